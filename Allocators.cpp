@@ -0,0 +1,78 @@
+/*
+ * Implementation of the frame arena.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include "Allocators.h"
+
+FrameArena::FrameArena(size_t blockSize)
+: current(0), offset(0), blockSize(blockSize)
+{
+	AllocationCounters zero = { 0, 0, 0, 0, 0 };
+	counters = zero;
+	addBlock(blockSize);
+}
+
+FrameArena::~FrameArena()
+{
+	for (Block *block = blocks.data(); block < blocks.data() + blocks.size(); block++)
+	{
+		::operator delete(block->memory);
+	}
+}
+
+void FrameArena::addBlock(size_t size)
+{
+	Block block = { static_cast<char*>(::operator new(size)), size };
+	blocks.push_back(block);
+	counters.heapBlocks++;
+	counters.reservedBytes += size;
+}
+
+void* FrameArena::allocate(size_t size, size_t alignment)
+{
+	size_t start = (offset + alignment - 1) & ~(alignment - 1);
+	if (start + size > blocks[current].size)
+	{
+		// Chain on a block big enough for this request. The blocks come
+		// from operator new, so their starts are suitably aligned.
+		addBlock(size > blockSize ? size : blockSize);
+		current = blocks.size() - 1;
+		start = 0;
+	}
+
+	offset = start + size;
+	counters.allocations++;
+	counters.live += size;
+	if (counters.live > counters.peakLive) counters.peakLive = counters.live;
+	return blocks[current].memory + start;
+}
+
+void FrameArena::reset()
+{
+	// Swap an overflowed chain for a single block that would have held it.
+	if (blocks.size() > 1)
+	{
+		size_t total = 0;
+		for (Block *block = blocks.data(); block < blocks.data() + blocks.size(); block++)
+		{
+			total += block->size;
+			::operator delete(block->memory);
+		}
+		blocks.clear();
+		counters.reservedBytes = 0;
+		blockSize = total;
+		addBlock(total);
+	}
+
+	current = 0;
+	offset = 0;
+	counters.live = 0;
+}
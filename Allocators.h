@@ -0,0 +1,213 @@
+/*
+ * Allocators that keep simulation objects together and off the heap once
+ * a level is running.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef ALLOCATORS_H
+#define ALLOCATORS_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+#include <vector>
+
+/** Counts kept by each allocator, so heap traffic can be checked. */
+struct AllocationCounters
+{
+	/** Blocks taken from the heap since the allocator was created. */
+	unsigned heapBlocks;
+	/** Bytes held in those blocks. */
+	size_t reservedBytes;
+	/** Objects or arrays handed out since the allocator was created. */
+	unsigned allocations;
+	/** Objects or bytes in use now, and the most there have been. */
+	size_t live;
+	size_t peakLive;
+};
+
+/**
+ * Hands out memory by bumping a pointer through large blocks, and takes
+ * it all back at once. Meant for data that only lives for one step, so
+ * it should only hold types that need no destructor.
+ *
+ * When a step overflows the first block more are chained on, and the next
+ * reset swaps them for one block big enough for the lot, so after the
+ * first few steps nothing more comes from the heap.
+ */
+class FrameArena
+{
+public:
+	/** Creates an arena whose first block holds the given number of bytes. */
+	explicit FrameArena(size_t blockSize = 64 * 1024);
+
+	~FrameArena();
+
+	/** Returns uninitialised memory with the given size and alignment. */
+	void* allocate(size_t size, size_t alignment);
+
+	/** Returns an array of default constructed objects. */
+	template <class T>
+	T* allocateArray(size_t count)
+	{
+		T *array = static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+		for (T *object = array; object < array + count; object++) new (object) T();
+		return array;
+	}
+
+	/** Takes back everything handed out since the last reset. */
+	void reset();
+
+	const AllocationCounters& getCounters() const { return counters; }
+
+private:
+	struct Block
+	{
+		char *memory;
+		size_t size;
+	};
+
+	std::vector<Block> blocks;
+	/** The block being bumped through, and how far into it. */
+	size_t current;
+	size_t offset;
+	size_t blockSize;
+
+	AllocationCounters counters;
+
+	void addBlock(size_t size);
+
+	FrameArena(const FrameArena&);
+	FrameArena& operator=(const FrameArena&);
+};
+
+/**
+ * Stores objects of one type in contiguous chunks and recycles their
+ * slots. Objects acquired one after another sit next to each other, and
+ * releasing objects only returns their slots to the pool, so once a level
+ * has been played through the heap isn't touched again.
+ */
+template <class T, unsigned ChunkSize = 256>
+class ObjectPool
+{
+public:
+	ObjectPool() : used(0)
+	{
+		AllocationCounters zero = { 0, 0, 0, 0, 0 };
+		counters = zero;
+	}
+
+	~ObjectPool()
+	{
+		releaseAll();
+		for (T **chunk = chunks.data(); chunk < chunks.data() + chunks.size(); chunk++)
+		{
+			::operator delete(*chunk);
+		}
+	}
+
+	/** Returns a default constructed object. */
+	T* acquire()
+	{
+		unsigned index;
+		if (!freeSlots.empty())
+		{
+			index = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		else
+		{
+			if (used == chunks.size() * ChunkSize) addChunk();
+			index = used++;
+			liveSlots.push_back(false);
+		}
+
+		T *object = slot(index);
+		new (object) T();
+		liveSlots[index] = true;
+
+		counters.allocations++;
+		if (++counters.live > counters.peakLive) counters.peakLive = counters.live;
+		return object;
+	}
+
+	/**
+	 * Destroys an object from this pool and keeps its slot for the next
+	 * acquire. The object must be one this pool handed out and hasn't
+	 * taken back yet; anything else asserts, and is ignored if asserts are
+	 * compiled out, rather than freeing some other slot.
+	 */
+	void release(T *object)
+	{
+		unsigned index = indexOf(object);
+		assert(index < used && liveSlots[index] && "Released an object this pool isn't holding");
+		if (index >= used || !liveSlots[index]) return;
+		object->~T();
+		liveSlots[index] = false;
+		freeSlots.push_back(index);
+		counters.live--;
+	}
+
+	/** Destroys every object, keeping the chunks. */
+	void releaseAll()
+	{
+		for (unsigned index = 0; index < used; index++)
+		{
+			if (liveSlots[index]) slot(index)->~T();
+		}
+		used = 0;
+		liveSlots.clear();
+		freeSlots.clear();
+		counters.live = 0;
+	}
+
+	const AllocationCounters& getCounters() const { return counters; }
+
+private:
+	std::vector<T*> chunks;
+	/** Slots ever handed out since the last releaseAll, and which hold objects. */
+	unsigned used;
+	std::vector<bool> liveSlots;
+	std::vector<unsigned> freeSlots;
+
+	AllocationCounters counters;
+
+	T* slot(unsigned index) { return chunks[index / ChunkSize] + index % ChunkSize; }
+
+	/** Returns the slot an object sits in, or used if it isn't at the start of one of this pool's slots. */
+	unsigned indexOf(const T *object) const
+	{
+		// Compared as addresses, since the pointer may not be into any chunk at all.
+		uintptr_t address = (uintptr_t)object;
+		for (unsigned chunk = 0; chunk < chunks.size(); chunk++)
+		{
+			uintptr_t first = (uintptr_t)chunks[chunk];
+			if (address >= first && address < first + sizeof(T) * ChunkSize)
+			{
+				if ((address - first) % sizeof(T) != 0) return used;
+				return chunk * ChunkSize + (unsigned)((address - first) / sizeof(T));
+			}
+		}
+		return used;
+	}
+
+	void addChunk()
+	{
+		chunks.push_back(static_cast<T*>(::operator new(sizeof(T) * ChunkSize)));
+		counters.heapBlocks++;
+		counters.reservedBytes += sizeof(T) * ChunkSize;
+	}
+
+	ObjectPool(const ObjectPool&);
+	ObjectPool& operator=(const ObjectPool&);
+};
+
+#endif // ALLOCATORS_H
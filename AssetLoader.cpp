@@ -0,0 +1,63 @@
+/*
+ * Implementation of the asset loader.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include "AssetLoader.h"
+#include "Profiler.h"
+
+AssetLoader::AssetLoader(unsigned threadCount)
+: threadCount(threadCount), stopping(false)
+{
+	if (this->threadCount == 0) this->threadCount = std::thread::hardware_concurrency();
+	if (this->threadCount == 0) this->threadCount = 1;
+}
+
+AssetLoader::~AssetLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		queue.clear();
+	}
+	wake.notify_all();
+	for (std::thread *thread = threads.data(); thread < threads.data() + threads.size(); thread++)
+	{
+		thread->join();
+	}
+}
+
+void AssetLoader::submit(const Job &job)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (threads.empty())
+	{
+		for (unsigned i = 0; i < threadCount; i++) threads.push_back(std::thread(&AssetLoader::threadLoop, this));
+	}
+	queue.push_back(job);
+	wake.notify_one();
+}
+
+void AssetLoader::threadLoop()
+{
+	Profiler::setThreadName("asset loader");
+	for (;;)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!stopping && queue.empty()) wake.wait(lock);
+			if (stopping) return;
+			job = queue.front();
+			queue.pop_front();
+		}
+		job();
+	}
+}
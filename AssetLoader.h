@@ -0,0 +1,60 @@
+/*
+ * Background threads that read and decode assets, leaving the GL thread
+ * free to upload them.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Runs loading jobs, first come first served, on a few threads of its
+ * own. The threads are only started by the first job, so programs that
+ * never load anything never pay for them. Jobs must not touch OpenGL.
+ */
+class AssetLoader
+{
+public:
+	typedef std::function<void()> Job;
+
+	/** Creates a loader with the given number of threads, or one per core if zero. */
+	explicit AssetLoader(unsigned threadCount = 0);
+
+	/** Drops the jobs that haven't started and waits for the running ones. */
+	~AssetLoader();
+
+	/** Queues a job to run on one of the loader's threads. */
+	void submit(const Job &job);
+
+	/** Returns how many threads run jobs. */
+	unsigned getThreadCount() const { return threadCount; }
+
+private:
+	unsigned threadCount;
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<Job> queue;
+	bool stopping;
+
+	void threadLoop();
+
+	AssetLoader(const AssetLoader&);
+	AssetLoader& operator=(const AssetLoader&);
+};
+
+#endif // ASSET_LOADER_H
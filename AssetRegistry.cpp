@@ -0,0 +1,406 @@
+/*
+ * Implementation of the shared asset registry.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include "AssetRegistry.h"
+#include "Profiler.h"
+#include "Texture.h"
+
+#include <stdio.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+typedef std::chrono::steady_clock Clock;
+
+static double millisecondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+AssetRegistry::AssetRegistry()
+: streamer(loader), assetsRequested(0), assetsLoaded(0)
+{
+}
+
+AssetRegistry& AssetRegistry::get()
+{
+	static AssetRegistry registry;
+	return registry;
+}
+
+void AssetRegistry::setProgressCallback(const AssetProgressCallback &callback)
+{
+	progressCallback = callback;
+}
+
+void AssetRegistry::reportLoaded(const std::string &path, double milliseconds)
+{
+	assetsLoaded++;
+	if (!progressCallback) return;
+
+	AssetLoadProgress progress;
+	progress.loaded = assetsLoaded;
+	progress.requested = assetsRequested;
+	progress.path = path.c_str();
+	progress.milliseconds = milliseconds;
+	progressCallback(progress);
+}
+
+MeshHandle AssetRegistry::findMesh(const std::string &name, size_t *freeSlot)
+{
+	*freeSlot = meshes.size();
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		if (meshes[i].references == 0)
+		{
+			if (*freeSlot == meshes.size()) *freeSlot = i;
+		}
+		else if (meshes[i].path == name)
+		{
+			meshes[i].references++;
+			return (MeshHandle)(i + 1);
+		}
+	}
+	return 0;
+}
+
+MeshHandle AssetRegistry::addMesh(size_t slot, const std::string &name, Mesh *mesh, double loadMilliseconds)
+{
+	ProfileScope scope("uploadMesh");
+	Clock::time_point start = Clock::now();
+
+	MeshEntry entry;
+	entry.path = name;
+	entry.references = 1;
+	entry.mesh = mesh;
+	entry.loadMilliseconds = loadMilliseconds;
+
+	// Resolve each material's texture through the registry so meshes share them.
+	entry.textures.resize(mesh->materialCount, 0);
+	entry.gpu.materialTextures.resize(mesh->materialCount, 0);
+	for (uint32_t i = 0; i < mesh->materialCount; i++)
+	{
+		if (mesh->materials[i].texture[0])
+		{
+			entry.textures[i] = acquireTexture(mesh->materials[i].texture);
+			entry.gpu.materialTextures[i] = getTextureName(entry.textures[i]);
+		}
+	}
+
+	GLuint buffers[2];
+	glGenBuffers(2, buffers);
+	entry.gpu.vertexBuffer = buffers[0];
+	entry.gpu.indexBuffer = buffers[1];
+	glBindBuffer(GL_ARRAY_BUFFER, entry.gpu.vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(MeshVertex) * mesh->vertexCount, mesh->vertices, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, entry.gpu.indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * (mesh->indexCount + mesh->lodIndexCount), NULL, GL_STATIC_DRAW);
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(uint32_t) * mesh->indexCount, mesh->indices);
+
+	// The levels of detail follow the full mesh in the same buffer.
+	if (mesh->lodIndexCount > 0)
+	{
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * mesh->indexCount,
+			sizeof(uint32_t) * mesh->lodIndexCount, mesh->lodIndices);
+	}
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	entry.uploadMilliseconds = millisecondsSince(start);
+
+	if (slot == meshes.size()) meshes.push_back(entry);
+	else meshes[slot] = entry;
+	reportLoaded(name, loadMilliseconds);
+	return (MeshHandle)(slot + 1);
+}
+
+MeshHandle AssetRegistry::acquireMesh(const char *objPath)
+{
+	size_t freeSlot;
+	MeshHandle handle = findMesh(objPath, &freeSlot);
+	if (handle) return handle;
+
+	assetsRequested++;
+	Clock::time_point start = Clock::now();
+	Mesh *mesh = new Mesh;
+	if (!mesh->load(objPath))
+	{
+		fprintf(stderr, "Could not load mesh %s\n", objPath);
+	}
+	return addMesh(freeSlot, objPath, mesh, millisecondsSince(start));
+}
+
+void AssetRegistry::loadMeshes(const char *const *objPaths, unsigned count, MeshHandle *handles)
+{
+	ProfileScope scope("loadMeshes");
+
+	// Parsed meshes are handed back through a list guarded by the mutex;
+	// only this thread touches the registry itself.
+	struct PendingMesh
+	{
+		std::string path;
+		Mesh *mesh;
+		bool loaded;
+		double milliseconds;
+	};
+	std::vector<PendingMesh> pending;
+	std::vector<unsigned> finished;
+	std::mutex mutex;
+	std::condition_variable ready;
+
+	// Meshes already registered are just referenced again, and a path
+	// given twice is only loaded once.
+	std::vector<unsigned> pendingOf(count, (unsigned)-1);
+	for (unsigned i = 0; i < count; i++)
+	{
+		size_t freeSlot;
+		handles[i] = findMesh(objPaths[i], &freeSlot);
+		if (handles[i]) continue;
+
+		for (unsigned j = 0; j < i; j++)
+		{
+			if (pendingOf[j] != (unsigned)-1 && pending[pendingOf[j]].path == objPaths[i]) pendingOf[i] = pendingOf[j];
+		}
+		if (pendingOf[i] != (unsigned)-1) continue;
+
+		PendingMesh entry = { objPaths[i], NULL, false, 0 };
+		pendingOf[i] = (unsigned)pending.size();
+		pending.push_back(entry);
+	}
+
+	assetsRequested += (unsigned)pending.size();
+	for (unsigned index = 0; index < pending.size(); index++)
+	{
+		PendingMesh *entry = &pending[index];
+		loader.submit([entry, index, &finished, &mutex, &ready]()
+		{
+			ProfileScope scope("parseMesh");
+			Clock::time_point start = Clock::now();
+			Mesh *mesh = new Mesh;
+			bool loaded = mesh->load(entry->path.c_str());
+			double milliseconds = millisecondsSince(start);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			entry->mesh = mesh;
+			entry->loaded = loaded;
+			entry->milliseconds = milliseconds;
+			finished.push_back(index);
+			ready.notify_one();
+		});
+	}
+
+	// Upload in the order the loads finish rather than the order asked for.
+	std::vector<MeshHandle> uploaded(pending.size(), 0);
+	for (size_t done = 0; done < pending.size(); done++)
+	{
+		unsigned index;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (finished.empty()) ready.wait(lock);
+			index = finished.back();
+			finished.pop_back();
+		}
+
+		PendingMesh &entry = pending[index];
+		if (!entry.loaded) fprintf(stderr, "Could not load mesh %s\n", entry.path.c_str());
+		size_t freeSlot;
+		findMesh(entry.path, &freeSlot);
+		uploaded[index] = addMesh(freeSlot, entry.path, entry.mesh, entry.milliseconds);
+	}
+
+	// The first user of each mesh holds the reference addMesh made.
+	std::vector<bool> claimed(pending.size(), false);
+	for (unsigned i = 0; i < count; i++)
+	{
+		if (handles[i]) continue;
+		handles[i] = uploaded[pendingOf[i]];
+		if (claimed[pendingOf[i]]) meshes[handles[i] - 1].references++;
+		claimed[pendingOf[i]] = true;
+	}
+}
+
+MeshHandle AssetRegistry::acquireSphereMesh(unsigned slices, unsigned stacks, const float diffuse[3])
+{
+	char name[96];
+	sprintf(name, "sphere:%ux%u:%.3f,%.3f,%.3f", slices, stacks, diffuse[0], diffuse[1], diffuse[2]);
+
+	size_t freeSlot;
+	MeshHandle handle = findMesh(name, &freeSlot);
+	if (handle) return handle;
+
+	assetsRequested++;
+	Clock::time_point start = Clock::now();
+	Mesh *mesh = new Mesh;
+	mesh->buildSphere(slices, stacks, diffuse);
+	return addMesh(freeSlot, name, mesh, millisecondsSince(start));
+}
+
+void AssetRegistry::releaseMesh(MeshHandle handle)
+{
+	if (handle == 0 || handle > meshes.size() || meshes[handle - 1].references == 0) return;
+
+	MeshEntry &entry = meshes[handle - 1];
+	if (--entry.references > 0) return;
+
+	GLuint buffers[2] = { entry.gpu.vertexBuffer, entry.gpu.indexBuffer };
+	glDeleteBuffers(2, buffers);
+	entry.gpu.materialTextures.clear();
+	for (size_t i = 0; i < entry.textures.size(); i++)
+	{
+		releaseTexture(entry.textures[i]);
+	}
+	delete entry.mesh;
+	entry.mesh = NULL;
+	entry.textures.clear();
+	entry.path.clear();
+}
+
+TextureHandle AssetRegistry::acquireTexture(const char *path)
+{
+	size_t freeSlot = textures.size();
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		if (textures[i].references == 0)
+		{
+			if (freeSlot == textures.size()) freeSlot = i;
+		}
+		else if (textures[i].path == path)
+		{
+			textures[i].references++;
+			return (TextureHandle)(i + 1);
+		}
+	}
+
+	TextureEntry entry;
+	entry.path = path;
+	entry.references = 1;
+	entry.name = createPlaceholderTexture();
+	entry.bytes = 0;
+	entry.stream = streamer.request(path);
+	entry.loadMilliseconds = 0;
+	entry.uploadMilliseconds = 0;
+	assetsRequested++;
+
+	if (freeSlot == textures.size()) textures.push_back(entry);
+	else textures[freeSlot] = entry;
+	return (TextureHandle)(freeSlot + 1);
+}
+
+void AssetRegistry::releaseTexture(TextureHandle handle)
+{
+	if (handle == 0 || handle > textures.size() || textures[handle - 1].references == 0) return;
+
+	TextureEntry &entry = textures[handle - 1];
+	if (--entry.references > 0) return;
+
+	if (entry.stream)
+	{
+		entry.stream->cancelled = true;
+		entry.stream.reset();
+	}
+	if (entry.name) glDeleteTextures(1, &entry.name);
+	entry.name = 0;
+	entry.bytes = 0;
+	entry.path.clear();
+}
+
+unsigned AssetRegistry::updateStreaming(size_t byteBudget)
+{
+	ProfileScope scope("updateStreaming");
+	unsigned streaming = 0;
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		TextureEntry &entry = textures[i];
+		if (!entry.stream) continue;
+
+		if (byteBudget > 0)
+		{
+			Clock::time_point start = Clock::now();
+			size_t bytes = streamer.upload(*entry.stream, entry.name, &byteBudget);
+			if (bytes > 0) entry.uploadMilliseconds += millisecondsSince(start);
+			entry.bytes += bytes;
+		}
+		if (!TextureStreamer::isComplete(*entry.stream))
+		{
+			streaming++;
+			continue;
+		}
+
+		// A texture that failed to load keeps its white placeholder.
+		if (entry.stream->failed) fprintf(stderr, "Could not load texture %s\n", entry.path.c_str());
+		entry.loadMilliseconds = entry.stream->loadMilliseconds;
+		entry.stream.reset();
+		reportLoaded(entry.path, entry.loadMilliseconds);
+	}
+	return streaming;
+}
+
+const Mesh& AssetRegistry::getMesh(MeshHandle handle) const
+{
+	return *meshes[handle - 1].mesh;
+}
+
+const GpuMesh& AssetRegistry::getGpuMesh(MeshHandle handle) const
+{
+	return meshes[handle - 1].gpu;
+}
+
+GLuint AssetRegistry::getTextureName(TextureHandle handle) const
+{
+	return handle ? textures[handle - 1].name : 0;
+}
+
+AssetMemory AssetRegistry::getMemoryUsage() const
+{
+	AssetMemory memory = { 0, 0, 0, 0, 0 };
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		if (meshes[i].references == 0) continue;
+		memory.meshes++;
+		memory.meshBytes += meshes[i].mesh->getMemoryUsage();
+	}
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		if (textures[i].references == 0) continue;
+		memory.textures++;
+		memory.textureBytes += textures[i].bytes;
+		if (textures[i].stream) memory.streamingTextures++;
+	}
+	return memory;
+}
+
+void AssetRegistry::printReport() const
+{
+	AssetMemory memory = getMemoryUsage();
+	printf("Assets: %u meshes (%.1f KB), %u textures (%.1f MB, %u still streaming), %u loader threads\n",
+		memory.meshes, memory.meshBytes / 1024.0,
+		memory.textures, memory.textureBytes / (1024.0 * 1024.0), memory.streamingTextures,
+		loader.getThreadCount());
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		if (meshes[i].references == 0) continue;
+		printf("  %s: %u users, %.1f KB, loaded in %.1f ms, uploaded in %.1f ms\n", meshes[i].path.c_str(),
+			meshes[i].references, meshes[i].mesh->getMemoryUsage() / 1024.0,
+			meshes[i].loadMilliseconds, meshes[i].uploadMilliseconds);
+	}
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		if (textures[i].references == 0) continue;
+		if (textures[i].stream)
+		{
+			printf("  %s: %u users, streaming\n", textures[i].path.c_str(), textures[i].references);
+			continue;
+		}
+		printf("  %s: %u users, %.1f KB, loaded in %.1f ms, uploaded in %.1f ms\n", textures[i].path.c_str(),
+			textures[i].references, textures[i].bytes / 1024.0,
+			textures[i].loadMilliseconds, textures[i].uploadMilliseconds);
+	}
+}
@@ -0,0 +1,190 @@
+/*
+ * Shared, reference counted store for meshes and textures.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef ASSET_REGISTRY_H
+#define ASSET_REGISTRY_H
+
+#include <gl/glew.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include "AssetLoader.h"
+#include "Mesh.h"
+#include "TextureStreamer.h"
+
+/** Lightweight references to registered assets. Zero is never a valid handle. */
+typedef unsigned MeshHandle;
+typedef unsigned TextureHandle;
+
+/** The OpenGL buffers and textures used to draw a mesh. */
+struct GpuMesh
+{
+	/** Interleaved MeshVertex data. */
+	GLuint vertexBuffer;
+	/** 32 bit triangle indices. */
+	GLuint indexBuffer;
+	/** Texture name for each material, in material order (zero for none). */
+	std::vector<GLuint> materialTextures;
+};
+
+/** Summary of what the registry currently holds. */
+struct AssetMemory
+{
+	unsigned meshes;
+	unsigned textures;
+	/** Bytes of mesh geometry, whether parsed or mapped from the cache. */
+	size_t meshBytes;
+	/** Bytes of texture memory uploaded so far, including mip-maps. */
+	size_t textureBytes;
+	/** Textures whose levels are still arriving. */
+	unsigned streamingTextures;
+};
+
+/** Passed to the progress callback each time an asset finishes loading. */
+struct AssetLoadProgress
+{
+	/** Assets finished so far, out of all those asked for. */
+	unsigned loaded;
+	unsigned requested;
+	const char *path;
+	/** Time spent reading and decoding the asset, off the GL thread where possible. */
+	double milliseconds;
+};
+
+typedef std::function<void(const AssetLoadProgress&)> AssetProgressCallback;
+
+/**
+ * Loads each mesh and texture once, no matter how many objects use it, and
+ * hands out handles to them. Every acquire must be matched by a release;
+ * an asset is freed when its last user releases it.
+ *
+ * Each mesh's geometry is uploaded once into static vertex and index
+ * buffers when it's first acquired, so acquiring a mesh requires a GL
+ * context.
+ *
+ * Textures stream in: acquiring one hands back a white placeholder at once,
+ * and updateStreaming fills in its mip levels, smallest first, as the
+ * loader threads read them. Meshes wanted at startup can be loaded together
+ * with loadMeshes, which parses them on the loader threads and leaves only
+ * the uploads to the GL thread.
+ */
+class AssetRegistry
+{
+public:
+	/** Returns the registry shared by the whole application. */
+	static AssetRegistry& get();
+
+	/** Returns a handle to the mesh loaded from the given OBJ file, loading it if needed. */
+	MeshHandle acquireMesh(const char *objPath);
+
+	/**
+	 * Acquires several meshes at once, writing a handle for each path.
+	 * The files are parsed in parallel on the loader threads while this
+	 * thread uploads each mesh as soon as it's ready, and starts its
+	 * textures streaming. Blocks until every mesh is uploaded.
+	 */
+	void loadMeshes(const char *const *objPaths, unsigned count, MeshHandle *handles);
+
+	/**
+	 * Returns a handle to a unit sphere mesh of the given tessellation and
+	 * colour, building it if needed.
+	 */
+	MeshHandle acquireSphereMesh(unsigned slices, unsigned stacks, const float diffuse[3]);
+
+	/** Drops a reference to a mesh, freeing it along with its textures when unused. */
+	void releaseMesh(MeshHandle handle);
+
+	/** Returns a handle to the texture loaded from the given PPM file, starting to load it if needed. */
+	TextureHandle acquireTexture(const char *path);
+
+	/** Drops a reference to a texture, deleting it when unused. */
+	void releaseTexture(TextureHandle handle);
+
+	/** Returns the CPU copy of a mesh's geometry. */
+	const Mesh& getMesh(MeshHandle handle) const;
+
+	/** Returns the GPU buffers and textures of a mesh. */
+	const GpuMesh& getGpuMesh(MeshHandle handle) const;
+
+	/** Returns the OpenGL name of a texture, or zero if it failed to load. */
+	GLuint getTextureName(TextureHandle handle) const;
+
+	/**
+	 * Uploads texture levels that have finished loading, up to about the
+	 * given number of bytes. Call once a frame on the GL thread. Returns
+	 * the number of textures still streaming.
+	 */
+	unsigned updateStreaming(size_t byteBudget = 4 * 1024 * 1024);
+
+	/**
+	 * Sets a function to call on the GL thread each time a mesh is uploaded
+	 * or a texture finishes streaming. Pass an empty function to stop.
+	 */
+	void setProgressCallback(const AssetProgressCallback &callback);
+
+	/** Totals the assets currently loaded. */
+	AssetMemory getMemoryUsage() const;
+
+	/** Prints the memory report, with how long each asset took to load, to the console. */
+	void printReport() const;
+
+private:
+	struct MeshEntry
+	{
+		std::string path;
+		unsigned references;
+		Mesh *mesh;
+		GpuMesh gpu;
+		/** Textures used by each material, in material order (zero for none). */
+		std::vector<TextureHandle> textures;
+		/** Time spent parsing or building the mesh, and uploading it. */
+		double loadMilliseconds, uploadMilliseconds;
+	};
+
+	struct TextureEntry
+	{
+		std::string path;
+		unsigned references;
+		GLuint name;
+		size_t bytes;
+		/** The levels still on their way, until the last is uploaded. */
+		std::shared_ptr<TextureStream> stream;
+		/** Time the loader spent on the cache, and the GL thread spent uploading it. */
+		double loadMilliseconds, uploadMilliseconds;
+	};
+
+	/** Slots are reused once released; a handle is its slot index plus one. */
+	std::vector<MeshEntry> meshes;
+	std::vector<TextureEntry> textures;
+
+	/** Runs mesh parsing and texture reads; declared first so it outlives the streamer. */
+	AssetLoader loader;
+
+	/** Reads texture caches in the background. */
+	TextureStreamer streamer;
+
+	AssetProgressCallback progressCallback;
+	unsigned assetsRequested, assetsLoaded;
+
+	AssetRegistry();
+
+	/** Counts an asset as finished and tells the progress callback. */
+	void reportLoaded(const std::string &path, double milliseconds);
+
+	/** Returns the handle of the mesh registered under a name, bumping its count, or zero. */
+	MeshHandle findMesh(const std::string &name, size_t *freeSlot);
+
+	/** Uploads a loaded mesh and its textures and stores it in the given slot. */
+	MeshHandle addMesh(size_t slot, const std::string &name, Mesh *mesh, double loadMilliseconds);
+};
+
+#endif // ASSET_REGISTRY_H
@@ -0,0 +1,247 @@
+/*
+ * Implementation of the batched SIMD integrators.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include "BatchIntegrator.h"
+
+#include <atomic>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define BATCH_SIMD
+#endif
+
+#ifdef BATCH_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define BATCH_TARGET_SSE
+#define BATCH_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define BATCH_TARGET_SSE __attribute__((target("sse2")))
+#define BATCH_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+typedef cyclone::real real;
+
+#ifdef BATCH_SIMD
+// The kernels are written once against these, which hold four or eight
+// single precision lanes, or two or four double precision ones.
+#ifdef SINGLE_PRECISION
+typedef __m128 SseReals;
+typedef __m256 AvxReals;
+#define SSE_LOAD _mm_loadu_ps
+#define SSE_STORE _mm_storeu_ps
+#define SSE_SET1 _mm_set1_ps
+#define SSE_ADD _mm_add_ps
+#define SSE_SUB _mm_sub_ps
+#define SSE_MUL _mm_mul_ps
+#define AVX_LOAD _mm256_loadu_ps
+#define AVX_STORE _mm256_storeu_ps
+#define AVX_SET1 _mm256_set1_ps
+#define AVX_ADD _mm256_add_ps
+#define AVX_SUB _mm256_sub_ps
+#define AVX_MUL _mm256_mul_ps
+#else
+typedef __m128d SseReals;
+typedef __m256d AvxReals;
+#define SSE_LOAD _mm_loadu_pd
+#define SSE_STORE _mm_storeu_pd
+#define SSE_SET1 _mm_set1_pd
+#define SSE_ADD _mm_add_pd
+#define SSE_SUB _mm_sub_pd
+#define SSE_MUL _mm_mul_pd
+#define AVX_LOAD _mm256_loadu_pd
+#define AVX_STORE _mm256_storeu_pd
+#define AVX_SET1 _mm256_set1_pd
+#define AVX_ADD _mm256_add_pd
+#define AVX_SUB _mm256_sub_pd
+#define AVX_MUL _mm256_mul_pd
+#endif
+
+/** Lanes in each kind of vector. */
+static const unsigned sseLanes = sizeof(SseReals) / sizeof(real);
+static const unsigned avxLanes = sizeof(AvxReals) / sizeof(real);
+#endif
+
+/** The path in use, or -1 before the first kernel runs. Galleries on several threads may read it at once. */
+static std::atomic<int> activePath(-1);
+
+#ifdef BATCH_SIMD
+/** Reads a CPUID leaf into eax, ebx, ecx and edx. */
+static void cpuid(unsigned leaf, unsigned registers[4])
+{
+#ifdef _MSC_VER
+	int values[4];
+	__cpuidex(values, (int)leaf, 0);
+	for (unsigned i = 0; i < 4; i++) registers[i] = (unsigned)values[i];
+#else
+	registers[0] = registers[1] = registers[2] = registers[3] = 0;
+	__get_cpuid_count(leaf, 0, &registers[0], &registers[1], &registers[2], &registers[3]);
+#endif
+}
+
+/** Returns the low half of the extended control register that says which vector state the OS saves. */
+static unsigned long long readXcr0()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned eax, edx;
+	__asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+#endif
+
+static IntegrationPath detectIntegrationPath()
+{
+#ifdef BATCH_SIMD
+	unsigned features[4], extended[4];
+	cpuid(0, features);
+	unsigned maxLeaf = features[0];
+
+	cpuid(1, features);
+	bool sse2 = (features[3] & (1u << 26)) != 0;
+	bool osxsave = (features[2] & (1u << 27)) != 0;
+	bool avx = (features[2] & (1u << 28)) != 0;
+	if (!sse2) return INTEGRATE_SCALAR;
+
+	// AVX registers are only usable if the OS saves them on a context switch.
+	if (maxLeaf >= 7 && osxsave && avx && (readXcr0() & 6) == 6)
+	{
+		cpuid(7, extended);
+		if (extended[1] & (1u << 5)) return INTEGRATE_AVX2;
+	}
+	return INTEGRATE_SSE;
+#else
+	return INTEGRATE_SCALAR;
+#endif
+}
+
+IntegrationPath getSupportedIntegrationPath()
+{
+	static const IntegrationPath supported = detectIntegrationPath();
+	return supported;
+}
+
+IntegrationPath getIntegrationPath()
+{
+	if (activePath < 0) activePath = getSupportedIntegrationPath();
+	return (IntegrationPath)activePath.load();
+}
+
+void setIntegrationPath(IntegrationPath path)
+{
+	IntegrationPath supported = getSupportedIntegrationPath();
+	activePath = path < supported ? path : supported;
+}
+
+const char* getIntegrationPathName(IntegrationPath path)
+{
+	switch (path)
+	{
+	case INTEGRATE_SSE: return "SSE";
+	case INTEGRATE_AVX2: return "AVX2";
+	default: return "scalar";
+	}
+}
+
+// Rounds. Each kernel handles whole vectors and returns how many rounds it
+// covered; the scalar kernel finishes the rest. All three do the same
+// operations in the same order, so they give identical results.
+
+static void integrateRoundsScalar(real *px, real *py, real *pz, real *vx, real *vy, real *vz,
+	const real *g, const real *factor, unsigned begin, unsigned end, real duration)
+{
+	for (unsigned i = begin; i < end; i++)
+	{
+		real x = vx[i] * factor[i];
+		real y = (vy[i] - g[i] * duration) * factor[i];
+		real z = vz[i] * factor[i];
+		vx[i] = x;
+		vy[i] = y;
+		vz[i] = z;
+		px[i] += x * duration;
+		py[i] += y * duration;
+		pz[i] += z * duration;
+	}
+}
+
+#ifdef BATCH_SIMD
+BATCH_TARGET_SSE static unsigned integrateRoundsSse(real *px, real *py, real *pz, real *vx, real *vy, real *vz,
+	const real *g, const real *factor, unsigned count, real duration)
+{
+	SseReals dt = SSE_SET1(duration);
+	unsigned end = count - count % sseLanes;
+	for (unsigned i = 0; i < end; i += sseLanes)
+	{
+		SseReals f = SSE_LOAD(factor + i);
+		SseReals x = SSE_MUL(SSE_LOAD(vx + i), f);
+		SseReals y = SSE_MUL(SSE_SUB(SSE_LOAD(vy + i), SSE_MUL(SSE_LOAD(g + i), dt)), f);
+		SseReals z = SSE_MUL(SSE_LOAD(vz + i), f);
+		SSE_STORE(vx + i, x);
+		SSE_STORE(vy + i, y);
+		SSE_STORE(vz + i, z);
+		SSE_STORE(px + i, SSE_ADD(SSE_LOAD(px + i), SSE_MUL(x, dt)));
+		SSE_STORE(py + i, SSE_ADD(SSE_LOAD(py + i), SSE_MUL(y, dt)));
+		SSE_STORE(pz + i, SSE_ADD(SSE_LOAD(pz + i), SSE_MUL(z, dt)));
+	}
+	return end;
+}
+
+BATCH_TARGET_AVX2 static unsigned integrateRoundsAvx2(real *px, real *py, real *pz, real *vx, real *vy, real *vz,
+	const real *g, const real *factor, unsigned count, real duration)
+{
+	AvxReals dt = AVX_SET1(duration);
+	unsigned end = count - count % avxLanes;
+	for (unsigned i = 0; i < end; i += avxLanes)
+	{
+		AvxReals f = AVX_LOAD(factor + i);
+		AvxReals x = AVX_MUL(AVX_LOAD(vx + i), f);
+		AvxReals y = AVX_MUL(AVX_SUB(AVX_LOAD(vy + i), AVX_MUL(AVX_LOAD(g + i), dt)), f);
+		AvxReals z = AVX_MUL(AVX_LOAD(vz + i), f);
+		AVX_STORE(vx + i, x);
+		AVX_STORE(vy + i, y);
+		AVX_STORE(vz + i, z);
+		AVX_STORE(px + i, AVX_ADD(AVX_LOAD(px + i), AVX_MUL(x, dt)));
+		AVX_STORE(py + i, AVX_ADD(AVX_LOAD(py + i), AVX_MUL(y, dt)));
+		AVX_STORE(pz + i, AVX_ADD(AVX_LOAD(pz + i), AVX_MUL(z, dt)));
+	}
+	return end;
+}
+#endif
+
+void integrateRounds(real *positionX, real *positionY, real *positionZ,
+	real *velocityX, real *velocityY, real *velocityZ,
+	const real *gravity, const real *dampingFactor,
+	unsigned count, real duration)
+{
+	unsigned done = 0;
+#ifdef BATCH_SIMD
+	switch (getIntegrationPath())
+	{
+	case INTEGRATE_AVX2:
+		done = integrateRoundsAvx2(positionX, positionY, positionZ, velocityX, velocityY, velocityZ,
+			gravity, dampingFactor, count, duration);
+		break;
+	case INTEGRATE_SSE:
+		done = integrateRoundsSse(positionX, positionY, positionZ, velocityX, velocityY, velocityZ,
+			gravity, dampingFactor, count, duration);
+		break;
+	default:
+		break;
+	}
+#endif
+	integrateRoundsScalar(positionX, positionY, positionZ, velocityX, velocityY, velocityZ,
+		gravity, dampingFactor, done, count, duration);
+}
@@ -0,0 +1,47 @@
+/*
+ * Batched SIMD integration of rounds.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef BATCH_INTEGRATOR_H
+#define BATCH_INTEGRATOR_H
+
+#include <cyclone.h>
+
+/** Instruction sets the batch kernels can use, from slowest to fastest. */
+enum IntegrationPath
+{
+	INTEGRATE_SCALAR = 0,
+	INTEGRATE_SSE,
+	INTEGRATE_AVX2
+};
+
+/** Returns the fastest path this processor and build support. */
+IntegrationPath getSupportedIntegrationPath();
+
+/** Returns the path the kernels currently run on. */
+IntegrationPath getIntegrationPath();
+
+/** Selects the path the kernels run on, limited to what is supported. */
+void setIntegrationPath(IntegrationPath path);
+
+/** Returns a printable name for the path. */
+const char* getIntegrationPathName(IntegrationPath path);
+
+/**
+ * Integrates a batch of rounds stored as separate arrays. Gravity points
+ * down and the damping factors are for one step of the given duration.
+ */
+void integrateRounds(cyclone::real *positionX, cyclone::real *positionY, cyclone::real *positionZ,
+	cyclone::real *velocityX, cyclone::real *velocityY, cyclone::real *velocityZ,
+	const cyclone::real *gravity, const cyclone::real *dampingFactor,
+	unsigned count, cyclone::real duration);
+
+#endif // BATCH_INTEGRATOR_H
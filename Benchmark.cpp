@@ -0,0 +1,564 @@
+/*
+ * Headless benchmark harness for the Shooting Gallery.
+ *
+ * Drives the simulation from a scripted input stream at a fixed timestep,
+ * with no GLUT window or OpenGL context, and reports throughput, per-phase
+ * timings and the final score. Build it in place of the demo framework's
+ * main.cpp with SHOOTING_GALLERY_HEADLESS defined.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifdef SHOOTING_GALLERY_HEADLESS
+
+#include "BatchIntegrator.h"
+#include "SessionBatch.h"
+#include "ShootingGallery.h"
+#include "SnapshotStream.h"
+
+#include <algorithm>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+/** A keypress delivered to the game at the start of a given step. */
+struct ScriptedInput
+{
+	unsigned step;
+	unsigned char key;
+};
+
+/** Describes a single benchmark run. */
+struct BenchmarkScenario
+{
+	const char *name;
+	unsigned targets;
+	unsigned rounds;
+	unsigned steps;
+	/** Number of steps between shots. */
+	unsigned fireInterval;
+	cyclone::real timestep;
+	ShotType weapon;
+	/** Muzzle speed in units per second, or zero for the weapon's own. */
+	cyclone::real muzzleSpeed;
+};
+
+/** The scenarios run when no options are given on the command line. */
+static const BenchmarkScenario defaultScenarios[] =
+{
+	{ "10 targets / 6 rounds", 10, 6, 3600, 30, 1.0f / 60.0f, PISTOL, 0 },
+	{ "10k targets / 1k rounds", 10000, 1000, 300, 1, 1.0f / 60.0f, PISTOL, 0 },
+	{ "shotgun / 4k pellets", 10, 4096, 600, 1, 1.0f / 60.0f, SHOTGUN, 0 },
+	{ "400 units/s rounds at 30Hz", 10, 6, 1800, 15, 1.0f / 30.0f, PISTOL, 400 },
+};
+
+/** Threads sharing the collision work, or zero for one per core. */
+static unsigned workerCount = 0;
+
+/** Where to write a Chrome trace of the run, if anywhere. */
+static const char *tracePath = NULL;
+
+/** The layout read with --scenario, used in place of the built-in one. */
+static Scenario fileScenario;
+static bool useFileScenario = false;
+
+/** A session read with --replay, played in place of the scripted input. */
+static InputRecording replay;
+static bool useReplay = false;
+
+/** Where --record saves the run's input, if anywhere. */
+static const char *recordPath = NULL;
+
+/** Independent sessions to run side by side with --sessions, or zero for a single gallery. */
+static unsigned sessionCount = 0;
+
+/** Whether --spectate streams every step to a loopback spectator. */
+static bool spectate = false;
+
+/** Bodies and rounds to integrate with --integrate, or zero to run the gallery. */
+static unsigned integrateCount = 0;
+
+/** What streaming a run to a spectator cost, and how far the spectator's world strayed. */
+struct SpectatorStats
+{
+	unsigned keyframes, deltas;
+	double keyframeBytes, deltaBytes;
+	double encodeMs, decodeMs;
+	double worstError;
+	bool lost;
+};
+
+/**
+ * Sends the gallery's state after a step through the snapshot stream and
+ * compares what the spectator rebuilt with it.
+ */
+static void streamStep(const ShootingGallery &gallery, SnapshotEncoder &encoder, SpectatorClient &client,
+	WorldSnapshot &world, std::vector<unsigned char> &frame, SpectatorStats &stats)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+	gallery.captureSnapshot(world);
+	frame.clear();
+	Clock::time_point start = Clock::now();
+	bool keyframe = encoder.encode(world, &frame);
+	Clock::time_point encoded = Clock::now();
+	if (!client.receive(frame.data(), frame.size())) stats.lost = true;
+	stats.encodeMs += Milliseconds(encoded - start).count();
+	stats.decodeMs += Milliseconds(Clock::now() - encoded).count();
+
+	if (keyframe) { stats.keyframes++; stats.keyframeBytes += frame.size(); }
+	else { stats.deltas++; stats.deltaBytes += frame.size(); }
+
+	const WorldSnapshot &rebuilt = client.getWorld();
+	if (rebuilt.bullseyes.size() != world.bullseyes.size() || rebuilt.rounds.size() != world.rounds.size() ||
+		rebuilt.score != world.score || rebuilt.ammoCount != world.ammoCount)
+	{
+		stats.lost = true;
+		return;
+	}
+	for (size_t i = 0; i < world.bullseyes.size(); i++)
+	{
+		cyclone::Vector3 error = rebuilt.bullseyes[i].position - world.bullseyes[i].position;
+		stats.worstError = std::max(stats.worstError, (double)error.magnitude());
+	}
+	for (size_t i = 0; i < world.rounds.size(); i++)
+	{
+		for (unsigned j = 0; j < 3; j++)
+		{
+			stats.worstError = std::max(stats.worstError, (double)fabs(rebuilt.rounds[i].current[j] - world.rounds[i].current[j]));
+		}
+	}
+}
+
+/**
+ * Builds the input script for a scenario: the gun sweeps left and right
+ * across the gallery while firing at a fixed interval.
+ */
+static std::vector<ScriptedInput> buildScript(const BenchmarkScenario &scenario)
+{
+	std::vector<ScriptedInput> script;
+
+	// Select the weapon before anything else happens.
+	unsigned char weaponKey = scenario.weapon == SHOTGUN ? '2' : scenario.weapon == HITSCAN ? '3' : '1';
+	ScriptedInput weapon = { 0, weaponKey };
+	script.push_back(weapon);
+
+	for (unsigned step = 0; step < scenario.steps; step++)
+	{
+		// Each yaw keypress turns the gun half a degree, so a 160 step
+		// cycle sweeps 20 degrees either side of centre.
+		unsigned phase = step % 160;
+		ScriptedInput aim = { step, (unsigned char)((phase < 40 || phase >= 120) ? 'a' : 'd') };
+		script.push_back(aim);
+
+		if (step % scenario.fireInterval == 0)
+		{
+			ScriptedInput shot = { step, ' ' };
+			script.push_back(shot);
+		}
+	}
+	return script;
+}
+
+/**
+ * Writes the trace asked for with --trace, if any. It is written while the
+ * run's threads are still alive, since a thread's scopes are dropped when
+ * it exits. Returns false if the file couldn't be written.
+ */
+static bool writeTrace()
+{
+	if (!tracePath) return true;
+
+	// The rings only hold each thread's latest steps, so the trace covers the end of the run.
+	int events = Profiler::get().exportChromeTrace(tracePath);
+	if (events < 0)
+	{
+		fprintf(stderr, "Could not write %s\n", tracePath);
+		return false;
+	}
+	printf("  wrote %d events to %s\n", events, tracePath);
+	return true;
+}
+
+/**
+ * Runs one scenario and prints its results. Returns false if a replay
+ * didn't end as its recording did, or a recording couldn't be saved.
+ */
+static bool runScenario(const BenchmarkScenario &scenario)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+	Scenario layout = fileScenario;
+	if (!useFileScenario) layout.setStandard(scenario.targets, scenario.rounds);
+	ShootingGallery gallery(layout);
+	gallery.setMuzzleSpeed(scenario.muzzleSpeed);
+	gallery.setFixedTimestep(scenario.timestep);
+	if (workerCount > 0) gallery.setWorkerCount(workerCount);
+
+	std::vector<ScriptedInput> script;
+	if (!useReplay) script = buildScript(scenario);
+	else if (!gallery.startReplay(replay)) return false;
+	if (recordPath) gallery.startRecording();
+
+	StepTimings total = { 0, 0, 0, 0 }, frame;
+	unsigned peakRounds = 0;
+	double candidatePairs = 0, shotContacts = 0, possiblePairs = 0, activeBullseyes = 0, rayQueries = 0, rayHits = 0, sceneryHits = 0;
+	size_t next = 0;
+
+	SnapshotEncoder encoder;
+	SpectatorClient client;
+	WorldSnapshot world;
+	std::vector<unsigned char> streamFrame;
+	SpectatorStats spectator = { 0, 0, 0, 0, 0, 0, 0, false };
+	double spectatorWall = 0;
+
+	Clock::time_point start = Clock::now();
+	for (unsigned step = 0; step < scenario.steps; step++)
+	{
+		while (next < script.size() && script[next].step == step)
+		{
+			gallery.key(script[next++].key);
+		}
+
+		gallery.step(scenario.timestep, &frame);
+		total.updateObjects += frame.updateObjects;
+		total.generateContacts += frame.generateContacts;
+		total.resolveContacts += frame.resolveContacts;
+		total.integrate += frame.integrate;
+
+		candidatePairs += gallery.getCollisionCounters().candidatePairs;
+		shotContacts += gallery.getCollisionCounters().shotContacts;
+		activeBullseyes += gallery.getActiveBullseyes();
+		rayQueries += gallery.getCollisionCounters().rayQueries;
+		rayHits += gallery.getCollisionCounters().rayHits;
+		sceneryHits += gallery.getCollisionCounters().sceneryHits;
+
+		unsigned live = gallery.getLiveRounds();
+		possiblePairs += (double)live * scenario.targets;
+		if (live > peakRounds) peakRounds = live;
+
+		// The spectator's work is kept out of the frame rate.
+		if (spectate)
+		{
+			Clock::time_point streamed = Clock::now();
+			streamStep(gallery, encoder, client, world, streamFrame, spectator);
+			spectatorWall += Milliseconds(Clock::now() - streamed).count();
+		}
+	}
+	double elapsed = Milliseconds(Clock::now() - start).count() - spectatorWall;
+
+	printf("%s\n", scenario.name);
+	printf("  steps: %u of %.4fs (%.1fs simulated)\n",
+		scenario.steps, scenario.timestep, scenario.steps * scenario.timestep);
+	printf("  frames/sec: %.1f\n", scenario.steps * 1000.0 / elapsed);
+	printf("  updateObjects: %.4f ms/step\n", total.updateObjects / scenario.steps);
+	printf("    integrate: %.4f ms/step (%s)\n", total.integrate / scenario.steps, getIntegrationPathName(getIntegrationPath()));
+	printf("  generateContacts: %.4f ms/step\n", total.generateContacts / scenario.steps);
+	printf("  resolveContacts: %.4f ms/step (%u workers)\n", total.resolveContacts / scenario.steps, gallery.getWorkerCount());
+	printf("  candidate pairs: %.1f/step (of %.1f possible), shot contacts: %.0f\n",
+		candidatePairs / scenario.steps, possiblePairs / scenario.steps, shotContacts);
+	if (rayQueries > 0) printf("  hitscan shots: %.0f, hits: %.0f\n", rayQueries, rayHits);
+	if (sceneryHits > 0) printf("  rounds stopped by the scenery: %.0f\n", sceneryHits);
+	printf("  active bullseyes: %.1f/step (of %u)\n", activeBullseyes / scenario.steps, scenario.targets);
+	printf("  peak live rounds: %u\n", peakRounds);
+	printf("  final score: %d of %u\n", gallery.getScore(), scenario.targets);
+	if (spectate)
+	{
+		printf("  spectator stream: %u keyframes of %.0f bytes, %u deltas of %.1f bytes on average\n",
+			spectator.keyframes, spectator.keyframes ? spectator.keyframeBytes / spectator.keyframes : 0.0,
+			spectator.deltas, spectator.deltas ? spectator.deltaBytes / spectator.deltas : 0.0);
+		printf("    encode: %.4f ms/step, decode: %.4f ms/step, worst position error: %.5f%s\n",
+			spectator.encodeMs / scenario.steps, spectator.decodeMs / scenario.steps, spectator.worstError,
+			spectator.lost ? " (the spectator lost the stream)" : "");
+	}
+
+	// Once the first steps have warmed the allocators up, these shouldn't grow with the run's length.
+	GalleryAllocations allocations = gallery.getAllocations();
+	printf("  heap blocks: bodies %u, proxies %u, step arena %u (peak %.1f KB/step)\n",
+		allocations.bodies.heapBlocks, allocations.proxies.heapBlocks, allocations.step.heapBlocks,
+		allocations.step.peakLive / 1024.0);
+
+	bool ok = true;
+	if (recordPath)
+	{
+		const InputRecording &recording = gallery.stopRecording();
+		ok = recording.save(recordPath);
+		if (!ok) fprintf(stderr, "Could not write %s\n", recordPath);
+		else printf("  recorded %u keypresses to %s\n", (unsigned)recording.events.size(), recordPath);
+	}
+	if (useReplay)
+	{
+		ok = gallery.replayFinished() && gallery.replayMatched();
+		printf("  replay %s the recording\n", ok ? "matched" : "diverged from");
+	}
+	return writeTrace() && ok;
+}
+
+/**
+ * Runs many sessions of a scenario at once, each playing the scenario's
+ * script, and prints the aggregate throughput and the spread of scores.
+ * Returns false if the trace couldn't be written.
+ */
+static bool runSessions(const BenchmarkScenario &scenario)
+{
+	Scenario layout = fileScenario;
+	if (!useFileScenario) layout.setStandard(scenario.targets, scenario.rounds);
+	layout.timestep = scenario.timestep;
+	SessionBatch batch(layout, sessionCount, workerCount);
+	// Recording costs throughput, so the sessions only record when a trace is wanted.
+	batch.setProfiling(tracePath != NULL);
+	for (unsigned i = 0; i < batch.getSessionCount(); i++)
+	{
+		batch.getSession(i).setMuzzleSpeed(scenario.muzzleSpeed);
+	}
+
+	// The script is only read, so every session shares it.
+	std::vector<ScriptedInput> script = buildScript(scenario);
+	SessionBatchTimings timings = batch.run(scenario.steps, [&script](unsigned session, unsigned step, ShootingGallery &gallery)
+	{
+		ScriptedInput first = { step, 0 };
+		for (std::vector<ScriptedInput>::const_iterator input = std::lower_bound(script.begin(), script.end(), first,
+			[](const ScriptedInput &a, const ScriptedInput &b) { return a.step < b.step; });
+			input != script.end() && input->step == step; ++input)
+		{
+			gallery.key(input->key);
+		}
+	});
+
+	int lowest = 0, highest = 0;
+	double total = 0;
+	for (unsigned i = 0; i < batch.getSessionCount(); i++)
+	{
+		int score = batch.getSession(i).getScore();
+		if (i == 0 || score < lowest) lowest = score;
+		if (i == 0 || score > highest) highest = score;
+		total += score;
+	}
+
+	printf("%s, %u sessions\n", scenario.name, batch.getSessionCount());
+	printf("  steps: %u of %.4fs per session on %u threads\n", scenario.steps, scenario.timestep, batch.getThreadCount());
+	printf("  aggregate steps/sec: %.1f (%.1fs simulated per second)\n",
+		timings.stepsPerSecond, timings.stepsPerSecond * scenario.timestep);
+	printf("  wall time: %.3fs\n", timings.seconds);
+	printf("  final scores: %d to %d, mean %.2f, of %u\n", lowest, highest, total / batch.getSessionCount(), scenario.targets);
+	return writeTrace();
+}
+
+/**
+ * Integrates the same number of rigid bodies and rounds for a number of
+ * steps, with nothing else running, and prints what each costs. Bodies go
+ * through RigidBody::integrate, as bullseyes do; rounds go through the
+ * scalar kernels and then the vector ones, if the processor has them.
+ */
+static void runIntegration(unsigned count, unsigned steps, cyclone::real duration)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+	// Awake, tumbling boxes set up like bullseyes, so every step does the full update.
+	std::vector<cyclone::RigidBody> bodies(count);
+	cyclone::Matrix3 tensor;
+	tensor.setBlockInertiaTensor(cyclone::Vector3(0.5, 0.5, 0.1), 2);
+	for (unsigned i = 0; i < count; i++)
+	{
+		cyclone::RigidBody &body = bodies[i];
+		body.setMass(2);
+		body.setInertiaTensor(tensor);
+		body.setDamping(0.95f, 0.8f);
+		body.setPosition(cyclone::real(i % 32), 1, cyclone::real(i / 32));
+		body.setOrientation(1, 0, 0, 0);
+		body.setVelocity(0, 0, -1);
+		body.setRotation(0.1f * (i % 7), 0.2f, 0);
+		body.setAcceleration(0, -9.81f, 0);
+		body.setCanSleep(false);
+		body.setAwake();
+		body.clearAccumulators();
+		body.calculateDerivedData();
+	}
+	Clock::time_point start = Clock::now();
+	for (unsigned step = 0; step < steps; step++)
+	{
+		for (cyclone::RigidBody *body = bodies.data(); body < bodies.data() + count; body++)
+		{
+			body->integrate(duration);
+		}
+	}
+	double bodyMs = Milliseconds(Clock::now() - start).count();
+
+	std::vector<cyclone::real> lanes(count * 8);
+	cyclone::real *gravity = &lanes[count * 6], *dampingFactor = &lanes[count * 7];
+	IntegrationPath selected = getIntegrationPath();
+	printf("integration of %u bodies and %u rounds\n", count, count);
+	printf("  steps: %u of %.4fs\n", steps, duration);
+	printf("  RigidBody::integrate: %.4f ms/step (%.1f ns/body)\n", bodyMs / steps, bodyMs * 1e6 / ((double)steps * count));
+	IntegrationPath paths[] = { INTEGRATE_SCALAR, selected };
+	for (unsigned p = 0; p < (selected == INTEGRATE_SCALAR ? 1u : 2u); p++)
+	{
+		for (unsigned i = 0; i < count; i++)
+		{
+			lanes[i] = cyclone::real(i % 32);
+			lanes[count + i] = 1;
+			lanes[count * 2 + i] = cyclone::real(i / 32);
+			lanes[count * 3 + i] = 0;
+			lanes[count * 4 + i] = 5;
+			lanes[count * 5 + i] = -50;
+			gravity[i] = 9.81f;
+			dampingFactor[i] = real_pow(0.99f, duration);
+		}
+		setIntegrationPath(paths[p]);
+		start = Clock::now();
+		for (unsigned step = 0; step < steps; step++)
+		{
+			integrateRounds(&lanes[0], &lanes[count], &lanes[count * 2], &lanes[count * 3], &lanes[count * 4], &lanes[count * 5],
+				gravity, dampingFactor, count, duration);
+		}
+		double roundMs = Milliseconds(Clock::now() - start).count();
+		printf("  rounds (%s): %.4f ms/step (%.1f ns/round)\n", getIntegrationPathName(paths[p]),
+			roundMs / steps, roundMs * 1e6 / ((double)steps * count));
+	}
+	setIntegrationPath(selected);
+}
+
+static void printUsage(const char *program)
+{
+	printf("Usage: %s [--targets N] [--rounds N] [--steps N] [--fire-interval N] [--timestep S] [--weapon pistol|shotgun|hitscan] [--muzzle-speed S] [--scenario FILE] [--record FILE | --replay FILE] [--sessions N] [--spectate] [--integrate N] [--workers N] [--trace FILE] [--scalar]\n", program);
+	printf("With no scenario options the built-in scenarios are run. --scalar forces the scalar integration kernels.\n");
+	printf("--scenario runs a scenario file's targets, rounds, weapons and timestep.\n");
+	printf("--sessions runs that many independent galleries side by side, sharded across --workers threads, and reports aggregate throughput.\n");
+	printf("--spectate streams each step to a loopback spectator and reports the frame sizes, their cost and the spectator's error.\n");
+	printf("--integrate times N bodies through RigidBody::integrate and N rounds through each integration kernel, for --steps steps.\n");
+	printf("--record saves the run's input; --replay plays a saved session's input instead of the script, as fast as it can, and fails if it ends differently.\n");
+}
+
+int main(int argc, char **argv)
+{
+	BenchmarkScenario custom = defaultScenarios[0];
+	custom.name = "custom";
+	bool customised = false;
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 < argc && strcmp(argv[i], "--workers") == 0)
+		{
+			workerCount = (unsigned)atoi(argv[++i]);
+			continue;
+		}
+		if (i + 1 < argc && strcmp(argv[i], "--trace") == 0)
+		{
+			tracePath = argv[++i];
+			continue;
+		}
+		if (i + 1 < argc && strcmp(argv[i], "--sessions") == 0)
+		{
+			sessionCount = (unsigned)atoi(argv[++i]);
+			continue;
+		}
+		if (strcmp(argv[i], "--spectate") == 0)
+		{
+			spectate = true;
+			continue;
+		}
+		if (strcmp(argv[i], "--scalar") == 0)
+		{
+			// Forcing the scalar kernels shows what the vector ones are worth.
+			setIntegrationPath(INTEGRATE_SCALAR);
+			continue;
+		}
+		if (i + 1 < argc && strcmp(argv[i], "--integrate") == 0)
+		{
+			integrateCount = (unsigned)atoi(argv[++i]);
+			continue;
+		}
+
+		customised = true;
+		if (i + 1 < argc && strcmp(argv[i], "--targets") == 0) custom.targets = (unsigned)atoi(argv[++i]);
+		else if (i + 1 < argc && strcmp(argv[i], "--rounds") == 0) custom.rounds = (unsigned)atoi(argv[++i]);
+		else if (i + 1 < argc && strcmp(argv[i], "--steps") == 0) custom.steps = (unsigned)atoi(argv[++i]);
+		else if (i + 1 < argc && strcmp(argv[i], "--fire-interval") == 0) custom.fireInterval = (unsigned)atoi(argv[++i]);
+		else if (i + 1 < argc && strcmp(argv[i], "--timestep") == 0) custom.timestep = (cyclone::real)atof(argv[++i]);
+		else if (i + 1 < argc && strcmp(argv[i], "--muzzle-speed") == 0) custom.muzzleSpeed = (cyclone::real)atof(argv[++i]);
+		else if (i + 1 < argc && strcmp(argv[i], "--weapon") == 0) custom.weapon = strcmp(argv[++i], "shotgun") == 0 ? SHOTGUN : strcmp(argv[i], "hitscan") == 0 ? HITSCAN : PISTOL;
+		else if (i + 1 < argc && strcmp(argv[i], "--scenario") == 0)
+		{
+			if (!fileScenario.load(argv[++i])) return 1;
+			useFileScenario = true;
+			custom.name = argv[i];
+			custom.targets = fileScenario.getTargetCount();
+			custom.rounds = fileScenario.rounds;
+			custom.timestep = fileScenario.timestep;
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "--record") == 0) recordPath = argv[++i];
+		else if (i + 1 < argc && strcmp(argv[i], "--replay") == 0)
+		{
+			if (!replay.load(argv[++i]))
+			{
+				fprintf(stderr, "Could not load recording %s\n", argv[i]);
+				return 1;
+			}
+			useReplay = true;
+			custom.name = argv[i];
+			custom.targets = replay.targetCount;
+			custom.rounds = replay.roundCount;
+			custom.steps = replay.stepCount;
+			custom.timestep = replay.timestep;
+		}
+		else
+		{
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+	if (custom.fireInterval == 0) custom.fireInterval = 1;
+	Profiler::setThreadName("benchmark");
+
+	// Starting a recording resets the gallery, which would end the replay before it had played anything.
+	if (useReplay && recordPath)
+	{
+		fprintf(stderr, "--record can't be combined with --replay\n");
+		return 1;
+	}
+
+	if (integrateCount > 0)
+	{
+		runIntegration(integrateCount, custom.steps, custom.timestep);
+		return 0;
+	}
+	if (sessionCount > 0)
+	{
+		if (useReplay || recordPath)
+		{
+			fprintf(stderr, "--sessions can't be combined with --record or --replay\n");
+			return 1;
+		}
+		if (!customised)
+		{
+			for (const BenchmarkScenario *scenario = defaultScenarios;
+				scenario < defaultScenarios + sizeof(defaultScenarios) / sizeof(defaultScenarios[0]); scenario++)
+			{
+				if (!runSessions(*scenario)) return 1;
+			}
+		}
+		else if (!runSessions(custom)) return 1;
+	}
+	else if (!customised)
+	{
+		for (const BenchmarkScenario *scenario = defaultScenarios;
+			scenario < defaultScenarios + sizeof(defaultScenarios) / sizeof(defaultScenarios[0]); scenario++)
+		{
+			runScenario(*scenario);
+		}
+	}
+	else if (!runScenario(custom)) return 1;
+	return 0;
+}
+
+#endif // SHOOTING_GALLERY_HEADLESS
@@ -0,0 +1,237 @@
+/*
+ * Implementation of BC1 block compression.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include "BlockCompression.h"
+
+#include <math.h>
+#include <string.h>
+
+size_t getBC1Size(unsigned width, unsigned height)
+{
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * bc1BlockBytes;
+}
+
+/** Packs an 8 bit colour into 5:6:5 bits, rounding to the nearest value. */
+static unsigned pack565(const float colour[3])
+{
+	int r = (int)(colour[0] * 31.0f / 255.0f + 0.5f);
+	int g = (int)(colour[1] * 63.0f / 255.0f + 0.5f);
+	int b = (int)(colour[2] * 31.0f / 255.0f + 0.5f);
+	r = r < 0 ? 0 : (r > 31 ? 31 : r);
+	g = g < 0 ? 0 : (g > 63 ? 63 : g);
+	b = b < 0 ? 0 : (b > 31 ? 31 : b);
+	return (unsigned)((r << 11) | (g << 5) | b);
+}
+
+/** Expands 5:6:5 bits to an 8 bit colour, replicating the high bits into the low ones. */
+static void unpack565(unsigned packed, int colour[3])
+{
+	int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+	colour[0] = (r << 3) | (r >> 2);
+	colour[1] = (g << 2) | (g >> 4);
+	colour[2] = (b << 3) | (b >> 2);
+}
+
+/** Fills in the four colours a block with the given endpoints can use. */
+static void buildPalette(unsigned colour0, unsigned colour1, int palette[4][3])
+{
+	unpack565(colour0, palette[0]);
+	unpack565(colour1, palette[1]);
+	for (unsigned channel = 0; channel < 3; channel++)
+	{
+		if (colour0 > colour1)
+		{
+			palette[2][channel] = (2 * palette[0][channel] + palette[1][channel]) / 3;
+			palette[3][channel] = (palette[0][channel] + 2 * palette[1][channel]) / 3;
+		}
+		else
+		{
+			// The three colour mode, whose fourth entry is black.
+			palette[2][channel] = (palette[0][channel] + palette[1][channel]) / 2;
+			palette[3][channel] = 0;
+		}
+	}
+}
+
+/** Compresses one block of sixteen pixels into eight bytes. */
+static void compressBlock(const unsigned char pixels[16][3], unsigned char *block)
+{
+	// Fit a line through the colours: the mean plus the direction in
+	// which they vary most, found by power iteration on their covariance.
+	float mean[3] = { 0, 0, 0 };
+	for (unsigned i = 0; i < 16; i++)
+	{
+		for (unsigned channel = 0; channel < 3; channel++) mean[channel] += pixels[i][channel];
+	}
+	for (unsigned channel = 0; channel < 3; channel++) mean[channel] /= 16.0f;
+
+	float covariance[6] = { 0, 0, 0, 0, 0, 0 };
+	for (unsigned i = 0; i < 16; i++)
+	{
+		float r = pixels[i][0] - mean[0], g = pixels[i][1] - mean[1], b = pixels[i][2] - mean[2];
+		covariance[0] += r * r; covariance[1] += r * g; covariance[2] += r * b;
+		covariance[3] += g * g; covariance[4] += g * b; covariance[5] += b * b;
+	}
+
+	float axis[3] = { 1, 1, 1 };
+	for (unsigned iteration = 0; iteration < 4; iteration++)
+	{
+		float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+		float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+		float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+		float length = sqrtf(x * x + y * y + z * z);
+		if (length < 1e-6f) break;
+		axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+	}
+
+	// The endpoints are the colours furthest along the line each way.
+	float lowest = 0, highest = 0;
+	for (unsigned i = 0; i < 16; i++)
+	{
+		float along = (pixels[i][0] - mean[0]) * axis[0] + (pixels[i][1] - mean[1]) * axis[1] + (pixels[i][2] - mean[2]) * axis[2];
+		if (along < lowest) lowest = along;
+		if (along > highest) highest = along;
+	}
+	float end0[3], end1[3];
+	for (unsigned channel = 0; channel < 3; channel++)
+	{
+		end0[channel] = mean[channel] + axis[channel] * highest;
+		end1[channel] = mean[channel] + axis[channel] * lowest;
+	}
+
+	unsigned colour0 = pack565(end0), colour1 = pack565(end1);
+	unsigned indices = 0;
+	if (colour0 != colour1)
+	{
+		// The first endpoint must be the larger for the four colour mode.
+		if (colour0 < colour1)
+		{
+			unsigned swap = colour0;
+			colour0 = colour1;
+			colour1 = swap;
+		}
+
+		int palette[4][3];
+		buildPalette(colour0, colour1, palette);
+		for (unsigned i = 0; i < 16; i++)
+		{
+			unsigned best = 0;
+			int bestError = 0x7fffffff;
+			for (unsigned entry = 0; entry < 4; entry++)
+			{
+				int r = pixels[i][0] - palette[entry][0];
+				int g = pixels[i][1] - palette[entry][1];
+				int b = pixels[i][2] - palette[entry][2];
+				int error = r * r + g * g + b * b;
+				if (error < bestError)
+				{
+					best = entry;
+					bestError = error;
+				}
+			}
+			indices |= best << (i * 2);
+		}
+	}
+
+	block[0] = (unsigned char)(colour0 & 0xff);
+	block[1] = (unsigned char)(colour0 >> 8);
+	block[2] = (unsigned char)(colour1 & 0xff);
+	block[3] = (unsigned char)(colour1 >> 8);
+	for (unsigned i = 0; i < 4; i++) block[4 + i] = (unsigned char)(indices >> (i * 8));
+}
+
+void compressBC1(const unsigned char *rgb, unsigned width, unsigned height, unsigned char *blocks)
+{
+	unsigned char pixels[16][3];
+	for (unsigned blockY = 0; blockY < height; blockY += 4)
+	{
+		for (unsigned blockX = 0; blockX < width; blockX += 4, blocks += bc1BlockBytes)
+		{
+			for (unsigned y = 0; y < 4; y++)
+			{
+				unsigned row = blockY + y < height ? blockY + y : height - 1;
+				for (unsigned x = 0; x < 4; x++)
+				{
+					unsigned column = blockX + x < width ? blockX + x : width - 1;
+					memcpy(pixels[y * 4 + x], rgb + ((size_t)row * width + column) * 3, 3);
+				}
+			}
+			compressBlock(pixels, blocks);
+		}
+	}
+}
+
+void decompressBC1(const unsigned char *blocks, unsigned width, unsigned height, unsigned char *rgb)
+{
+	for (unsigned blockY = 0; blockY < height; blockY += 4)
+	{
+		for (unsigned blockX = 0; blockX < width; blockX += 4, blocks += bc1BlockBytes)
+		{
+			int palette[4][3];
+			buildPalette(blocks[0] | (blocks[1] << 8), blocks[2] | (blocks[3] << 8), palette);
+			unsigned indices = blocks[4] | (blocks[5] << 8) | (blocks[6] << 16) | ((unsigned)blocks[7] << 24);
+
+			for (unsigned y = 0; y < 4 && blockY + y < height; y++)
+			{
+				for (unsigned x = 0; x < 4 && blockX + x < width; x++)
+				{
+					const int *colour = palette[(indices >> ((y * 4 + x) * 2)) & 3];
+					unsigned char *pixel = rgb + ((size_t)(blockY + y) * width + blockX + x) * 3;
+					pixel[0] = (unsigned char)colour[0];
+					pixel[1] = (unsigned char)colour[1];
+					pixel[2] = (unsigned char)colour[2];
+				}
+			}
+		}
+	}
+}
+
+void downsampleRGB(const unsigned char *source, unsigned *width, unsigned *height, unsigned char *destination)
+{
+	unsigned sourceWidth = *width, sourceHeight = *height;
+	unsigned newWidth = sourceWidth > 1 ? sourceWidth / 2 : 1;
+	unsigned newHeight = sourceHeight > 1 ? sourceHeight / 2 : 1;
+
+	for (unsigned y = 0; y < newHeight; y++)
+	{
+		// Each pixel covers a 2x2 square of the source, clamped at the edge.
+		// The last row of squares also takes in a leftover odd row, so
+		// nothing at the bottom or right edge is lost.
+		unsigned row0 = y * 2;
+		unsigned rowEnd = y + 1 == newHeight ? sourceHeight : row0 + 2;
+		for (unsigned x = 0; x < newWidth; x++)
+		{
+			unsigned column0 = x * 2;
+			unsigned columnEnd = x + 1 == newWidth ? sourceWidth : column0 + 2;
+			unsigned sum[3] = { 0, 0, 0 };
+			for (unsigned row = row0; row < rowEnd; row++)
+			{
+				const unsigned char *texel = source + ((size_t)row * sourceWidth + column0) * 3;
+				for (unsigned column = column0; column < columnEnd; column++, texel += 3)
+				{
+					sum[0] += texel[0];
+					sum[1] += texel[1];
+					sum[2] += texel[2];
+				}
+			}
+			unsigned count = (rowEnd - row0) * (columnEnd - column0);
+			unsigned char *pixel = destination + ((size_t)y * newWidth + x) * 3;
+			for (unsigned channel = 0; channel < 3; channel++)
+			{
+				pixel[channel] = (unsigned char)((sum[channel] + count / 2) / count);
+			}
+		}
+	}
+
+	*width = newWidth;
+	*height = newHeight;
+}
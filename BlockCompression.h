@@ -0,0 +1,41 @@
+/*
+ * BC1 (DXT1) block compression of RGB images, done on the CPU.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef BLOCK_COMPRESSION_H
+#define BLOCK_COMPRESSION_H
+
+#include <stddef.h>
+
+/** Bytes in each compressed 4x4 block. */
+const size_t bc1BlockBytes = 8;
+
+/** Returns the compressed size of an image, whose edges are padded out to whole blocks. */
+size_t getBC1Size(unsigned width, unsigned height);
+
+/**
+ * Compresses a tightly packed 8 bit RGB image to BC1, one block after
+ * another along each row of blocks. Blocks hanging over the edge repeat
+ * the last row and column.
+ */
+void compressBC1(const unsigned char *rgb, unsigned width, unsigned height, unsigned char *blocks);
+
+/** Expands BC1 blocks back to a tightly packed 8 bit RGB image. */
+void decompressBC1(const unsigned char *blocks, unsigned width, unsigned height, unsigned char *rgb);
+
+/**
+ * Halves an RGB image in each direction, down to one pixel, by averaging
+ * each 2x2 square; a leftover odd row or column is averaged into the last
+ * row or column of squares. Returns the new size through width and height.
+ */
+void downsampleRGB(const unsigned char *source, unsigned *width, unsigned *height, unsigned char *destination);
+
+#endif // BLOCK_COMPRESSION_H
@@ -0,0 +1,140 @@
+/*
+ * Implementation of the broad phase grid.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include "BroadPhaseGrid.h"
+
+#include <limits.h>
+#include <math.h>
+
+BroadPhaseGrid::BroadPhaseGrid(cyclone::real cellSize)
+: inverseCellSize(1.0f / cellSize)
+{
+}
+
+void BroadPhaseGrid::clear()
+{
+	cells.clear();
+	ranges.clear();
+}
+
+int BroadPhaseGrid::cellOf(cyclone::real coordinate) const
+{
+	// Converting a NaN or out of range value to int is undefined, so those
+	// are clamped first. The limits stay one cell short of INT_MAX and
+	// INT_MIN so the loops over a range can step past them.
+	double cell = floor((double)coordinate * inverseCellSize);
+	if (cell != cell) return 0;
+	if (cell > INT_MAX - 1) return INT_MAX - 1;
+	if (cell < INT_MIN + 1) return INT_MIN + 1;
+	return (int)cell;
+}
+
+void BroadPhaseGrid::update(unsigned index, const cyclone::CollisionBox &box)
+{
+	if (index >= ranges.size())
+	{
+		CellRange absent = { 0, 0, 0, 0, false };
+		ranges.resize(index + 1, absent);
+	}
+
+	// The world space extent of an oriented box along an axis is the sum of
+	// its half sizes projected onto that axis.
+	cyclone::Vector3 centre = box.getAxis(3);
+	cyclone::Vector3 axes[3] = { box.getAxis(0), box.getAxis(1), box.getAxis(2) };
+	cyclone::real extentX = 0, extentZ = 0;
+	for (unsigned axis = 0; axis < 3; axis++)
+	{
+		extentX += real_abs(axes[axis].x) * box.halfSize[axis];
+		extentZ += real_abs(axes[axis].z) * box.halfSize[axis];
+	}
+
+	CellRange range = {
+		cellOf(centre.x - extentX), cellOf(centre.z - extentZ),
+		cellOf(centre.x + extentX), cellOf(centre.z + extentZ),
+		true
+	};
+
+	CellRange &current = ranges[index];
+	if (current.present)
+	{
+		if (current == range) return;
+		remove(index, current);
+	}
+	insert(index, range);
+	current = range;
+}
+
+void BroadPhaseGrid::remove(unsigned index)
+{
+	if (index >= ranges.size() || !ranges[index].present) return;
+	remove(index, ranges[index]);
+	ranges[index].present = false;
+}
+
+void BroadPhaseGrid::insert(unsigned index, const CellRange &range)
+{
+	for (int x = range.minX; x <= range.maxX; x++)
+	{
+		for (int z = range.minZ; z <= range.maxZ; z++)
+		{
+			cells[key(x, z)].push_back(index);
+		}
+	}
+}
+
+void BroadPhaseGrid::remove(unsigned index, const CellRange &range)
+{
+	for (int x = range.minX; x <= range.maxX; x++)
+	{
+		for (int z = range.minZ; z <= range.maxZ; z++)
+		{
+			std::unordered_map<uint64_t, std::vector<unsigned> >::iterator cell = cells.find(key(x, z));
+			if (cell == cells.end()) continue;
+
+			// Order within a cell doesn't matter, so the last entry fills the gap.
+			std::vector<unsigned> &entries = cell->second;
+			for (unsigned *entry = entries.data(); entry < entries.data() + entries.size(); entry++)
+			{
+				if (*entry == index)
+				{
+					*entry = entries.back();
+					entries.pop_back();
+					break;
+				}
+			}
+			if (entries.empty()) cells.erase(cell);
+		}
+	}
+}
+
+void BroadPhaseGrid::query(cyclone::real minX, cyclone::real minZ, cyclone::real maxX, cyclone::real maxZ,
+	std::vector<unsigned> &results) const
+{
+	int lowX = cellOf(minX), lowZ = cellOf(minZ), highX = cellOf(maxX), highZ = cellOf(maxZ);
+	for (int x = lowX; x <= highX; x++)
+	{
+		for (int z = lowZ; z <= highZ; z++)
+		{
+			std::unordered_map<uint64_t, std::vector<unsigned> >::const_iterator cell = cells.find(key(x, z));
+			if (cell == cells.end()) continue;
+
+			for (const unsigned *entry = cell->second.data(); entry < cell->second.data() + cell->second.size(); entry++)
+			{
+				// A box covering several of the cells is only reported from
+				// the first cell it shares with the query.
+				const CellRange &range = ranges[*entry];
+				if (x != (range.minX > lowX ? range.minX : lowX) || z != (range.minZ > lowZ ? range.minZ : lowZ)) continue;
+				results.push_back(*entry);
+			}
+		}
+	}
+}
@@ -0,0 +1,87 @@
+/*
+ * Uniform grid over the gallery floor, used to find which targets a round
+ * could be touching before running the narrow phase.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef BROAD_PHASE_GRID_H
+#define BROAD_PHASE_GRID_H
+
+#include <cyclone.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Buckets boxes by the square X/Z cells their bounds cover. Only occupied
+ * cells are stored, so the gallery can extend any distance down range.
+ *
+ * Boxes are updated incrementally: a box is only moved between cells when
+ * the range of cells it covers changes, which for the oscillating targets
+ * is once every few steps.
+ */
+class BroadPhaseGrid
+{
+public:
+	/** Creates an empty grid with cells of the given width. */
+	BroadPhaseGrid(cyclone::real cellSize = 4.0f);
+
+	/** Removes every box. */
+	void clear();
+
+	/** Inserts the box with the given index, or moves it if its cells have changed. */
+	void update(unsigned index, const cyclone::CollisionBox &box);
+
+	/** Takes the box with the given index out of the grid, if it's in it. */
+	void remove(unsigned index);
+
+	/**
+	 * Appends the index of every box sharing a cell with the given X/Z
+	 * bounds to results. Each box is reported once. Queries don't change
+	 * the grid, so several threads can run them at once.
+	 */
+	void query(cyclone::real minX, cyclone::real minZ, cyclone::real maxX, cyclone::real maxZ,
+		std::vector<unsigned> &results) const;
+
+private:
+	/** The inclusive range of cells a box covers. */
+	struct CellRange
+	{
+		int minX, minZ, maxX, maxZ;
+		bool present;
+
+		bool operator==(const CellRange &other) const
+		{
+			return minX == other.minX && minZ == other.minZ && maxX == other.maxX && maxZ == other.maxZ;
+		}
+	};
+
+	cyclone::real inverseCellSize;
+
+	/** Box indices in each occupied cell. */
+	std::unordered_map<uint64_t, std::vector<unsigned> > cells;
+
+	/** The cells each box is currently listed in. */
+	std::vector<CellRange> ranges;
+
+	/**
+	 * Returns the cell holding the given coordinate along one axis. Huge
+	 * coordinates are clamped to the cells an int can hold, and NaN is cell 0.
+	 */
+	int cellOf(cyclone::real coordinate) const;
+
+	/** Packs cell coordinates into a map key. */
+	static uint64_t key(int x, int z) { return ((uint64_t)(uint32_t)x << 32) | (uint32_t)z; }
+
+	void insert(unsigned index, const CellRange &range);
+	void remove(unsigned index, const CellRange &range);
+};
+
+#endif // BROAD_PHASE_GRID_H
@@ -0,0 +1,81 @@
+/*
+ * Implementation of the view frustum.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include "Frustum.h"
+
+#include <math.h>
+
+void Frustum::extract(const float projection[16], const float modelview[16])
+{
+	// Combine the matrices, so the planes come out in model space.
+	float clip[16];
+	for (unsigned column = 0; column < 4; column++)
+	{
+		for (unsigned row = 0; row < 4; row++)
+		{
+			clip[column * 4 + row] =
+				projection[0 * 4 + row] * modelview[column * 4 + 0] +
+				projection[1 * 4 + row] * modelview[column * 4 + 1] +
+				projection[2 * 4 + row] * modelview[column * 4 + 2] +
+				projection[3 * 4 + row] * modelview[column * 4 + 3];
+		}
+	}
+
+	// A point is inside when -w <= x, y, z <= w in clip space, so each
+	// plane is the fourth row of the matrix plus or minus one of the others.
+	for (unsigned plane = 0; plane < 6; plane++)
+	{
+		unsigned row = plane / 2;
+		float sign = (plane & 1) ? -1.0f : 1.0f;
+		for (unsigned column = 0; column < 4; column++)
+		{
+			planes[plane][column] = clip[column * 4 + 3] + sign * clip[column * 4 + row];
+		}
+
+		float length = sqrtf(planes[plane][0] * planes[plane][0] +
+			planes[plane][1] * planes[plane][1] + planes[plane][2] * planes[plane][2]);
+		if (length > 0)
+		{
+			for (unsigned i = 0; i < 4; i++) planes[plane][i] /= length;
+		}
+	}
+}
+
+bool Frustum::intersectsBox(const MeshBounds &box, const float transform[16]) const
+{
+	// Place the box's centre, and find the half-widths of the box that
+	// holds the transformed one.
+	float centre[3], extent[3], half[3], local[3];
+	for (unsigned axis = 0; axis < 3; axis++)
+	{
+		local[axis] = (box.min[axis] + box.max[axis]) * 0.5f;
+		half[axis] = (box.max[axis] - box.min[axis]) * 0.5f;
+	}
+	for (unsigned row = 0; row < 3; row++)
+	{
+		centre[row] = transform[12 + row];
+		extent[row] = 0;
+		for (unsigned column = 0; column < 3; column++)
+		{
+			centre[row] += transform[column * 4 + row] * local[column];
+			extent[row] += fabsf(transform[column * 4 + row]) * half[column];
+		}
+	}
+
+	for (const float (*plane)[4] = planes; plane < planes + 6; plane++)
+	{
+		float distance = (*plane)[0] * centre[0] + (*plane)[1] * centre[1] + (*plane)[2] * centre[2] + (*plane)[3];
+		float reach = fabsf((*plane)[0]) * extent[0] + fabsf((*plane)[1]) * extent[1] + fabsf((*plane)[2]) * extent[2];
+		if (distance < -reach) return false;
+	}
+	return true;
+}
@@ -0,0 +1,38 @@
+/*
+ * View frustum tests for culling what can't be seen.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include "Mesh.h"
+
+/**
+ * The six planes bounding what a camera sees, in the space its modelview
+ * matrix transforms from. The tests are conservative: something reported
+ * outside is certainly invisible, but a box near a corner of the frustum
+ * may be reported inside when it isn't.
+ */
+class Frustum
+{
+public:
+	/** Builds the planes from column-major projection and modelview matrices, as OpenGL stores them. */
+	void extract(const float projection[16], const float modelview[16]);
+
+	/** Returns false if a box, placed by a column-major transform, is wholly outside. */
+	bool intersectsBox(const MeshBounds &box, const float transform[16]) const;
+
+private:
+	/** Each plane as a unit normal pointing inwards and a distance. */
+	float planes[6][4];
+};
+
+#endif // FRUSTUM_H
@@ -0,0 +1,235 @@
+/*
+ * Implementation of the HUD text renderer.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include "HudText.h"
+#include "TrueTypeFont.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/** Wide enough for a few faces of HUD-sized glyphs; the height grows as needed. */
+static const unsigned defaultAtlasWidth = 512;
+
+HudText::HudText()
+: atlasWidth(defaultAtlasWidth), atlasHeight(0), shelfX(0), shelfY(0), shelfHeight(0),
+texture(0), vertexBuffer(0), vertexCount(0)
+{
+}
+
+int HudText::addFace(const char *fontPath, float pixelHeight)
+{
+	TrueTypeFont font;
+	if (!font.load(fontPath))
+	{
+		fprintf(stderr, "Could not load font %s\n", fontPath);
+		return -1;
+	}
+
+	float scale = font.getScale(pixelHeight);
+	Face face;
+	face.lineHeight = floorf(font.getLineHeight() * scale + 0.5f);
+
+	// Remember where the atlas was so a face that can't fit leaves it as it was.
+	unsigned startX = shelfX, startY = shelfY, startShelfHeight = shelfHeight, startHeight = atlasHeight;
+
+	GlyphBitmap bitmap;
+	for (unsigned character = 0; character < atlasCharacterCount; character++)
+	{
+		unsigned glyph = font.findGlyph(firstAtlasCharacter + character);
+		font.rasterize(glyph, scale, &bitmap);
+
+		// A glyph wider than the atlas can't go on any shelf.
+		if (bitmap.width > atlasWidth)
+		{
+			fprintf(stderr, "Could not fit font %s at %g pixels in the text atlas\n", fontPath, pixelHeight);
+			shelfX = startX;
+			shelfY = startY;
+			shelfHeight = startShelfHeight;
+			atlasHeight = startHeight;
+			atlas.resize(atlasWidth * atlasHeight);
+			return -1;
+		}
+
+		AtlasGlyph &placed = face.glyphs[character];
+		placed.width = bitmap.width;
+		placed.height = bitmap.height;
+		placed.left = bitmap.left;
+		placed.top = bitmap.top;
+		placed.advance = font.getAdvance(glyph) * scale;
+
+		// Start a new shelf when this one is full. The bitmaps' own blank
+		// margins keep neighbouring glyphs from bleeding into each other.
+		if (shelfX + bitmap.width > atlasWidth)
+		{
+			shelfX = 0;
+			shelfY += shelfHeight;
+			shelfHeight = 0;
+		}
+		placed.x = shelfX;
+		placed.y = shelfY;
+		shelfX += bitmap.width;
+		if (bitmap.height > shelfHeight) shelfHeight = bitmap.height;
+		if (shelfY + shelfHeight > atlasHeight)
+		{
+			atlasHeight = shelfY + shelfHeight;
+			atlas.resize(atlasWidth * atlasHeight, 0);
+		}
+
+		for (unsigned row = 0; row < bitmap.height; row++)
+		{
+			memcpy(&atlas[(placed.y + row) * atlasWidth + placed.x], &bitmap.coverage[row * bitmap.width], bitmap.width);
+		}
+	}
+
+	faces.push_back(face);
+	return (int)faces.size() - 1;
+}
+
+void HudText::init()
+{
+	// Round the height up to a power of two for older drivers.
+	unsigned height = 1;
+	while (height < atlasHeight) height *= 2;
+	atlas.resize(atlasWidth * height, 0);
+	atlasHeight = height;
+
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA8, atlasWidth, atlasHeight, 0, GL_ALPHA, GL_UNSIGNED_BYTE, atlas.data());
+
+	// Glyphs are drawn at the size they were rasterized, on whole pixels.
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	std::vector<unsigned char>().swap(atlas);
+	glGenBuffers(1, &vertexBuffer);
+}
+
+void HudText::deinit()
+{
+	if (texture) glDeleteTextures(1, &texture);
+	if (vertexBuffer) glDeleteBuffers(1, &vertexBuffer);
+	texture = 0;
+	vertexBuffer = 0;
+	vertexCount = 0;
+}
+
+float HudText::measure(int face, const char *text) const
+{
+	if (face < 0) return 0;
+	float width = 0;
+	for (const char *character = text; *character && *character != '\n'; character++)
+	{
+		unsigned index = (unsigned char)*character - firstAtlasCharacter;
+		if (index < atlasCharacterCount) width += faces[face].glyphs[index].advance;
+	}
+	return width;
+}
+
+float HudText::append(std::vector<TextVertex> *batch, int face, float x, float y,
+	const char *text, const GLubyte colour[4]) const
+{
+	if (face < 0) return x;
+
+	const Face &metrics = faces[face];
+	float penX = x, penY = y;
+	float toU = 1.0f / atlasWidth, toV = 1.0f / atlasHeight;
+	for (const char *character = text; *character; character++)
+	{
+		if (*character == '\n')
+		{
+			penX = x;
+			penY -= metrics.lineHeight;
+			continue;
+		}
+		unsigned index = (unsigned char)*character - firstAtlasCharacter;
+		if (index >= atlasCharacterCount) continue;
+
+		const AtlasGlyph &glyph = metrics.glyphs[index];
+		if (glyph.width > 0)
+		{
+			// Snap to whole pixels so the texels land exactly on the screen's.
+			float left = floorf(penX + 0.5f) + glyph.left, top = floorf(penY + 0.5f) + glyph.top;
+			float right = left + glyph.width, bottom = top - glyph.height;
+			float u0 = glyph.x * toU, v0 = glyph.y * toV;
+			float u1 = (glyph.x + glyph.width) * toU, v1 = (glyph.y + glyph.height) * toV;
+
+			const TextVertex corners[4] = {
+				{ left, top, u0, v0, { colour[0], colour[1], colour[2], colour[3] } },
+				{ right, top, u1, v0, { colour[0], colour[1], colour[2], colour[3] } },
+				{ right, bottom, u1, v1, { colour[0], colour[1], colour[2], colour[3] } },
+				{ left, bottom, u0, v1, { colour[0], colour[1], colour[2], colour[3] } }
+			};
+			const unsigned order[6] = { 0, 1, 2, 0, 2, 3 };
+			for (unsigned i = 0; i < 6; i++) batch->push_back(corners[order[i]]);
+		}
+		penX += glyph.advance;
+	}
+	return penX;
+}
+
+void HudText::upload(const std::vector<TextVertex> &batch)
+{
+	vertexCount = (GLsizei)batch.size();
+	if (!vertexBuffer || batch.empty()) return;
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(TextVertex) * batch.size(), batch.data(), GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void HudText::draw(int width, int height) const
+{
+	if (!texture || vertexCount == 0) return;
+
+	glPushAttrib(GL_CURRENT_BIT | GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_TEXTURE_BIT | GL_TRANSFORM_BIT);
+	glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glOrtho(0, width, 0, height, -1, 1);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	glDisable(GL_LIGHTING);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_CULL_FACE);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glEnable(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glVertexPointer(2, GL_FLOAT, sizeof(TextVertex), (const GLvoid*)offsetof(TextVertex, x));
+	glTexCoordPointer(2, GL_FLOAT, sizeof(TextVertex), (const GLvoid*)offsetof(TextVertex, u));
+	glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(TextVertex), (const GLvoid*)offsetof(TextVertex, colour));
+	glDrawArrays(GL_TRIANGLES, 0, vertexCount);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glPopClientAttrib();
+	glPopAttrib();
+}
@@ -0,0 +1,100 @@
+/*
+ * Text for the heads-up display, drawn from a cached glyph atlas.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef HUD_TEXT_H
+#define HUD_TEXT_H
+
+#include <gl/glew.h>
+#include <vector>
+
+/** A corner of a glyph quad: window position in pixels, atlas coordinates and colour. */
+struct TextVertex
+{
+	GLfloat x, y;
+	GLfloat u, v;
+	GLubyte colour[4];
+};
+
+/** The printable ASCII characters, which is all the HUD uses. */
+const unsigned firstAtlasCharacter = 32;
+const unsigned atlasCharacterCount = 95;
+
+/**
+ * Rasterizes TrueType fonts once into a single alpha texture, then lays out
+ * strings as batches of textured quads. A whole HUD, in any mix of faces
+ * and colours, is one batch drawn with one call; the batch only needs
+ * uploading again when its text changes.
+ */
+class HudText
+{
+public:
+	HudText();
+
+	/**
+	 * Rasterizes the printable characters of a font at an em size, in
+	 * pixels, into the atlas. Call before init. Returns the face's index,
+	 * or -1 if the font couldn't be read or has a glyph wider than the atlas.
+	 */
+	int addFace(const char *fontPath, float pixelHeight);
+
+	/** Uploads the atlas and frees the CPU copy. Needs the GL context. */
+	void init();
+
+	/** Frees the texture and buffer. Needs the GL context. */
+	void deinit();
+
+	/** Returns the width of a line of text in pixels. */
+	float measure(int face, const char *text) const;
+
+	/**
+	 * Appends the quads for a string with its first baseline at (x, y),
+	 * measured in pixels from the bottom left of the window. Newlines
+	 * start a new line below. Returns where the pen ended up across the
+	 * last line, for text that follows on.
+	 */
+	float append(std::vector<TextVertex> *batch, int face, float x, float y,
+		const char *text, const GLubyte colour[4]) const;
+
+	/** Replaces the batch the next draws use. Needs the GL context. */
+	void upload(const std::vector<TextVertex> &batch);
+
+	/** Draws the uploaded batch over a window of the given size, in a single call. */
+	void draw(int width, int height) const;
+
+private:
+	/** Where a glyph is in the atlas, in pixels, and how it sits against the pen. */
+	struct AtlasGlyph
+	{
+		unsigned x, y, width, height;
+		int left, top;
+		float advance;
+	};
+
+	struct Face
+	{
+		float lineHeight;
+		AtlasGlyph glyphs[atlasCharacterCount];
+	};
+
+	std::vector<Face> faces;
+
+	/** The atlas while it's being filled: a fixed width, growing downwards a shelf at a time. */
+	std::vector<unsigned char> atlas;
+	unsigned atlasWidth, atlasHeight;
+	unsigned shelfX, shelfY, shelfHeight;
+
+	GLuint texture;
+	GLuint vertexBuffer;
+	GLsizei vertexCount;
+};
+
+#endif // HUD_TEXT_H
@@ -0,0 +1,175 @@
+/*
+ * Implementation of input recordings.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include "InputRecording.h"
+#include "MappedFile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/** Identifies the file format; bump the version whenever the layout changes. */
+static const char recordingMagic[4] = { 'S', 'G', 'I', 'R' };
+static const uint32_t recordingVersion = 3;
+
+/** The fixed-size header at the start of every recording, followed by the packed events. */
+struct RecordingHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t seed;
+	float timestep;
+	uint32_t targetCount, roundCount;
+	uint32_t stepCount;
+	uint32_t eventCount;
+	int32_t finalScore;
+	uint32_t reserved;
+	uint64_t finalStateHash;
+	uint64_t scenarioHash;
+	/** Size of the packed events that follow, in bytes. */
+	uint64_t eventBytes;
+};
+
+/** Appends an unsigned integer seven bits at a time, low bits first. */
+static void writeVarint(std::vector<unsigned char> *bytes, uint32_t value)
+{
+	while (value >= 0x80)
+	{
+		bytes->push_back((unsigned char)(value | 0x80));
+		value >>= 7;
+	}
+	bytes->push_back((unsigned char)value);
+}
+
+/** Reads an integer written by writeVarint, returning false if it runs off the end. */
+static bool readVarint(const unsigned char *&cursor, const unsigned char *end, uint32_t *value)
+{
+	*value = 0;
+	for (unsigned shift = 0; shift < 35 && cursor < end; shift += 7)
+	{
+		unsigned char byte = *cursor++;
+		*value |= (uint32_t)(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0) return true;
+	}
+	return false;
+}
+
+InputRecording::InputRecording()
+{
+	clear();
+}
+
+void InputRecording::clear()
+{
+	events.clear();
+	seed = 0;
+	timestep = 0;
+	targetCount = roundCount = 0;
+	stepCount = 0;
+	finalScore = 0;
+	finalStateHash = 0;
+	scenarioHash = 0;
+}
+
+void InputRecording::add(uint32_t step, const InputEvent &event)
+{
+	RecordedInput input = { step, event };
+	events.push_back(input);
+}
+
+bool InputRecording::save(const char *path) const
+{
+	// Each event is the steps since the last one, shifted up to make room
+	// for the special key flag, and then the key.
+	std::vector<unsigned char> packed;
+	uint32_t lastStep = 0;
+	for (const RecordedInput *input = events.data(); input < events.data() + events.size(); input++)
+	{
+		writeVarint(&packed, (input->step - lastStep) << 1 | (input->event.special ? 1 : 0));
+		writeVarint(&packed, (uint32_t)input->event.key);
+		lastStep = input->step;
+	}
+
+	RecordingHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, recordingMagic, sizeof(header.magic));
+	header.version = recordingVersion;
+	header.seed = seed;
+	header.timestep = timestep;
+	header.targetCount = targetCount;
+	header.roundCount = roundCount;
+	header.stepCount = stepCount;
+	header.eventCount = (uint32_t)events.size();
+	header.finalScore = finalScore;
+	header.finalStateHash = finalStateHash;
+	header.scenarioHash = scenarioHash;
+	header.eventBytes = packed.size();
+
+	FILE *file = fopen(path, "wb");
+	if (!file) return false;
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	ok = ok && (packed.empty() || fwrite(packed.data(), packed.size(), 1, file) == 1);
+	ok = (fclose(file) == 0) && ok;
+
+	if (!ok) remove(path);
+	return ok;
+}
+
+bool InputRecording::load(const char *path)
+{
+	clear();
+
+	MappedFile file;
+	if (!file.open(path)) return false;
+
+	const RecordingHeader *header = (const RecordingHeader*)file.data();
+	if (file.size() < sizeof(RecordingHeader) ||
+		memcmp(header->magic, recordingMagic, sizeof(header->magic)) != 0 ||
+		header->version != recordingVersion ||
+		header->eventBytes != file.size() - sizeof(RecordingHeader) ||
+		header->eventCount > header->eventBytes / 2)
+	{
+		return false;
+	}
+
+	// Every event takes at least a byte for its step and one for its key,
+	// so the count was checked against the bytes before reserving for it.
+	const unsigned char *cursor = file.data() + sizeof(RecordingHeader), *end = file.data() + file.size();
+	uint32_t step = 0;
+	events.reserve(header->eventCount);
+	for (uint32_t i = 0; i < header->eventCount; i++)
+	{
+		uint32_t packedStep, key;
+		if (!readVarint(cursor, end, &packedStep) || !readVarint(cursor, end, &key))
+		{
+			clear();
+			return false;
+		}
+		step += packedStep >> 1;
+		InputEvent event = { (packedStep & 1) != 0, (int)key };
+		add(step, event);
+	}
+	if (cursor != end)
+	{
+		clear();
+		return false;
+	}
+
+	seed = header->seed;
+	timestep = header->timestep;
+	targetCount = header->targetCount;
+	roundCount = header->roundCount;
+	stepCount = header->stepCount;
+	finalScore = header->finalScore;
+	finalStateHash = header->finalStateHash;
+	scenarioHash = header->scenarioHash;
+	return true;
+}
@@ -0,0 +1,76 @@
+/*
+ * Recordings of the input to a session, for replaying it exactly.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef INPUT_RECORDING_H
+#define INPUT_RECORDING_H
+
+#include <stdint.h>
+#include <vector>
+
+/** A keypress passed from the window thread to the simulation thread. */
+struct InputEvent
+{
+	/** True for GLUT special keys such as the arrows. */
+	bool special;
+	int key;
+};
+
+/** A keypress and the simulation step it was applied before. */
+struct RecordedInput
+{
+	uint32_t step;
+	InputEvent event;
+};
+
+/**
+ * The input to a session, stamped with simulation steps rather than wall
+ * time. The simulation only moves in fixed steps and its randomness is
+ * seeded, so applying the same keys before the same steps, from the same
+ * starting state, gives the same session however fast it is replayed.
+ *
+ * Recordings are saved as a small header followed by the events, each
+ * packed as the steps since the one before and the key, in variable-length
+ * integers; a typical event takes two bytes.
+ */
+class InputRecording
+{
+public:
+	InputRecording();
+
+	/** Forgets every event and the session's settings. */
+	void clear();
+
+	/** Adds a keypress applied before the given step, which must not be earlier than the last one's. */
+	void add(uint32_t step, const InputEvent &event);
+
+	/** Writes the recording to a file. Returns false if it couldn't be written. */
+	bool save(const char *path) const;
+
+	/** Reads a recording written by save. Returns false if it is missing or corrupt. */
+	bool load(const char *path);
+
+	std::vector<RecordedInput> events;
+
+	/** The settings the session was recorded with, which a replay must match. */
+	uint32_t seed;
+	float timestep;
+	uint32_t targetCount, roundCount;
+	/** The gallery's Scenario::hash, with its muzzle speed, when the session was recorded. */
+	uint64_t scenarioHash;
+
+	/** How many steps the session ran, and how it ended, to check a replay against. */
+	uint32_t stepCount;
+	int32_t finalScore;
+	uint64_t finalStateHash;
+};
+
+#endif // INPUT_RECORDING_H
@@ -0,0 +1,130 @@
+/*
+ * Implementation of read-only memory mapped files.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include "MappedFile.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+bool getFileStamp(const char *path, FileStamp *stamp)
+{
+	struct stat info;
+	if (stat(path, &info) != 0) return false;
+	stamp->modified = (uint64_t)info.st_mtime;
+	stamp->size = (uint64_t)info.st_size;
+	return true;
+}
+
+uint64_t hashBytes(const void *data, size_t size, uint64_t hash)
+{
+	const unsigned char *byte = (const unsigned char*)data;
+	for (const unsigned char *end = byte + size; byte < end; byte++)
+	{
+		hash ^= *byte;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+uint64_t hashFile(const char *path)
+{
+	MappedFile file;
+	if (!file.open(path)) return 0;
+	return hashBytes(file.data(), file.size());
+}
+
+MappedFile::MappedFile()
+: bytes(NULL), length(0)
+#ifdef _WIN32
+, file(INVALID_HANDLE_VALUE), mapping(NULL)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const char *path)
+{
+	close();
+
+#ifdef _WIN32
+	file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL)
+	{
+		close();
+		return false;
+	}
+
+	bytes = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (bytes == NULL)
+	{
+		close();
+		return false;
+	}
+	length = (size_t)fileSize.QuadPart;
+#else
+	int descriptor = ::open(path, O_RDONLY);
+	if (descriptor < 0) return false;
+
+	struct stat info;
+	if (fstat(descriptor, &info) != 0 || info.st_size == 0)
+	{
+		::close(descriptor);
+		return false;
+	}
+
+	void *view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	// The mapping keeps its own reference to the file.
+	::close(descriptor);
+	if (view == MAP_FAILED) return false;
+
+	bytes = (const unsigned char*)view;
+	length = (size_t)info.st_size;
+#endif
+	return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (bytes) UnmapViewOfFile(bytes);
+	if (mapping) CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+	mapping = NULL;
+	file = INVALID_HANDLE_VALUE;
+#else
+	if (bytes) munmap((void*)bytes, length);
+#endif
+	bytes = NULL;
+	length = 0;
+}
@@ -0,0 +1,70 @@
+/*
+ * Read-only memory mapped files, used to load cached assets without copying.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Modification time and size of a file on disk, used to detect stale caches. */
+struct FileStamp
+{
+	uint64_t modified;
+	uint64_t size;
+};
+
+/** Fills in the stamp of the given file, returning false if it doesn't exist. */
+bool getFileStamp(const char *path, FileStamp *stamp);
+
+/** Returns the 64 bit FNV-1a hash of a block of memory, chained from a previous hash. */
+uint64_t hashBytes(const void *data, size_t size, uint64_t hash = 14695981039346656037ULL);
+
+/** Returns the hash of a file's contents, or zero if it can't be read. */
+uint64_t hashFile(const char *path);
+
+/**
+ * Maps a whole file into memory for reading. The mapping is released when
+ * the object is closed or destroyed.
+ */
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	/** Maps the given file, closing any previous mapping. Returns false on failure. */
+	bool open(const char *path);
+
+	/** Releases the mapping. */
+	void close();
+
+	/** Returns the start of the mapped bytes, or NULL if nothing is mapped. */
+	const unsigned char* data() const { return bytes; }
+
+	/** Returns the number of mapped bytes. */
+	size_t size() const { return length; }
+
+private:
+	const unsigned char *bytes;
+	size_t length;
+#ifdef _WIN32
+	void *file;
+	void *mapping;
+#endif
+
+	// Mappings are owned by exactly one object.
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+};
+
+#endif // MAPPED_FILE_H
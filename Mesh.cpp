@@ -0,0 +1,755 @@
+/*
+ * Implementation of OBJ mesh loading and the binary mesh cache.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include "Mesh.h"
+#include "MeshSimplifier.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unordered_map>
+
+/** Identifies the cache format; bump the version whenever the layout changes. */
+static const char meshCacheMagic[4] = { 'S', 'G', 'M', 'C' };
+static const uint32_t meshCacheVersion = 2;
+
+/** The fixed-size header at the start of every mesh cache file. */
+struct MeshCacheHeader
+{
+	char magic[4];
+	uint32_t version;
+
+	/** State of the source files when the cache was written. */
+	uint64_t objModified, objSize;
+	uint64_t mtlModified, mtlSize;
+	uint64_t sourceHash;
+	char materialLibrary[128];
+
+	/** Element counts and byte offsets of each section from the start of the file. */
+	uint32_t vertexCount, indexCount, subMeshCount, materialCount;
+	uint64_t vertexOffset, indexOffset, subMeshOffset, materialOffset;
+
+	/** The levels of detail, with their indices and lodCount * subMeshCount sub-meshes. */
+	uint32_t lodCount, lodIndexCount;
+	uint64_t lodOffset, lodIndexOffset, lodSubMeshOffset;
+};
+
+/** Models with fewer triangles than this are drawn at full detail however small. */
+static const uint32_t minimumLodTriangles = 32;
+
+/** Sections in the cache file are aligned so they can be used in place. */
+static const uint64_t sectionAlignment = 16;
+
+static uint64_t alignSection(uint64_t offset)
+{
+	return (offset + sectionAlignment - 1) & ~(sectionAlignment - 1);
+}
+
+/** Returns the directory part of a path, including the trailing separator. */
+static std::string directoryOf(const std::string &path)
+{
+	size_t slash = path.find_last_of("/\\");
+	return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+/** Returns the combined hash of an OBJ file and its material library. */
+static uint64_t hashSources(const char *objPath, const std::string &mtlPath)
+{
+	MappedFile obj, mtl;
+	if (!obj.open(objPath)) return 0;
+	uint64_t hash = hashBytes(obj.data(), obj.size());
+	if (!mtlPath.empty() && mtl.open(mtlPath.c_str())) hash = hashBytes(mtl.data(), mtl.size(), hash);
+	return hash;
+}
+
+/**
+ * Returns true if a section of count elements of the given size starts on
+ * a section boundary and ends within a file of the given size. Written so
+ * that no sum or product can wrap, whatever a corrupt header holds.
+ */
+static bool sectionFits(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t size)
+{
+	return offset % sectionAlignment == 0 && offset <= size && count <= (size - offset) / elementSize;
+}
+
+/** Returns true if every material's texture path is terminated within its field. */
+static bool materialsTerminated(const MeshMaterial *materials, uint32_t materialCount)
+{
+	for (const MeshMaterial *material = materials; material < materials + materialCount; material++)
+	{
+		if (memchr(material->texture, '\0', sizeof(material->texture)) == NULL) return false;
+	}
+	return true;
+}
+
+/** Returns true if every index names one of the vertices. */
+static bool indicesInRange(const uint32_t *indices, uint32_t indexCount, uint32_t vertexCount)
+{
+	for (const uint32_t *index = indices; index < indices + indexCount; index++)
+	{
+		if (*index >= vertexCount) return false;
+	}
+	return true;
+}
+
+/**
+ * Returns true if every sub-mesh's indices lie between first and end and
+ * its material is one of the mesh's.
+ */
+static bool subMeshesInRange(const SubMesh *subMeshes, uint64_t subMeshCount, uint64_t first, uint64_t end,
+	uint32_t materialCount)
+{
+	for (const SubMesh *subMesh = subMeshes; subMesh < subMeshes + subMeshCount; subMesh++)
+	{
+		if (subMesh->firstIndex < first || (uint64_t)subMesh->firstIndex + subMesh->indexCount > end ||
+			subMesh->material >= materialCount)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/** Sets a material to the OBJ defaults. */
+static void defaultMaterial(MeshMaterial *material)
+{
+	memset(material, 0, sizeof(MeshMaterial));
+	for (unsigned i = 0; i < 3; i++)
+	{
+		material->diffuse[i] = 0.8f;
+		material->ambient[i] = 0.2f;
+	}
+	material->diffuse[3] = material->ambient[3] = material->specular[3] = 1.0f;
+}
+
+/** Returns a pointer past any leading spaces or tabs. */
+static const char* skipSpace(const char *text)
+{
+	while (*text == ' ' || *text == '\t') text++;
+	return text;
+}
+
+/** Returns true if the line starts with the given keyword followed by whitespace. */
+static bool hasKeyword(const char *line, const char *keyword, const char **rest)
+{
+	size_t length = strlen(keyword);
+	if (strncmp(line, keyword, length) != 0) return false;
+	if (line[length] != ' ' && line[length] != '\t') return false;
+	*rest = skipSpace(line + length);
+	return true;
+}
+
+/** Reads up to count floats from a line. */
+static void readFloats(const char *text, float *values, unsigned count)
+{
+	for (unsigned i = 0; i < count; i++)
+	{
+		char *end;
+		values[i] = strtof(text, &end);
+		if (end == text) break;
+		text = end;
+	}
+}
+
+/** Converts a one-based (or negative relative) OBJ index to a zero-based one. */
+static int resolveIndex(long index, size_t count)
+{
+	if (index > 0) return (int)index - 1;
+	if (index < 0) return (int)(count + index);
+	return -1;
+}
+
+namespace
+{
+	/** The position, texture coordinate and normal a face corner refers to. */
+	struct CornerKey
+	{
+		int position, texCoord, normal;
+
+		bool operator==(const CornerKey &other) const
+		{
+			return position == other.position && texCoord == other.texCoord && normal == other.normal;
+		}
+	};
+
+	struct CornerKeyHash
+	{
+		size_t operator()(const CornerKey &key) const
+		{
+			return ((size_t)key.position * 73856093u) ^ ((size_t)key.texCoord * 19349663u) ^ ((size_t)key.normal * 83492791u);
+		}
+	};
+}
+
+Mesh::Mesh()
+{
+	useParsedData();
+}
+
+Mesh::~Mesh()
+{
+	release();
+}
+
+void Mesh::useParsedData()
+{
+	vertices = vertexData.empty() ? NULL : &vertexData[0];
+	vertexCount = (uint32_t)vertexData.size();
+	indices = indexData.empty() ? NULL : &indexData[0];
+	indexCount = (uint32_t)indexData.size();
+	subMeshes = subMeshData.empty() ? NULL : &subMeshData[0];
+	subMeshCount = (uint32_t)subMeshData.size();
+	materials = materialData.empty() ? NULL : &materialData[0];
+	materialCount = (uint32_t)materialData.size();
+	lods = lodData.empty() ? NULL : &lodData[0];
+	lodCount = (uint32_t)lodData.size();
+	lodIndices = lodIndexData.empty() ? NULL : &lodIndexData[0];
+	lodIndexCount = (uint32_t)lodIndexData.size();
+	lodSubMeshes = lodSubMeshData.empty() ? NULL : &lodSubMeshData[0];
+	computeBounds();
+}
+
+void Mesh::buildLods()
+{
+	lodData.clear();
+	lodIndexData.clear();
+	lodSubMeshData.clear();
+	if (indexCount / 3 < minimumLodTriangles) return;
+
+	// Each level carries on collapsing from the last, halving it, until a
+	// level would save too little to be worth drawing.
+	MeshSimplifier simplifier(*this);
+	uint32_t previous = indexCount / 3;
+	for (unsigned level = 1; level < maxMeshLevels; level++)
+	{
+		uint32_t left = simplifier.simplify(previous / 2);
+		if (left > previous * 3 / 4) break;
+
+		MeshLod lod = { simplifier.getError(), left, { 0, 0 } };
+		lodData.push_back(lod);
+		simplifier.write(&lodIndexData, &lodSubMeshData, indexCount);
+		previous = left;
+	}
+	useParsedData();
+}
+
+void Mesh::computeBounds()
+{
+	subMeshBoundsData.resize(subMeshCount);
+	subMeshBounds = subMeshBoundsData.empty() ? NULL : &subMeshBoundsData[0];
+
+	// An empty mesh gets an empty box at the origin.
+	memset(&bounds, 0, sizeof(bounds));
+	for (uint32_t i = 0; i < subMeshCount; i++)
+	{
+		MeshBounds &box = subMeshBoundsData[i];
+		memset(&box, 0, sizeof(box));
+		const uint32_t *index = indices + subMeshes[i].firstIndex;
+		const uint32_t *end = index + subMeshes[i].indexCount;
+		for (bool first = true; index < end; index++, first = false)
+		{
+			const float *position = vertices[*index].position;
+			for (unsigned axis = 0; axis < 3; axis++)
+			{
+				if (first || position[axis] < box.min[axis]) box.min[axis] = position[axis];
+				if (first || position[axis] > box.max[axis]) box.max[axis] = position[axis];
+			}
+		}
+
+		for (unsigned axis = 0; axis < 3; axis++)
+		{
+			if (i == 0 || box.min[axis] < bounds.min[axis]) bounds.min[axis] = box.min[axis];
+			if (i == 0 || box.max[axis] > bounds.max[axis]) bounds.max[axis] = box.max[axis];
+		}
+	}
+}
+
+void Mesh::release()
+{
+	vertexData.clear();
+	indexData.clear();
+	subMeshData.clear();
+	materialData.clear();
+	lodData.clear();
+	lodIndexData.clear();
+	lodSubMeshData.clear();
+	materialLibrary.clear();
+	cache.close();
+	useParsedData();
+}
+
+bool Mesh::load(const char *objPath)
+{
+	std::string cachePath = std::string(objPath) + ".meshcache";
+	if (mapCache(cachePath.c_str(), objPath)) return true;
+
+	if (!parseObj(objPath)) return false;
+	if (!writeCache(cachePath.c_str(), objPath))
+	{
+		fprintf(stderr, "Could not write mesh cache %s\n", cachePath.c_str());
+	}
+	return true;
+}
+
+void Mesh::parseMaterials(const std::string &mtlPath, std::vector<std::string> *names)
+{
+	MappedFile file;
+	if (!file.open(mtlPath.c_str())) return;
+
+	std::string text((const char*)file.data(), file.size());
+	std::string directory = directoryOf(mtlPath);
+	MeshMaterial *material = NULL;
+
+	for (size_t start = 0; start < text.size();)
+	{
+		size_t end = text.find('\n', start);
+		if (end == std::string::npos) end = text.size();
+		std::string line = text.substr(start, end - start);
+		start = end + 1;
+
+		// Strip trailing whitespace, including carriage returns.
+		while (!line.empty() && isspace((unsigned char)line[line.size() - 1])) line.erase(line.size() - 1);
+		const char *cursor = skipSpace(line.c_str()), *rest;
+
+		if (hasKeyword(cursor, "newmtl", &rest))
+		{
+			materialData.push_back(MeshMaterial());
+			material = &materialData.back();
+			defaultMaterial(material);
+			names->push_back(rest);
+		}
+		else if (material == NULL) continue;
+		else if (hasKeyword(cursor, "Kd", &rest)) readFloats(rest, material->diffuse, 3);
+		else if (hasKeyword(cursor, "Ka", &rest)) readFloats(rest, material->ambient, 3);
+		else if (hasKeyword(cursor, "Ks", &rest)) readFloats(rest, material->specular, 3);
+		else if (hasKeyword(cursor, "Ns", &rest)) readFloats(rest, &material->shininess, 1);
+		else if (hasKeyword(cursor, "map_Kd", &rest))
+		{
+			std::string texture = directory + rest;
+			if (texture.size() < sizeof(material->texture))
+			{
+				strcpy(material->texture, texture.c_str());
+			}
+		}
+	}
+}
+
+bool Mesh::parseObj(const char *objPath)
+{
+	release();
+
+	MappedFile file;
+	if (!file.open(objPath))
+	{
+		fprintf(stderr, "Could not open model %s\n", objPath);
+		return false;
+	}
+	std::string text((const char*)file.data(), file.size());
+	file.close();
+
+	std::vector<float> positions, texCoords, normals;
+	std::vector<std::string> materialNames;
+	std::unordered_map<CornerKey, uint32_t, CornerKeyHash> corners;
+	std::vector<CornerKey> keys;
+	std::vector<uint32_t> face;
+	uint32_t currentMaterial = 0;
+	bool haveDefaultMaterial = false;
+
+	// Starts a new sub-mesh, dropping the previous one if nothing was added to it.
+	#define BEGIN_SUBMESH(materialIndex) \
+		{ \
+			if (!subMeshData.empty() && subMeshData.back().indexCount == 0) subMeshData.pop_back(); \
+			SubMesh subMesh = { (uint32_t)indexData.size(), 0, (materialIndex), 0 }; \
+			subMeshData.push_back(subMesh); \
+		}
+
+	for (size_t start = 0; start < text.size();)
+	{
+		size_t end = text.find('\n', start);
+		if (end == std::string::npos) end = text.size();
+		std::string line = text.substr(start, end - start);
+		start = end + 1;
+
+		while (!line.empty() && isspace((unsigned char)line[line.size() - 1])) line.erase(line.size() - 1);
+		const char *cursor = skipSpace(line.c_str()), *rest;
+
+		if (hasKeyword(cursor, "v", &rest))
+		{
+			float value[3] = { 0, 0, 0 };
+			readFloats(rest, value, 3);
+			positions.insert(positions.end(), value, value + 3);
+		}
+		else if (hasKeyword(cursor, "vt", &rest))
+		{
+			float value[2] = { 0, 0 };
+			readFloats(rest, value, 2);
+			texCoords.insert(texCoords.end(), value, value + 2);
+		}
+		else if (hasKeyword(cursor, "vn", &rest))
+		{
+			float value[3] = { 0, 1, 0 };
+			readFloats(rest, value, 3);
+			normals.insert(normals.end(), value, value + 3);
+		}
+		else if (hasKeyword(cursor, "mtllib", &rest))
+		{
+			materialLibrary = directoryOf(objPath) + rest;
+			parseMaterials(materialLibrary, &materialNames);
+		}
+		else if (hasKeyword(cursor, "usemtl", &rest))
+		{
+			currentMaterial = (uint32_t)materialNames.size();
+			for (size_t i = 0; i < materialNames.size(); i++)
+			{
+				if (materialNames[i] == rest) currentMaterial = (uint32_t)i;
+			}
+			if (currentMaterial == materialNames.size())
+			{
+				// Unknown materials fall back to a shared default.
+				if (!haveDefaultMaterial)
+				{
+					materialData.push_back(MeshMaterial());
+					defaultMaterial(&materialData.back());
+					materialNames.push_back(std::string());
+					haveDefaultMaterial = true;
+				}
+				currentMaterial = (uint32_t)materialData.size() - 1;
+			}
+			BEGIN_SUBMESH(currentMaterial);
+		}
+		else if (hasKeyword(cursor, "g", &rest))
+		{
+			// Groups get their own sub-meshes so they can be culled separately.
+			BEGIN_SUBMESH(currentMaterial);
+		}
+		else if (hasKeyword(cursor, "f", &rest))
+		{
+			if (subMeshData.empty()) BEGIN_SUBMESH(currentMaterial);
+
+			keys.clear();
+			face.clear();
+			bool missingNormal = false;
+			while (*rest)
+			{
+				char *next;
+				CornerKey key = { -1, -1, -1 };
+				key.position = resolveIndex(strtol(rest, &next, 10), positions.size() / 3);
+				if (next == rest) break;
+				rest = next;
+				if (*rest == '/')
+				{
+					rest++;
+					if (*rest != '/')
+					{
+						key.texCoord = resolveIndex(strtol(rest, &next, 10), texCoords.size() / 2);
+						rest = next;
+					}
+					if (*rest == '/')
+					{
+						rest++;
+						key.normal = resolveIndex(strtol(rest, &next, 10), normals.size() / 3);
+						rest = next;
+					}
+				}
+				rest = skipSpace(rest);
+				if (key.position < 0 || (size_t)key.position * 3 >= positions.size()) continue;
+				if (key.normal < 0 || (size_t)key.normal * 3 >= normals.size()) missingNormal = true;
+				keys.push_back(key);
+			}
+			if (keys.size() < 3) continue;
+
+			// Corners without normals share the face normal, and can't be shared with other faces.
+			float faceNormal[3] = { 0, 1, 0 };
+			if (missingNormal)
+			{
+				const float *a = &positions[keys[0].position * 3], *b = &positions[keys[1].position * 3], *c = &positions[keys[2].position * 3];
+				float u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] }, v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+				faceNormal[0] = u[1] * v[2] - u[2] * v[1];
+				faceNormal[1] = u[2] * v[0] - u[0] * v[2];
+				faceNormal[2] = u[0] * v[1] - u[1] * v[0];
+				float length = sqrtf(faceNormal[0] * faceNormal[0] + faceNormal[1] * faceNormal[1] + faceNormal[2] * faceNormal[2]);
+				if (length > 0)
+				{
+					for (unsigned i = 0; i < 3; i++) faceNormal[i] /= length;
+				}
+			}
+
+			for (size_t i = 0; i < keys.size(); i++)
+			{
+				const CornerKey &key = keys[i];
+				bool hasNormal = key.normal >= 0 && (size_t)key.normal * 3 < normals.size();
+				bool hasTexCoord = key.texCoord >= 0 && (size_t)key.texCoord * 2 < texCoords.size();
+
+				if (hasNormal)
+				{
+					std::unordered_map<CornerKey, uint32_t, CornerKeyHash>::iterator found = corners.find(key);
+					if (found != corners.end())
+					{
+						face.push_back(found->second);
+						continue;
+					}
+					corners[key] = (uint32_t)vertexData.size();
+				}
+
+				MeshVertex vertex;
+				memcpy(vertex.position, &positions[key.position * 3], sizeof(vertex.position));
+				memcpy(vertex.normal, hasNormal ? &normals[key.normal * 3] : faceNormal, sizeof(vertex.normal));
+				vertex.texCoord[0] = hasTexCoord ? texCoords[key.texCoord * 2] : 0.0f;
+				vertex.texCoord[1] = hasTexCoord ? texCoords[key.texCoord * 2 + 1] : 0.0f;
+				face.push_back((uint32_t)vertexData.size());
+				vertexData.push_back(vertex);
+			}
+
+			// Triangulate the polygon as a fan around its first corner.
+			for (size_t i = 2; i < face.size(); i++)
+			{
+				indexData.push_back(face[0]);
+				indexData.push_back(face[i - 1]);
+				indexData.push_back(face[i]);
+			}
+			subMeshData.back().indexCount += (uint32_t)(face.size() - 2) * 3;
+		}
+	}
+	#undef BEGIN_SUBMESH
+
+	if (!subMeshData.empty() && subMeshData.back().indexCount == 0) subMeshData.pop_back();
+	if (materialData.empty())
+	{
+		materialData.push_back(MeshMaterial());
+		defaultMaterial(&materialData.back());
+	}
+	for (size_t i = 0; i < subMeshData.size(); i++)
+	{
+		if (subMeshData[i].material >= materialData.size()) subMeshData[i].material = 0;
+	}
+
+	useParsedData();
+	buildLods();
+	return !indexData.empty();
+}
+
+bool Mesh::writeCache(const char *cachePath, const char *objPath) const
+{
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, meshCacheMagic, sizeof(header.magic));
+	header.version = meshCacheVersion;
+
+	FileStamp objStamp, mtlStamp = { 0, 0 };
+	if (!getFileStamp(objPath, &objStamp)) return false;
+	if (!materialLibrary.empty()) getFileStamp(materialLibrary.c_str(), &mtlStamp);
+	if (materialLibrary.size() >= sizeof(header.materialLibrary)) return false;
+
+	header.objModified = objStamp.modified;
+	header.objSize = objStamp.size;
+	header.mtlModified = mtlStamp.modified;
+	header.mtlSize = mtlStamp.size;
+	header.sourceHash = hashSources(objPath, materialLibrary);
+	strcpy(header.materialLibrary, materialLibrary.c_str());
+
+	header.vertexCount = vertexCount;
+	header.indexCount = indexCount;
+	header.subMeshCount = subMeshCount;
+	header.materialCount = materialCount;
+	header.vertexOffset = alignSection(sizeof(header));
+	header.indexOffset = alignSection(header.vertexOffset + sizeof(MeshVertex) * vertexCount);
+	header.subMeshOffset = alignSection(header.indexOffset + sizeof(uint32_t) * indexCount);
+	header.materialOffset = alignSection(header.subMeshOffset + sizeof(SubMesh) * subMeshCount);
+	header.lodCount = lodCount;
+	header.lodIndexCount = lodIndexCount;
+	header.lodOffset = alignSection(header.materialOffset + sizeof(MeshMaterial) * materialCount);
+	header.lodIndexOffset = alignSection(header.lodOffset + sizeof(MeshLod) * lodCount);
+	header.lodSubMeshOffset = alignSection(header.lodIndexOffset + sizeof(uint32_t) * lodIndexCount);
+
+	FILE *file = fopen(cachePath, "wb");
+	if (!file) return false;
+
+	const void *sections[] = { vertices, indices, subMeshes, materials, lods, lodIndices, lodSubMeshes };
+	const uint64_t offsets[] = { header.vertexOffset, header.indexOffset, header.subMeshOffset, header.materialOffset,
+		header.lodOffset, header.lodIndexOffset, header.lodSubMeshOffset };
+	const size_t sizes[] = { sizeof(MeshVertex) * vertexCount, sizeof(uint32_t) * indexCount,
+		sizeof(SubMesh) * subMeshCount, sizeof(MeshMaterial) * materialCount,
+		sizeof(MeshLod) * lodCount, sizeof(uint32_t) * lodIndexCount, sizeof(SubMesh) * lodCount * subMeshCount };
+	static const char padding[sectionAlignment] = { 0 };
+
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	uint64_t written = sizeof(header);
+	for (unsigned i = 0; ok && i < 7; i++)
+	{
+		ok = fwrite(padding, 1, (size_t)(offsets[i] - written), file) == offsets[i] - written;
+		ok = ok && (sizes[i] == 0 || fwrite(sections[i], sizes[i], 1, file) == 1);
+		written = offsets[i] + sizes[i];
+	}
+	ok = (fclose(file) == 0) && ok;
+
+	if (!ok) remove(cachePath);
+	return ok;
+}
+
+bool Mesh::mapCache(const char *cachePath, const char *objPath)
+{
+	release();
+	if (!cache.open(cachePath)) return false;
+
+	const MeshCacheHeader *header = (const MeshCacheHeader*)cache.data();
+	const uint64_t size = cache.size();
+	if (size < sizeof(MeshCacheHeader) ||
+		memcmp(header->magic, meshCacheMagic, sizeof(header->magic)) != 0 ||
+		header->version != meshCacheVersion ||
+		header->materialLibrary[sizeof(header->materialLibrary) - 1] != '\0' ||
+		!sectionFits(header->vertexOffset, header->vertexCount, sizeof(MeshVertex), size) ||
+		!sectionFits(header->indexOffset, header->indexCount, sizeof(uint32_t), size) ||
+		!sectionFits(header->subMeshOffset, header->subMeshCount, sizeof(SubMesh), size) ||
+		!sectionFits(header->materialOffset, header->materialCount, sizeof(MeshMaterial), size) ||
+		header->lodCount >= maxMeshLevels ||
+		!sectionFits(header->lodOffset, header->lodCount, sizeof(MeshLod), size) ||
+		!sectionFits(header->lodIndexOffset, header->lodIndexCount, sizeof(uint32_t), size) ||
+		!sectionFits(header->lodSubMeshOffset, (uint64_t)header->lodCount * header->subMeshCount, sizeof(SubMesh), size))
+	{
+		cache.close();
+		return false;
+	}
+
+	// A corrupt cache could send the renderer outside its buffers, so every
+	// index and sub-mesh, of every level, is checked once here rather than
+	// on each draw. A level's sub-meshes must stay within its own indices,
+	// which follow the full mesh's. Texture names are opened as paths, so
+	// each must end inside its field.
+	const unsigned char *base = cache.data();
+	if (!materialsTerminated((const MeshMaterial*)(base + header->materialOffset), header->materialCount) ||
+		!indicesInRange((const uint32_t*)(base + header->indexOffset), header->indexCount, header->vertexCount) ||
+		!subMeshesInRange((const SubMesh*)(base + header->subMeshOffset), header->subMeshCount,
+			0, header->indexCount, header->materialCount) ||
+		!indicesInRange((const uint32_t*)(base + header->lodIndexOffset), header->lodIndexCount, header->vertexCount) ||
+		!subMeshesInRange((const SubMesh*)(base + header->lodSubMeshOffset), (uint64_t)header->lodCount * header->subMeshCount,
+			header->indexCount, (uint64_t)header->indexCount + header->lodIndexCount, header->materialCount))
+	{
+		cache.close();
+		return false;
+	}
+
+	// Unchanged timestamps mean the cache is current. Otherwise the sources
+	// may only have been touched, so fall back to comparing their contents.
+	std::string mtlPath = header->materialLibrary;
+	FileStamp objStamp, mtlStamp = { 0, 0 };
+	if (!getFileStamp(objPath, &objStamp))
+	{
+		cache.close();
+		return false;
+	}
+	if (!mtlPath.empty()) getFileStamp(mtlPath.c_str(), &mtlStamp);
+
+	bool stampsMatch = objStamp.modified == header->objModified && objStamp.size == header->objSize &&
+		mtlStamp.modified == header->mtlModified && mtlStamp.size == header->mtlSize;
+	if (!stampsMatch && hashSources(objPath, mtlPath) != header->sourceHash)
+	{
+		cache.close();
+		return false;
+	}
+
+	// The sources were only touched, so record their new stamps and save
+	// hashing them again on the next load. The mapping is closed while the
+	// header is written, and if it can't be written the cache is still used.
+	if (!stampsMatch)
+	{
+		MeshCacheHeader updated = *header;
+		updated.objModified = objStamp.modified;
+		updated.objSize = objStamp.size;
+		updated.mtlModified = mtlStamp.modified;
+		updated.mtlSize = mtlStamp.size;
+		MeshCacheHeader original = *header;
+		cache.close();
+
+		bool written = false;
+		FILE *file = fopen(cachePath, "r+b");
+		if (file)
+		{
+			written = fwrite(&updated, sizeof(updated), 1, file) == 1;
+			written = (fclose(file) == 0) && written;
+		}
+		if (!cache.open(cachePath) || cache.size() != size ||
+			memcmp(cache.data(), written ? &updated : &original, sizeof(MeshCacheHeader)) != 0)
+		{
+			cache.close();
+			return false;
+		}
+		header = (const MeshCacheHeader*)cache.data();
+	}
+
+	materialLibrary = mtlPath;
+	vertices = (const MeshVertex*)(cache.data() + header->vertexOffset);
+	vertexCount = header->vertexCount;
+	indices = (const uint32_t*)(cache.data() + header->indexOffset);
+	indexCount = header->indexCount;
+	subMeshes = (const SubMesh*)(cache.data() + header->subMeshOffset);
+	subMeshCount = header->subMeshCount;
+	materials = (const MeshMaterial*)(cache.data() + header->materialOffset);
+	materialCount = header->materialCount;
+	lods = (const MeshLod*)(cache.data() + header->lodOffset);
+	lodCount = header->lodCount;
+	lodIndices = (const uint32_t*)(cache.data() + header->lodIndexOffset);
+	lodIndexCount = header->lodIndexCount;
+	lodSubMeshes = (const SubMesh*)(cache.data() + header->lodSubMeshOffset);
+	computeBounds();
+	return true;
+}
+
+size_t Mesh::getMemoryUsage() const
+{
+	return sizeof(MeshVertex) * vertexCount + sizeof(uint32_t) * (indexCount + lodIndexCount) +
+		sizeof(SubMesh) * subMeshCount * (1 + lodCount) + sizeof(MeshMaterial) * materialCount +
+		sizeof(MeshLod) * lodCount;
+}
+
+void Mesh::buildSphere(unsigned slices, unsigned stacks, const float diffuse[3])
+{
+	release();
+
+	for (unsigned stack = 0; stack <= stacks; stack++)
+	{
+		float polar = 3.14159265f * stack / stacks;
+		for (unsigned slice = 0; slice <= slices; slice++)
+		{
+			float azimuth = 2.0f * 3.14159265f * slice / slices;
+			MeshVertex vertex;
+			vertex.normal[0] = sinf(polar) * cosf(azimuth);
+			vertex.normal[1] = cosf(polar);
+			vertex.normal[2] = sinf(polar) * sinf(azimuth);
+			memcpy(vertex.position, vertex.normal, sizeof(vertex.position));
+			vertex.texCoord[0] = (float)slice / slices;
+			vertex.texCoord[1] = 1.0f - (float)stack / stacks;
+			vertexData.push_back(vertex);
+		}
+	}
+
+	for (unsigned stack = 0; stack < stacks; stack++)
+	{
+		for (unsigned slice = 0; slice < slices; slice++)
+		{
+			uint32_t first = stack * (slices + 1) + slice, second = first + slices + 1;
+			uint32_t quad[6] = { first, first + 1, second, second, first + 1, second + 1 };
+			indexData.insert(indexData.end(), quad, quad + 6);
+		}
+	}
+
+	MeshMaterial material;
+	defaultMaterial(&material);
+	memcpy(material.diffuse, diffuse, sizeof(float) * 3);
+	memcpy(material.ambient, diffuse, sizeof(float) * 3);
+	materialData.push_back(material);
+
+	SubMesh subMesh = { 0, (uint32_t)indexData.size(), 0, 0 };
+	subMeshData.push_back(subMesh);
+	useParsedData();
+}
@@ -0,0 +1,181 @@
+/*
+ * Triangle meshes loaded from Wavefront OBJ files, with a binary cache.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef MESH_H
+#define MESH_H
+
+#include <gl/glew.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+/** Interleaved vertex layout shared by every mesh. */
+struct MeshVertex
+{
+	float position[3];
+	float normal[3];
+	float texCoord[2];
+};
+
+/** A contiguous run of triangle indices drawn with a single material. */
+struct SubMesh
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	uint32_t material;
+	uint32_t reserved;
+};
+
+/** An axis-aligned box around some of a mesh's vertices, in model space. */
+struct MeshBounds
+{
+	float min[3];
+	float max[3];
+};
+
+/** A simplified version of a mesh, for drawing it small. */
+struct MeshLod
+{
+	/** How far, in model units, the simplified surface may be from the full one. */
+	float error;
+	uint32_t triangleCount;
+	uint32_t reserved[2];
+};
+
+/** The most levels of detail a mesh has, counting the full mesh. */
+static const unsigned maxMeshLevels = 4;
+
+/** Surface properties read from the model's MTL file. */
+struct MeshMaterial
+{
+	float diffuse[4];
+	float ambient[4];
+	float specular[4];
+	float shininess;
+	/** Path of the diffuse texture relative to the working directory, or empty. */
+	char texture[124];
+};
+
+/**
+ * Holds the geometry of an OBJ model as one de-indexed, interleaved vertex
+ * buffer with a triangle index list split into per-material sub-meshes.
+ *
+ * Parsing OBJ text is slow, so the first load writes a binary cache next to
+ * the model (<model>.obj.meshcache). Later loads map the cache straight into
+ * memory, provided the OBJ and MTL files haven't changed since.
+ *
+ * A parsed model of more than a few hundred triangles is also simplified
+ * into up to three coarser levels of detail, each about half the last, and
+ * these are kept in the cache too. The levels share the full mesh's
+ * vertices; each has its own indices and a sub-mesh per full sub-mesh.
+ */
+class Mesh
+{
+public:
+	Mesh();
+	~Mesh();
+
+	/** Loads the model from its cache, rebuilding the cache if it is missing or stale. */
+	bool load(const char *objPath);
+
+	/** Loads the model by parsing the OBJ text, without touching the cache. */
+	bool parseObj(const char *objPath);
+
+	/** Frees the geometry. */
+	void release();
+
+	/** Fills the mesh with a unit sphere of a single untextured colour. */
+	void buildSphere(unsigned slices, unsigned stacks, const float diffuse[3]);
+
+	/** Returns the number of bytes of geometry held, whether parsed or mapped. */
+	size_t getMemoryUsage() const;
+
+	const MeshVertex *vertices;
+	uint32_t vertexCount;
+	const uint32_t *indices;
+	uint32_t indexCount;
+	const SubMesh *subMeshes;
+	uint32_t subMeshCount;
+	const MeshMaterial *materials;
+	uint32_t materialCount;
+
+	/** Boxes around the whole mesh and around each sub-mesh, for culling. */
+	MeshBounds bounds;
+	const MeshBounds *subMeshBounds;
+
+	/**
+	 * The simplified levels, coarsest last, and their indices. Each level
+	 * has subMeshCount sub-meshes in lodSubMeshes, whose first indices
+	 * count on from the end of the full mesh's, as they are uploaded after
+	 * them in one buffer.
+	 */
+	const MeshLod *lods;
+	uint32_t lodCount;
+	const uint32_t *lodIndices;
+	uint32_t lodIndexCount;
+	const SubMesh *lodSubMeshes;
+
+	/** Returns the sub-meshes of a level of detail, where level 0 is the full mesh. */
+	const SubMesh* getLevelSubMeshes(unsigned level) const
+	{
+		return level == 0 ? subMeshes : lodSubMeshes + (level - 1) * subMeshCount;
+	}
+
+	/** Returns how many triangles a level of detail has. */
+	uint32_t getLevelTriangles(unsigned level) const
+	{
+		return level == 0 ? indexCount / 3 : lods[level - 1].triangleCount;
+	}
+
+private:
+	/** Storage for geometry parsed from text; empty when the cache is mapped. */
+	std::vector<MeshVertex> vertexData;
+	std::vector<uint32_t> indexData;
+	std::vector<SubMesh> subMeshData;
+	std::vector<MeshMaterial> materialData;
+	std::vector<MeshLod> lodData;
+	std::vector<uint32_t> lodIndexData;
+	std::vector<SubMesh> lodSubMeshData;
+
+	/** Worked out from the vertices after every load, so the cache format needn't change. */
+	std::vector<MeshBounds> subMeshBoundsData;
+
+	/** The mapped cache file, when loaded from the cache. */
+	MappedFile cache;
+
+	/** Path of the MTL library named by the OBJ file, or empty. */
+	std::string materialLibrary;
+
+	/** Points the public views at the parsed storage. */
+	void useParsedData();
+
+	/** Simplifies the parsed geometry into its levels of detail. */
+	void buildLods();
+
+	/** Fills in the bounds from the current geometry. */
+	void computeBounds();
+
+	/** Reads the MTL library, adding its materials and their names. */
+	void parseMaterials(const std::string &mtlPath, std::vector<std::string> *names);
+
+	/** Writes the parsed geometry to a cache file. */
+	bool writeCache(const char *cachePath, const char *objPath) const;
+
+	/** Maps a cache file, returning false if it is missing, corrupt or out of date. */
+	bool mapCache(const char *cachePath, const char *objPath);
+
+	Mesh(const Mesh&);
+	Mesh& operator=(const Mesh&);
+};
+
+#endif // MESH_H
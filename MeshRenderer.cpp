@@ -0,0 +1,410 @@
+/*
+ * Implementation of the instanced mesh renderer.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include "MeshRenderer.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/** Attribute locations shared by the shader and the vertex array objects. */
+enum
+{
+	POSITION_ATTRIBUTE = 0,
+	NORMAL_ATTRIBUTE = 1,
+	TEXCOORD_ATTRIBUTE = 2,
+	/** The instance transform takes four consecutive locations, one per column. */
+	TRANSFORM_ATTRIBUTE = 3
+};
+
+/**
+ * Transforms each vertex by its instance matrix and then the fixed-function
+ * modelview and projection, so the camera is still set with gluLookAt.
+ */
+static const char *vertexShaderSource =
+	"#version 330 compatibility\n"
+	"layout(location = 0) in vec3 position;\n"
+	"layout(location = 1) in vec3 normal;\n"
+	"layout(location = 2) in vec2 texCoord;\n"
+	"layout(location = 3) in mat4 instanceTransform;\n"
+	"out vec3 eyeNormal;\n"
+	"out vec2 uv;\n"
+	"void main()\n"
+	"{\n"
+	"	eyeNormal = gl_NormalMatrix * (transpose(inverse(mat3(instanceTransform))) * normal);\n"
+	"	uv = texCoord;\n"
+	"	gl_Position = gl_ModelViewProjectionMatrix * (instanceTransform * vec4(position, 1.0));\n"
+	"}\n";
+
+/** Lights with fixed-function light 0 and modulates by the texture, as the fixed pipeline would. */
+static const char *fragmentShaderSource =
+	"#version 330 compatibility\n"
+	"in vec3 eyeNormal;\n"
+	"in vec2 uv;\n"
+	"uniform bool textured;\n"
+	"uniform vec4 materialDiffuse;\n"
+	"uniform vec4 materialAmbient;\n"
+	"uniform sampler2D diffuseMap;\n"
+	"out vec4 colour;\n"
+	"void main()\n"
+	"{\n"
+	"	vec3 n = normalize(eyeNormal);\n"
+	"	vec3 l = normalize(gl_LightSource[0].position.xyz);\n"
+	"	vec3 lit = (gl_LightModel.ambient.rgb + gl_LightSource[0].ambient.rgb) * materialAmbient.rgb +\n"
+	"		gl_LightSource[0].diffuse.rgb * materialDiffuse.rgb * max(dot(n, l), 0.0);\n"
+	"	vec4 base = textured ? texture(diffuseMap, uv) : vec4(1.0);\n"
+	"	colour = vec4(base.rgb * lit, base.a * materialDiffuse.a);\n"
+	"}\n";
+
+static const GLfloat white[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+static const GLfloat identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+/** Compiles one shader stage, printing the log on failure. */
+static GLuint compileShader(GLenum type, const char *source)
+{
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+
+	GLint compiled;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+	if (!compiled)
+	{
+		char log[1024];
+		glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+		fprintf(stderr, "Mesh shader failed to compile:\n%s\n", log);
+		glDeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+MeshRenderer::MeshRenderer()
+: program(0), instanceBuffer(0),
+texturedLocation(-1), diffuseLocation(-1), ambientLocation(-1), samplerLocation(-1),
+frustum(NULL), detailView(NULL)
+{
+	resetStats();
+}
+
+MeshRenderer::~MeshRenderer()
+{
+}
+
+bool MeshRenderer::init()
+{
+	int major = 0, minor = 0;
+	const char *version = (const char*)glGetString(GL_VERSION);
+	if (!version || sscanf(version, "%d.%d", &major, &minor) != 2 || major * 10 + minor < 33)
+	{
+		printf("OpenGL 3.3 is unavailable, drawing meshes without instancing.\n");
+		return false;
+	}
+
+	GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexShaderSource);
+	GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentShaderSource);
+	if (vertexShader && fragmentShader)
+	{
+		program = glCreateProgram();
+		glAttachShader(program, vertexShader);
+		glAttachShader(program, fragmentShader);
+		glLinkProgram(program);
+
+		GLint linked;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		if (!linked)
+		{
+			char log[1024];
+			glGetProgramInfoLog(program, sizeof(log), NULL, log);
+			fprintf(stderr, "Mesh shader failed to link:\n%s\n", log);
+			glDeleteProgram(program);
+			program = 0;
+		}
+	}
+	// The program keeps the stages alive for as long as it needs them.
+	if (vertexShader) glDeleteShader(vertexShader);
+	if (fragmentShader) glDeleteShader(fragmentShader);
+	if (!program) return false;
+
+	texturedLocation = glGetUniformLocation(program, "textured");
+	diffuseLocation = glGetUniformLocation(program, "materialDiffuse");
+	ambientLocation = glGetUniformLocation(program, "materialAmbient");
+	samplerLocation = glGetUniformLocation(program, "diffuseMap");
+
+	glGenBuffers(1, &instanceBuffer);
+	return true;
+}
+
+void MeshRenderer::deinit()
+{
+	for (size_t i = 0; i < vertexArrays.size(); i++)
+	{
+		if (vertexArrays[i]) glDeleteVertexArrays(1, &vertexArrays[i]);
+	}
+	vertexArrays.clear();
+	vertexArraySources.clear();
+	if (instanceBuffer) glDeleteBuffers(1, &instanceBuffer);
+	if (program) glDeleteProgram(program);
+	instanceBuffer = 0;
+	program = 0;
+}
+
+GLuint MeshRenderer::getVertexArray(MeshHandle mesh)
+{
+	const GpuMesh &gpu = AssetRegistry::get().getGpuMesh(mesh);
+	if (vertexArrays.size() < mesh)
+	{
+		vertexArrays.resize(mesh, 0);
+		vertexArraySources.resize(mesh, 0);
+	}
+
+	// Registry slots are reused, so rebuild if the handle now names other buffers.
+	GLuint &vertexArray = vertexArrays[mesh - 1];
+	if (vertexArray && vertexArraySources[mesh - 1] == gpu.vertexBuffer) return vertexArray;
+	if (!vertexArray) glGenVertexArrays(1, &vertexArray);
+	vertexArraySources[mesh - 1] = gpu.vertexBuffer;
+
+	glBindVertexArray(vertexArray);
+	glBindBuffer(GL_ARRAY_BUFFER, gpu.vertexBuffer);
+	glEnableVertexAttribArray(POSITION_ATTRIBUTE);
+	glVertexAttribPointer(POSITION_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (const GLvoid*)offsetof(MeshVertex, position));
+	glEnableVertexAttribArray(NORMAL_ATTRIBUTE);
+	glVertexAttribPointer(NORMAL_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (const GLvoid*)offsetof(MeshVertex, normal));
+	glEnableVertexAttribArray(TEXCOORD_ATTRIBUTE);
+	glVertexAttribPointer(TEXCOORD_ATTRIBUTE, 2, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (const GLvoid*)offsetof(MeshVertex, texCoord));
+
+	// The instance buffer is re-filled for every draw, but keeps its name.
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	for (unsigned column = 0; column < 4; column++)
+	{
+		glEnableVertexAttribArray(TRANSFORM_ATTRIBUTE + column);
+		glVertexAttribPointer(TRANSFORM_ATTRIBUTE + column, 4, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 16, (const GLvoid*)(sizeof(GLfloat) * 4 * column));
+		glVertexAttribDivisor(TRANSFORM_ATTRIBUTE + column, 1);
+	}
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpu.indexBuffer);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return vertexArray;
+}
+
+void MeshRenderer::resetStats()
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+void DetailView::set(const GLfloat projection[16], const GLfloat modelview[16], int viewportHeight, float pixelTolerance)
+{
+	memcpy(this->modelview, modelview, sizeof(this->modelview));
+	pixelsPerUnit = projection[5] * viewportHeight * 0.5f;
+	this->pixelTolerance = pixelTolerance;
+}
+
+unsigned MeshRenderer::chooseLevel(const Mesh &data, const GLfloat *transform) const
+{
+	if (!detailView || data.lodCount == 0) return 0;
+
+	// Find the bounds' centre and radius as placed by the transform.
+	float centre[3], world[3], radius = 0, scale = 0;
+	for (unsigned axis = 0; axis < 3; axis++)
+	{
+		centre[axis] = (data.bounds.min[axis] + data.bounds.max[axis]) * 0.5f;
+		float half = (data.bounds.max[axis] - data.bounds.min[axis]) * 0.5f;
+		radius += half * half;
+
+		const GLfloat *column = transform + axis * 4;
+		float length = column[0] * column[0] + column[1] * column[1] + column[2] * column[2];
+		if (length > scale) scale = length;
+	}
+	scale = sqrtf(scale);
+	radius = sqrtf(radius) * scale;
+	for (unsigned row = 0; row < 3; row++)
+	{
+		world[row] = transform[row] * centre[0] + transform[4 + row] * centre[1] + transform[8 + row] * centre[2] + transform[12 + row];
+	}
+
+	// Its nearest point's depth in front of the camera decides how large
+	// a model unit looks. Anything reaching past the camera is drawn whole.
+	const GLfloat *view = detailView->modelview;
+	float depth = -(view[2] * world[0] + view[6] * world[1] + view[10] * world[2] + view[14]) - radius;
+	if (depth <= 0) return 0;
+	float pixels = detailView->pixelsPerUnit * scale / depth;
+
+	unsigned level = 0;
+	while (level < data.lodCount && data.lods[level].error * pixels <= detailView->pixelTolerance) level++;
+	return level;
+}
+
+unsigned MeshRenderer::cull(const Mesh &data, const GLfloat *transforms, unsigned count)
+{
+	visibleSubMeshes.assign(data.subMeshCount, 1);
+	for (unsigned level = 0; level < maxMeshLevels; level++) levelTransforms[level].clear();
+
+	unsigned visible = 0;
+	const GLfloat *last = NULL;
+	for (const GLfloat *transform = transforms; transform < transforms + 16 * count; transform += 16)
+	{
+		if (frustum && !frustum->intersectsBox(data.bounds, transform))
+		{
+			stats.instancesCulled++;
+			stats.trianglesCulled += data.indexCount / 3;
+			continue;
+		}
+		std::vector<GLfloat> &batch = levelTransforms[chooseLevel(data, transform)];
+		batch.insert(batch.end(), transform, transform + 16);
+		last = transform;
+		visible++;
+	}
+	stats.instancesDrawn += visible;
+
+	// A lone instance can have its sub-meshes culled as well; with more,
+	// a sub-mesh could only be skipped if it were outside for every one.
+	if (frustum && visible == 1 && data.subMeshCount > 1)
+	{
+		for (uint32_t i = 0; i < data.subMeshCount; i++)
+		{
+			if (frustum->intersectsBox(data.subMeshBounds[i], last)) continue;
+			visibleSubMeshes[i] = 0;
+			stats.subMeshesCulled++;
+			stats.trianglesCulled += data.subMeshes[i].indexCount / 3;
+		}
+	}
+	return visible;
+}
+
+void MeshRenderer::countDrawn(const Mesh &data, unsigned level, uint32_t subMesh, unsigned count)
+{
+	uint32_t full = data.subMeshes[subMesh].indexCount / 3;
+	uint32_t drawn = data.getLevelSubMeshes(level)[subMesh].indexCount / 3;
+	stats.drawCalls++;
+	stats.trianglesDrawn += (size_t)drawn * count;
+	stats.trianglesSimplified += (size_t)(full - drawn) * count;
+}
+
+void MeshRenderer::draw(MeshHandle mesh)
+{
+	drawInstances(mesh, identity, 1);
+}
+
+void MeshRenderer::drawInstances(MeshHandle mesh, const GLfloat *transforms, unsigned count)
+{
+	if (mesh == 0 || count == 0) return;
+
+	const Mesh &data = AssetRegistry::get().getMesh(mesh);
+	if (cull(data, transforms, count) == 0) return;
+
+	// The instances at each level of detail are drawn as a batch of their own.
+	for (unsigned level = 0; level <= data.lodCount; level++)
+	{
+		const std::vector<GLfloat> &batch = levelTransforms[level];
+		if (batch.empty()) continue;
+		if (program) drawInstanced(mesh, level, batch.data(), (unsigned)(batch.size() / 16));
+		else drawFixedFunction(mesh, level, batch.data(), (unsigned)(batch.size() / 16));
+	}
+}
+
+void MeshRenderer::drawInstanced(MeshHandle mesh, unsigned level, const GLfloat *transforms, unsigned count)
+{
+	const Mesh &data = AssetRegistry::get().getMesh(mesh);
+	const GpuMesh &gpu = AssetRegistry::get().getGpuMesh(mesh);
+	GLuint vertexArray = getVertexArray(mesh);
+
+	// Orphan the previous contents so the driver needn't wait for earlier draws.
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 16 * count, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLfloat) * 16 * count, transforms);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glUseProgram(program);
+	glUniform1i(samplerLocation, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindVertexArray(vertexArray);
+
+	const SubMesh *subMeshes = data.getLevelSubMeshes(level);
+	for (const SubMesh *subMesh = subMeshes; subMesh < subMeshes + data.subMeshCount; subMesh++)
+	{
+		if (!visibleSubMeshes[subMesh - subMeshes]) continue;
+		const MeshMaterial &material = data.materials[subMesh->material];
+		GLuint texture = gpu.materialTextures[subMesh->material];
+
+		// Textured surfaces take their colour from the texture.
+		glUniform1i(texturedLocation, texture != 0);
+		glUniform4fv(diffuseLocation, 1, texture ? white : material.diffuse);
+		glUniform4fv(ambientLocation, 1, material.ambient);
+		glBindTexture(GL_TEXTURE_2D, texture);
+
+		glDrawElementsInstanced(GL_TRIANGLES, subMesh->indexCount, GL_UNSIGNED_INT,
+			(const GLvoid*)(sizeof(uint32_t) * subMesh->firstIndex), count);
+		countDrawn(data, level, (uint32_t)(subMesh - subMeshes), count);
+		stats.subMeshesDrawn += count;
+	}
+
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glUseProgram(0);
+}
+
+void MeshRenderer::drawFixedFunction(MeshHandle mesh, unsigned level, const GLfloat *transforms, unsigned count)
+{
+	const Mesh &data = AssetRegistry::get().getMesh(mesh);
+	const GpuMesh &gpu = AssetRegistry::get().getGpuMesh(mesh);
+
+	glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+	glBindBuffer(GL_ARRAY_BUFFER, gpu.vertexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpu.indexBuffer);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glVertexPointer(3, GL_FLOAT, sizeof(MeshVertex), (const GLvoid*)offsetof(MeshVertex, position));
+	glNormalPointer(GL_FLOAT, sizeof(MeshVertex), (const GLvoid*)offsetof(MeshVertex, normal));
+	glTexCoordPointer(2, GL_FLOAT, sizeof(MeshVertex), (const GLvoid*)offsetof(MeshVertex, texCoord));
+
+	for (const GLfloat *transform = transforms; transform < transforms + 16 * count; transform += 16)
+	{
+		glPushMatrix();
+		glMultMatrixf(transform);
+		const SubMesh *subMeshes = data.getLevelSubMeshes(level);
+		for (const SubMesh *subMesh = subMeshes; subMesh < subMeshes + data.subMeshCount; subMesh++)
+		{
+			if (!visibleSubMeshes[subMesh - subMeshes]) continue;
+			const MeshMaterial &material = data.materials[subMesh->material];
+			GLuint texture = gpu.materialTextures[subMesh->material];
+
+			if (texture)
+			{
+				glEnable(GL_TEXTURE_2D);
+				glBindTexture(GL_TEXTURE_2D, texture);
+				glColor4fv(white);
+				glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, white);
+			}
+			else
+			{
+				glDisable(GL_TEXTURE_2D);
+				glColor4fv(material.diffuse);
+				glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, material.diffuse);
+			}
+			glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, material.ambient);
+
+			glDrawElements(GL_TRIANGLES, subMesh->indexCount, GL_UNSIGNED_INT,
+				(const GLvoid*)(sizeof(uint32_t) * subMesh->firstIndex));
+			countDrawn(data, level, (uint32_t)(subMesh - subMeshes), 1);
+			stats.subMeshesDrawn++;
+		}
+		glPopMatrix();
+	}
+
+	glDisable(GL_TEXTURE_2D);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glPopClientAttrib();
+}
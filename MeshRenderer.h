@@ -0,0 +1,148 @@
+/*
+ * Retained-mode mesh drawing with hardware instancing.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef MESH_RENDERER_H
+#define MESH_RENDERER_H
+
+#include <gl/glew.h>
+#include <vector>
+#include "AssetRegistry.h"
+#include "Frustum.h"
+
+/** What the renderer drew and culled since its counters were last reset. */
+struct RenderStats
+{
+	unsigned drawCalls;
+	unsigned instancesDrawn, instancesCulled;
+	unsigned subMeshesDrawn, subMeshesCulled;
+	size_t trianglesDrawn, trianglesCulled;
+	/** Triangles left out by drawing simplified levels of detail in place of full ones. */
+	size_t trianglesSimplified;
+};
+
+/** Where the camera is and how its view is projected, for choosing levels of detail. */
+struct DetailView
+{
+	/** The modelview matrix instance transforms are applied on top of. */
+	GLfloat modelview[16];
+	/** How many pixels tall something a unit tall and a unit in front of the camera looks. */
+	float pixelsPerUnit;
+	/** How many pixels a level's error may cover before a finer level is drawn instead. */
+	float pixelTolerance;
+
+	/** Sets the view from the matrices a frame is drawn with and the viewport's height. */
+	void set(const GLfloat projection[16], const GLfloat modelview[16], int viewportHeight, float pixelTolerance = 1.0f);
+};
+
+/**
+ * Draws registered meshes from their static GPU buffers. Many copies of one
+ * mesh are drawn with a single instanced call per sub-mesh, with each copy's
+ * transform streamed into a per-instance attribute buffer.
+ *
+ * Instancing needs OpenGL 3.3. On older contexts the renderer falls back to
+ * drawing each instance through the fixed-function pipeline, still from the
+ * same vertex buffers.
+ *
+ * Given a frustum, instances whose bounds are outside it are dropped before
+ * drawing, and so are the sub-meshes of a single instance, such as the
+ * pieces of the gallery, that are outside it.
+ *
+ * Given a detail view, each instance of a mesh with levels of detail is
+ * drawn at the coarsest level whose error would cover no more than a
+ * pixel or so on screen, from how far away and how large it is. The
+ * instances at each level are drawn together.
+ */
+class MeshRenderer
+{
+public:
+	MeshRenderer();
+	~MeshRenderer();
+
+	/** Compiles the instancing shader. Requires a GL context. Returns false if the fallback will be used. */
+	bool init();
+
+	/** Frees the shader and buffers. Requires the GL context to still be current. */
+	void deinit();
+
+	/**
+	 * Draws one copy of a mesh for each column-major 4x4 transform, applied
+	 * on top of the current modelview matrix.
+	 */
+	void drawInstances(MeshHandle mesh, const GLfloat *transforms, unsigned count);
+
+	/** Draws a single copy of a mesh with the current modelview matrix. */
+	void draw(MeshHandle mesh);
+
+	/** Returns true if hardware instancing is in use. */
+	bool isInstancing() const { return program != 0; }
+
+	/**
+	 * Culls what is drawn from now on against a frustum, in the space the
+	 * instance transforms place meshes in, or stops culling if NULL. The
+	 * frustum must outlive its use.
+	 */
+	void setFrustum(const Frustum *frustum) { this->frustum = frustum; }
+
+	/**
+	 * Chooses levels of detail for what is drawn from now on by how large
+	 * it looks from a view, or draws full detail if NULL. The view must
+	 * outlive its use.
+	 */
+	void setDetailView(const DetailView *view) { detailView = view; }
+
+	/** Returns the counters. */
+	const RenderStats& getStats() const { return stats; }
+
+	/** Sets the counters back to zero, usually once a frame. */
+	void resetStats();
+
+private:
+	GLuint program;
+	GLuint instanceBuffer;
+	GLint texturedLocation, diffuseLocation, ambientLocation, samplerLocation;
+
+	const Frustum *frustum;
+	const DetailView *detailView;
+	RenderStats stats;
+
+	/** The transforms of the instances that survived culling at each level of detail, and which sub-meshes to draw. */
+	std::vector<GLfloat> levelTransforms[maxMeshLevels];
+	std::vector<unsigned char> visibleSubMeshes;
+
+	/** Vertex array objects indexed by mesh handle, and the vertex buffer each was built for. */
+	std::vector<GLuint> vertexArrays;
+	std::vector<GLuint> vertexArraySources;
+
+	/** Returns the vertex array object binding a mesh's buffers with the instance buffer. */
+	GLuint getVertexArray(MeshHandle mesh);
+
+	/**
+	 * Drops the instances and sub-meshes outside the frustum, counting what
+	 * was culled, and sorts the rest by level of detail. Returns the number
+	 * of instances left, whose transforms are then in levelTransforms.
+	 */
+	unsigned cull(const Mesh &data, const GLfloat *transforms, unsigned count);
+
+	/** Returns the coarsest level of detail an instance can be drawn at without its error showing. */
+	unsigned chooseLevel(const Mesh &data, const GLfloat *transform) const;
+
+	/** Draws the instances at one level of detail with a call per sub-mesh. */
+	void drawInstanced(MeshHandle mesh, unsigned level, const GLfloat *transforms, unsigned count);
+
+	/** Draws each instance through the fixed-function pipeline. */
+	void drawFixedFunction(MeshHandle mesh, unsigned level, const GLfloat *transforms, unsigned count);
+
+	/** Counts the triangles drawn of a sub-mesh, and those a coarser level left out. */
+	void countDrawn(const Mesh &data, unsigned level, uint32_t subMesh, unsigned count);
+};
+
+#endif // MESH_RENDERER_H
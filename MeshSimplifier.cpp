@@ -0,0 +1,456 @@
+/*
+ * Implementation of quadric edge collapse simplification.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include "MeshSimplifier.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+
+/** How much more an open or material edge resists moving than a face does. */
+static const double borderWeight = 10.0;
+
+namespace
+{
+	/** A position's coordinates by their bits, so vertices at the same place weld. */
+	struct PositionKey
+	{
+		uint32_t bits[3];
+
+		bool operator==(const PositionKey &other) const
+		{
+			return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+		}
+	};
+
+	struct PositionKeyHash
+	{
+		size_t operator()(const PositionKey &key) const
+		{
+			return ((size_t)key.bits[0] * 73856093u) ^ ((size_t)key.bits[1] * 19349663u) ^ ((size_t)key.bits[2] * 83492791u);
+		}
+	};
+
+	/** A whole vertex by its bits, so vertices that are copies of one another weld. */
+	struct VertexKey
+	{
+		uint32_t bits[8];
+
+		bool operator==(const VertexKey &other) const
+		{
+			return memcmp(bits, other.bits, sizeof(bits)) == 0;
+		}
+	};
+
+	struct VertexKeyHash
+	{
+		size_t operator()(const VertexKey &key) const
+		{
+			size_t hash = 0;
+			for (unsigned i = 0; i < 8; i++) hash = hash * 31 + key.bits[i];
+			return hash;
+		}
+	};
+
+	/** How many triangles share an edge, and whether they are all of one sub-mesh. */
+	struct EdgeUse
+	{
+		uint32_t count;
+		uint32_t subMesh;
+		bool mixed;
+	};
+}
+
+/** Adds the quadric of the plane ax + by + cz + d = 0, scaled by weight. */
+static void addPlane(double quadric[11], double a, double b, double c, double d, double weight)
+{
+	quadric[0] += weight * a * a; quadric[1] += weight * a * b; quadric[2] += weight * a * c; quadric[3] += weight * a * d;
+	quadric[4] += weight * b * b; quadric[5] += weight * b * c; quadric[6] += weight * b * d;
+	quadric[7] += weight * c * c; quadric[8] += weight * c * d;
+	quadric[9] += weight * d * d;
+	quadric[10] += weight;
+}
+
+/** Writes the cross product of b - a and c - a. */
+static void triangleNormal(const float *a, const float *b, const float *c, double normal[3])
+{
+	double u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	double v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+	normal[0] = u[1] * v[2] - u[2] * v[1];
+	normal[1] = u[2] * v[0] - u[0] * v[2];
+	normal[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+MeshSimplifier::MeshSimplifier(const Mesh &mesh)
+: liveTriangles(0), worstError(0)
+{
+	// Exporters often give every face corner normals of its own even where
+	// they are the same, so the triangles are joined up through the first
+	// of each set of identical vertices.
+	std::unordered_map<VertexKey, uint32_t, VertexKeyHash> copies;
+	std::vector<uint32_t> original(mesh.vertexCount);
+	for (uint32_t vertex = 0; vertex < mesh.vertexCount; vertex++)
+	{
+		VertexKey key;
+		memcpy(key.bits, &mesh.vertices[vertex], sizeof(key.bits));
+		original[vertex] = copies.insert(std::make_pair(key, vertex)).first->second;
+	}
+
+	// Then the vertices that only differ in normal or texture coordinate
+	// are welded into positions.
+	std::unordered_map<PositionKey, uint32_t, PositionKeyHash> welded;
+	vertexPosition.resize(mesh.vertexCount);
+	for (uint32_t vertex = 0; vertex < mesh.vertexCount; vertex++)
+	{
+		PositionKey key;
+		memcpy(key.bits, mesh.vertices[vertex].position, sizeof(key.bits));
+		std::pair<std::unordered_map<PositionKey, uint32_t, PositionKeyHash>::iterator, bool> added =
+			welded.insert(std::make_pair(key, (uint32_t)(positions.size() / 3)));
+		if (added.second) positions.insert(positions.end(), mesh.vertices[vertex].position, mesh.vertices[vertex].position + 3);
+		vertexPosition[vertex] = added.first->second;
+	}
+	uint32_t positionCount = (uint32_t)(positions.size() / 3);
+
+	// Triangles with two corners at one place cover nothing, so they go now.
+	subMeshMaterials.resize(mesh.subMeshCount);
+	for (uint32_t subMesh = 0; subMesh < mesh.subMeshCount; subMesh++)
+	{
+		subMeshMaterials[subMesh] = mesh.subMeshes[subMesh].material;
+		const uint32_t *index = mesh.indices + mesh.subMeshes[subMesh].firstIndex;
+		const uint32_t *end = index + mesh.subMeshes[subMesh].indexCount;
+		for (; index + 3 <= end; index += 3)
+		{
+			uint32_t a = vertexPosition[index[0]], b = vertexPosition[index[1]], c = vertexPosition[index[2]];
+			if (a == b || b == c || c == a) continue;
+			for (unsigned i = 0; i < 3; i++) triangles.push_back(original[index[i]]);
+			triangleSubMesh.push_back(subMesh);
+		}
+	}
+	liveTriangles = (uint32_t)triangleSubMesh.size();
+	triangleLive.assign(liveTriangles, 1);
+
+	quadrics.resize(positionCount);
+	memset(quadrics.data(), 0, sizeof(Quadric) * positionCount);
+	kinds.assign(positionCount, POSITION_INTERIOR);
+	positionTriangles.resize(positionCount);
+	versions.assign(positionCount, 0);
+	positionLive.assign(positionCount, 1);
+
+	std::unordered_map<uint64_t, EdgeUse> edges;
+	for (uint32_t triangle = 0; triangle < liveTriangles; triangle++)
+	{
+		const uint32_t *corner = &triangles[triangle * 3];
+		double normal[3];
+		triangleNormal(&positions[vertexPosition[corner[0]] * 3], &positions[vertexPosition[corner[1]] * 3],
+			&positions[vertexPosition[corner[2]] * 3], normal);
+		double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+		for (unsigned i = 0; i < 3; i++)
+		{
+			uint32_t position = vertexPosition[corner[i]];
+			positionTriangles[position].push_back(triangle);
+
+			if (length > 0)
+			{
+				const float *point = &positions[position * 3];
+				double a = normal[0] / length, b = normal[1] / length, c = normal[2] / length;
+				addPlane(quadrics[position].a, a, b, c, -(a * point[0] + b * point[1] + c * point[2]), 1.0);
+			}
+
+			uint32_t other = vertexPosition[corner[(i + 1) % 3]];
+			uint64_t key = (uint64_t)std::min(position, other) << 32 | std::max(position, other);
+			std::pair<std::unordered_map<uint64_t, EdgeUse>::iterator, bool> added =
+				edges.insert(std::make_pair(key, EdgeUse()));
+			EdgeUse &use = added.first->second;
+			if (added.second)
+			{
+				use.count = 0;
+				use.subMesh = triangleSubMesh[triangle];
+				use.mixed = false;
+			}
+			use.count++;
+			use.mixed = use.mixed || use.subMesh != triangleSubMesh[triangle];
+		}
+	}
+
+	// An open edge, or one between materials, also holds its ends to the
+	// plane through it at right angles to the surface, so it keeps its shape.
+	for (uint32_t triangle = 0; triangle < liveTriangles; triangle++)
+	{
+		const uint32_t *corner = &triangles[triangle * 3];
+		double normal[3];
+		triangleNormal(&positions[vertexPosition[corner[0]] * 3], &positions[vertexPosition[corner[1]] * 3],
+			&positions[vertexPosition[corner[2]] * 3], normal);
+
+		for (unsigned i = 0; i < 3; i++)
+		{
+			uint32_t position = vertexPosition[corner[i]], other = vertexPosition[corner[(i + 1) % 3]];
+			const EdgeUse &use = edges[(uint64_t)std::min(position, other) << 32 | std::max(position, other)];
+			if (use.count != 1 && !use.mixed) continue;
+
+			const float *start = &positions[position * 3], *finish = &positions[other * 3];
+			double edge[3] = { finish[0] - start[0], finish[1] - start[1], finish[2] - start[2] };
+			double side[3] = {
+				edge[1] * normal[2] - edge[2] * normal[1],
+				edge[2] * normal[0] - edge[0] * normal[2],
+				edge[0] * normal[1] - edge[1] * normal[0] };
+			double length = sqrt(side[0] * side[0] + side[1] * side[1] + side[2] * side[2]);
+			if (length == 0) continue;
+
+			double a = side[0] / length, b = side[1] / length, c = side[2] / length;
+			double d = -(a * start[0] + b * start[1] + c * start[2]);
+			addPlane(quadrics[position].a, a, b, c, d, borderWeight);
+			addPlane(quadrics[other].a, a, b, c, d, borderWeight);
+		}
+	}
+
+	// Corners of edges shared by more than two triangles stay where they are,
+	// and corners of open or material edges may only slide along them.
+	std::vector<unsigned char> borderEdges(positionCount, 0);
+	for (std::unordered_map<uint64_t, EdgeUse>::const_iterator edge = edges.begin(); edge != edges.end(); ++edge)
+	{
+		uint32_t ends[2] = { (uint32_t)(edge->first >> 32), (uint32_t)edge->first };
+		const EdgeUse &use = edge->second;
+		for (unsigned i = 0; i < 2; i++)
+		{
+			if (use.count > 2) kinds[ends[i]] = POSITION_LOCKED;
+			else if (use.count == 1 || use.mixed)
+			{
+				if (kinds[ends[i]] != POSITION_LOCKED) kinds[ends[i]] = POSITION_BORDER;
+				if (borderEdges[ends[i]] < 255) borderEdges[ends[i]]++;
+			}
+		}
+	}
+
+	// A corner where borders meet or branch stays where it is.
+	for (uint32_t position = 0; position < positionCount; position++)
+	{
+		if (borderEdges[position] > 2) kinds[position] = POSITION_LOCKED;
+	}
+
+	for (uint32_t position = 0; position < positionCount; position++)
+	{
+		queueCollapses(position);
+	}
+}
+
+double MeshSimplifier::getCost(uint32_t from, uint32_t to) const
+{
+	double q[10];
+	for (unsigned i = 0; i < 10; i++) q[i] = quadrics[from].a[i] + quadrics[to].a[i];
+	const float *p = &positions[to * 3];
+	double x = p[0], y = p[1], z = p[2];
+	double cost = q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x +
+		q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y +
+		q[7] * z * z + 2 * q[8] * z + q[9];
+	return cost > 0 ? cost : 0;
+}
+
+void MeshSimplifier::queueCollapses(uint32_t position)
+{
+	const std::vector<uint32_t> &around = positionTriangles[position];
+	for (const uint32_t *triangle = around.data(); triangle < around.data() + around.size(); triangle++)
+	{
+		if (!triangleLive[*triangle]) continue;
+		for (unsigned i = 0; i < 3; i++)
+		{
+			uint32_t other = vertexPosition[triangles[*triangle * 3 + i]];
+			if (other == position) continue;
+			if (kinds[position] != POSITION_LOCKED)
+			{
+				Collapse move = { getCost(position, other), position, other, versions[position], versions[other] };
+				queue.push(move);
+			}
+			if (kinds[other] != POSITION_LOCKED)
+			{
+				Collapse move = { getCost(other, position), other, position, versions[other], versions[position] };
+				queue.push(move);
+			}
+		}
+	}
+}
+
+bool MeshSimplifier::collapse(uint32_t from, uint32_t to)
+{
+	const std::vector<uint32_t> &fromTriangles = positionTriangles[from];
+
+	// Find the triangles along the edge, and what each of from's vertices
+	// moves onto: the vertex of to that it shares a triangle with.
+	vertexTargets.clear();
+	uint32_t shared = 0, opposite[2] = { 0, 0 }, sharedSubMesh = 0;
+	bool mixed = false;
+	for (const uint32_t *triangle = fromTriangles.data(); triangle < fromTriangles.data() + fromTriangles.size(); triangle++)
+	{
+		if (!triangleLive[*triangle]) continue;
+		const uint32_t *corner = &triangles[*triangle * 3];
+		int fromCorner = -1, toCorner = -1;
+		for (int i = 0; i < 3; i++)
+		{
+			if (vertexPosition[corner[i]] == from) fromCorner = i;
+			else if (vertexPosition[corner[i]] == to) toCorner = i;
+		}
+		if (toCorner < 0) continue;
+
+		if (shared < 2) opposite[shared] = vertexPosition[corner[3 - fromCorner - toCorner]];
+		if (shared > 0 && triangleSubMesh[*triangle] != sharedSubMesh) mixed = true;
+		sharedSubMesh = triangleSubMesh[*triangle];
+		shared++;
+
+		uint32_t vertex = corner[fromCorner], target = corner[toCorner];
+		bool known = false;
+		for (size_t i = 0; i < vertexTargets.size(); i += 2)
+		{
+			if (vertexTargets[i] != vertex) continue;
+			if (vertexTargets[i + 1] != target) return false;
+			known = true;
+		}
+		if (!known)
+		{
+			vertexTargets.push_back(vertex);
+			vertexTargets.push_back(target);
+		}
+	}
+	if (shared == 0 || shared > 2) return false;
+
+	// A corner on a border may only slide along it.
+	if (kinds[from] == POSITION_BORDER && !(shared == 1 || mixed)) return false;
+
+	// The two ends may only share the neighbours across the edge, or the
+	// collapse would fold the surface onto itself.
+	neighbours.clear();
+	for (const uint32_t *triangle = fromTriangles.data(); triangle < fromTriangles.data() + fromTriangles.size(); triangle++)
+	{
+		if (!triangleLive[*triangle]) continue;
+		for (unsigned i = 0; i < 3; i++) neighbours.push_back(vertexPosition[triangles[*triangle * 3 + i]]);
+	}
+	std::sort(neighbours.begin(), neighbours.end());
+	const std::vector<uint32_t> &toTriangles = positionTriangles[to];
+	for (const uint32_t *triangle = toTriangles.data(); triangle < toTriangles.data() + toTriangles.size(); triangle++)
+	{
+		if (!triangleLive[*triangle]) continue;
+		for (unsigned i = 0; i < 3; i++)
+		{
+			uint32_t other = vertexPosition[triangles[*triangle * 3 + i]];
+			if (other == from || other == to) continue;
+			if ((shared > 0 && other == opposite[0]) || (shared > 1 && other == opposite[1])) continue;
+			if (std::binary_search(neighbours.begin(), neighbours.end(), other)) return false;
+		}
+	}
+
+	// Every vertex of from must have somewhere to go, and no triangle may turn over.
+	const float *target = &positions[to * 3];
+	for (const uint32_t *triangle = fromTriangles.data(); triangle < fromTriangles.data() + fromTriangles.size(); triangle++)
+	{
+		if (!triangleLive[*triangle]) continue;
+		const uint32_t *corner = &triangles[*triangle * 3];
+		const float *points[3];
+		bool touchesTo = false;
+		for (unsigned i = 0; i < 3; i++)
+		{
+			uint32_t position = vertexPosition[corner[i]];
+			touchesTo = touchesTo || position == to;
+			points[i] = &positions[position * 3];
+		}
+		if (touchesTo) continue;
+
+		double before[3], after[3];
+		triangleNormal(points[0], points[1], points[2], before);
+		for (unsigned i = 0; i < 3; i++)
+		{
+			if (vertexPosition[corner[i]] != from) continue;
+			points[i] = target;
+
+			bool known = false;
+			for (size_t j = 0; j < vertexTargets.size() && !known; j += 2) known = vertexTargets[j] == corner[i];
+			if (!known) return false;
+		}
+		triangleNormal(points[0], points[1], points[2], after);
+		double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+		if (dot <= 0) return false;
+	}
+
+	// Move from's triangles over to to, dropping the ones along the edge.
+	for (const uint32_t *triangle = fromTriangles.data(); triangle < fromTriangles.data() + fromTriangles.size(); triangle++)
+	{
+		if (!triangleLive[*triangle]) continue;
+		uint32_t *corner = &triangles[*triangle * 3];
+		bool touchesTo = false;
+		for (unsigned i = 0; i < 3; i++) touchesTo = touchesTo || vertexPosition[corner[i]] == to;
+		if (touchesTo)
+		{
+			triangleLive[*triangle] = 0;
+			liveTriangles--;
+			continue;
+		}
+		for (unsigned i = 0; i < 3; i++)
+		{
+			if (vertexPosition[corner[i]] != from) continue;
+			for (size_t j = 0; j < vertexTargets.size(); j += 2)
+			{
+				if (vertexTargets[j] == corner[i]) corner[i] = vertexTargets[j + 1];
+			}
+		}
+		positionTriangles[to].push_back(*triangle);
+	}
+
+	std::vector<uint32_t> &moved = positionTriangles[to];
+	moved.erase(std::remove_if(moved.begin(), moved.end(),
+		[this](uint32_t triangle) { return !triangleLive[triangle]; }), moved.end());
+	std::vector<uint32_t>().swap(positionTriangles[from]);
+
+	for (unsigned i = 0; i < 11; i++) quadrics[to].a[i] += quadrics[from].a[i];
+	positionLive[from] = 0;
+	versions[to]++;
+	return true;
+}
+
+uint32_t MeshSimplifier::simplify(uint32_t targetTriangles)
+{
+	while (liveTriangles > targetTriangles && !queue.empty())
+	{
+		Collapse move = queue.top();
+		queue.pop();
+		if (!positionLive[move.from] || !positionLive[move.to]) continue;
+		if (versions[move.from] != move.fromVersion || versions[move.to] != move.toVersion) continue;
+		double weight = quadrics[move.from].a[10] + quadrics[move.to].a[10];
+		if (!collapse(move.from, move.to)) continue;
+
+		// The cost sums squares over every plane gathered so far, so it is
+		// averaged over them to give a distance.
+		if (weight > 0 && move.cost / weight > worstError) worstError = move.cost / weight;
+		queueCollapses(move.to);
+	}
+	return liveTriangles;
+}
+
+float MeshSimplifier::getError() const
+{
+	return (float)sqrt(worstError);
+}
+
+void MeshSimplifier::write(std::vector<uint32_t> *indices, std::vector<SubMesh> *subMeshes, uint32_t indexBase) const
+{
+	// The triangles are in sub-mesh order, so each sub-mesh's survivors are a run.
+	uint32_t triangle = 0, triangleCount = (uint32_t)triangleSubMesh.size();
+	for (uint32_t subMesh = 0; subMesh < subMeshMaterials.size(); subMesh++)
+	{
+		SubMesh level = { indexBase + (uint32_t)indices->size(), 0, subMeshMaterials[subMesh], 0 };
+		for (; triangle < triangleCount && triangleSubMesh[triangle] == subMesh; triangle++)
+		{
+			if (!triangleLive[triangle]) continue;
+			indices->insert(indices->end(), &triangles[triangle * 3], &triangles[triangle * 3] + 3);
+			level.indexCount += 3;
+		}
+		subMeshes->push_back(level);
+	}
+}
@@ -0,0 +1,131 @@
+/*
+ * Quadric edge collapse simplification of triangle meshes.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <stdint.h>
+#include <queue>
+#include <vector>
+#include "Mesh.h"
+
+/**
+ * Takes a mesh down to fewer triangles a step at a time by collapsing
+ * edges, cheapest first, where the cost of moving a corner is the sum of
+ * its squared distances from the planes of the triangles that met there
+ * (Garland and Heckbert's error quadrics).
+ *
+ * A corner is only ever moved onto a neighbouring vertex, so every level
+ * reuses the mesh's own vertex buffer and only needs new indices. Corners
+ * where the texture or normals are split are moved along the split, and
+ * only if each side has a vertex to move onto. Corners on an open edge,
+ * or on an edge between two materials, are only moved along that edge, so
+ * the pieces of a model don't part; where more than two such edges meet
+ * the corner is never moved. Collapses that would turn a triangle over
+ * are skipped.
+ */
+class MeshSimplifier
+{
+public:
+	/** Prepares to simplify the full-detail triangles of a mesh. */
+	MeshSimplifier(const Mesh &mesh);
+
+	/**
+	 * Collapses edges until no more than the given number of triangles are
+	 * left, or nothing more can be collapsed. Returns the number left.
+	 */
+	uint32_t simplify(uint32_t targetTriangles);
+
+	/** Returns the number of triangles left. */
+	uint32_t getTriangleCount() const { return liveTriangles; }
+
+	/**
+	 * Returns roughly how far, in model units, the collapses so far have
+	 * moved the surface: the largest root mean square distance any moved
+	 * corner ended up from the planes it gathered.
+	 */
+	float getError() const;
+
+	/**
+	 * Appends the triangles left to indices, sub-mesh by sub-mesh, and one
+	 * sub-mesh for each of the mesh's to subMeshes. Each new sub-mesh's
+	 * first index is where its triangles start in indices plus indexBase.
+	 */
+	void write(std::vector<uint32_t> *indices, std::vector<SubMesh> *subMeshes, uint32_t indexBase) const;
+
+private:
+	/** The symmetric 4x4 matrix of an error quadric, upper triangle only, then the weight of its planes. */
+	struct Quadric
+	{
+		double a[11];
+	};
+
+	/** A possible collapse of one position onto another, and the versions of the two it was costed with. */
+	struct Collapse
+	{
+		double cost;
+		uint32_t from, to;
+		uint32_t fromVersion, toVersion;
+
+		bool operator<(const Collapse &other) const { return cost > other.cost; }
+	};
+
+	/** How freely a position may move. */
+	enum PositionKind
+	{
+		POSITION_INTERIOR,
+		POSITION_BORDER,
+		POSITION_LOCKED
+	};
+
+	/** The material of each of the mesh's sub-meshes. */
+	std::vector<uint32_t> subMeshMaterials;
+
+	/** Each triangle's vertices, its sub-mesh, and whether it is still there. */
+	std::vector<uint32_t> triangles;
+	std::vector<uint32_t> triangleSubMesh;
+	std::vector<unsigned char> triangleLive;
+	uint32_t liveTriangles;
+
+	/** The position each vertex sits at, after vertices at the same place are welded. */
+	std::vector<uint32_t> vertexPosition;
+
+	/** Per position: where it is, its quadric, how it may move and the triangles around it. */
+	std::vector<float> positions;
+	std::vector<Quadric> quadrics;
+	std::vector<unsigned char> kinds;
+	std::vector<std::vector<uint32_t> > positionTriangles;
+	std::vector<uint32_t> versions;
+	std::vector<unsigned char> positionLive;
+
+	std::priority_queue<Collapse> queue;
+	/** The largest mean squared distance from its planes any collapse has had. */
+	double worstError;
+
+	/** Scratch space for a collapse, kept between them. */
+	std::vector<uint32_t> vertexTargets;
+	std::vector<uint32_t> neighbours;
+
+	/** Queues the collapses of a position onto each of its neighbours, and theirs onto it. */
+	void queueCollapses(uint32_t position);
+
+	/** Returns the cost of moving one position onto another. */
+	double getCost(uint32_t from, uint32_t to) const;
+
+	/** Collapses one position onto another, returning false if that isn't allowed. */
+	bool collapse(uint32_t from, uint32_t to);
+
+	MeshSimplifier(const MeshSimplifier&);
+	MeshSimplifier& operator=(const MeshSimplifier&);
+};
+
+#endif // MESH_SIMPLIFIER_H
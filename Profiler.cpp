@@ -0,0 +1,210 @@
+/*
+ * Implementation of the frame profiler.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include "Profiler.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+thread_local Profiler::ThreadRingOwner Profiler::threadRing;
+thread_local bool Profiler::threadEnabled = true;
+
+Profiler& Profiler::get()
+{
+	static Profiler profiler;
+	return profiler;
+}
+
+uint64_t Profiler::now()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Profiler::ThreadRing* Profiler::getThreadRing()
+{
+	ThreadRingOwner &owner = threadRing;
+	if (owner.ring || owner.released) return owner.ring;
+
+	Profiler &profiler = get();
+	std::lock_guard<std::mutex> lock(profiler.mutex);
+	ThreadRing *ring;
+	if (!profiler.freeRings.empty())
+	{
+		ring = profiler.freeRings.back();
+		profiler.freeRings.pop_back();
+	}
+	else ring = new ThreadRing;
+
+	// A reused ring starts empty, under a new id and name, so nothing of
+	// the thread that had it shows up as this one's.
+	ring->written.store(0, std::memory_order_relaxed);
+	ring->id = ++profiler.lastId;
+	sprintf(ring->name, "thread %u", ring->id);
+	profiler.rings.push_back(ring);
+	owner.ring = ring;
+	return ring;
+}
+
+Profiler::ThreadRingOwner::~ThreadRingOwner()
+{
+	released = true;
+	if (!ring) return;
+
+	Profiler &profiler = get();
+	std::lock_guard<std::mutex> lock(profiler.mutex);
+	profiler.rings.erase(std::find(profiler.rings.begin(), profiler.rings.end(), ring));
+	profiler.freeRings.push_back(ring);
+	ring = NULL;
+}
+
+void Profiler::record(const char *name, uint64_t start, uint64_t end)
+{
+	if (!threadEnabled) return;
+	ThreadRing *ring = getThreadRing();
+	if (!ring) return;
+	uint64_t index = ring->written.load(std::memory_order_relaxed);
+	ProfileEvent &event = ring->events[index & (profileRingCapacity - 1)];
+	event.name = name;
+	event.start = start;
+	event.duration = end - start;
+	ring->written.store(index + 1, std::memory_order_release);
+}
+
+void Profiler::setThreadName(const char *name)
+{
+	ThreadRing *ring = getThreadRing();
+	if (!ring) return;
+	std::lock_guard<std::mutex> lock(get().mutex);
+	strncpy(ring->name, name, sizeof(ring->name) - 1);
+	ring->name[sizeof(ring->name) - 1] = 0;
+}
+
+bool Profiler::setThreadEnabled(bool enabled)
+{
+	bool was = threadEnabled;
+	threadEnabled = enabled;
+	return was;
+}
+
+void Profiler::copyEvents(const ThreadRing &ring, std::vector<ProfileEvent> *events)
+{
+	uint64_t end = ring.written.load(std::memory_order_acquire);
+	uint64_t begin = end > profileRingCapacity ? end - profileRingCapacity : 0;
+	size_t first = events->size();
+	for (uint64_t i = begin; i < end; i++)
+	{
+		events->push_back(ring.events[i & (profileRingCapacity - 1)]);
+	}
+
+	// The writer may have lapped the copy. Whatever it has started writing
+	// since could be torn, so only events newer than that are kept.
+	std::atomic_thread_fence(std::memory_order_acquire);
+	uint64_t written = ring.written.load(std::memory_order_relaxed);
+	uint64_t safe = written + 1 > profileRingCapacity ? written + 1 - profileRingCapacity : 0;
+	if (safe > begin)
+	{
+		size_t torn = (size_t)std::min(safe - begin, end - begin);
+		events->erase(events->begin() + first, events->begin() + first + torn);
+	}
+}
+
+void Profiler::summarize(const char *const *names, unsigned count, double windowSeconds, ProfileStats *stats) const
+{
+	std::vector<ProfileEvent> events;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (ThreadRing *const *ring = rings.data(); ring < rings.data() + rings.size(); ring++)
+		{
+			copyEvents(**ring, &events);
+		}
+	}
+
+	uint64_t since = now() - (uint64_t)(windowSeconds * 1e9);
+	std::vector<uint64_t> durations;
+	for (unsigned i = 0; i < count; i++)
+	{
+		durations.clear();
+		for (const ProfileEvent *event = events.data(); event < events.data() + events.size(); event++)
+		{
+			if (event->start + event->duration >= since && strcmp(event->name, names[i]) == 0)
+			{
+				durations.push_back(event->duration);
+			}
+		}
+
+		ProfileStats &result = stats[i];
+		result.name = names[i];
+		result.count = (unsigned)durations.size();
+		result.minimum = result.average = result.p99 = 0;
+		if (durations.empty()) continue;
+
+		std::sort(durations.begin(), durations.end());
+		uint64_t total = 0;
+		for (const uint64_t *duration = durations.data(); duration < durations.data() + durations.size(); duration++)
+		{
+			total += *duration;
+		}
+		size_t rank = (durations.size() * 99 + 99) / 100;
+		result.minimum = durations.front() * 1e-6;
+		result.average = total * 1e-6 / durations.size();
+		result.p99 = durations[rank - 1] * 1e-6;
+	}
+}
+
+int Profiler::exportChromeTrace(const char *path) const
+{
+	FILE *file = fopen(path, "w");
+	if (!file) return -1;
+
+	std::vector<ProfileEvent> events;
+	std::vector<unsigned> threadEnds;
+	std::vector<ThreadRing*> threads;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		threads = rings;
+		for (ThreadRing *const *ring = rings.data(); ring < rings.data() + rings.size(); ring++)
+		{
+			copyEvents(**ring, &events);
+			threadEnds.push_back((unsigned)events.size());
+		}
+	}
+
+	// Times are written in microseconds from the earliest event.
+	uint64_t origin = (uint64_t)-1;
+	for (const ProfileEvent *event = events.data(); event < events.data() + events.size(); event++)
+	{
+		if (event->start < origin) origin = event->start;
+	}
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Shooting Gallery\"}}");
+	unsigned first = 0;
+	for (unsigned t = 0; t < threads.size(); t++)
+	{
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+			threads[t]->id, threads[t]->name);
+		for (unsigned i = first; i < threadEnds[t]; i++)
+		{
+			fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+				events[i].name, threads[t]->id, (events[i].start - origin) * 1e-3, events[i].duration * 1e-3);
+		}
+		first = threadEnds[t];
+	}
+	fprintf(file, "\n]}\n");
+
+	bool written = !ferror(file);
+	if (fclose(file) != 0) written = false;
+	return written ? (int)events.size() : -1;
+}
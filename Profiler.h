@@ -0,0 +1,149 @@
+/*
+ * Scoped timers for profiling frames, recorded per thread.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+/** How many scopes each thread keeps before its oldest are overwritten. Must be a power of two. */
+const unsigned profileRingCapacity = 16384;
+
+/** One timed scope on one thread, in nanoseconds of the steady clock. */
+struct ProfileEvent
+{
+	/** A string literal naming the scope. */
+	const char *name;
+	uint64_t start;
+	uint64_t duration;
+};
+
+/** Rolling figures for one scope over a window, in milliseconds. */
+struct ProfileStats
+{
+	const char *name;
+	unsigned count;
+	double minimum, average, p99;
+};
+
+/**
+ * Collects scopes from every thread that records one. Each thread writes
+ * only to a ring of its own, so recording takes no locks; the lock is only
+ * taken the first time a thread records, when it exits, and when the rings
+ * are read. A thread's ring is handed back when the thread exits, its
+ * scopes drop out of summaries and traces, and the next new thread reuses
+ * it, so threads that come and go don't each leave a ring behind.
+ */
+class Profiler
+{
+public:
+	/** Returns the profiler shared by the whole program. */
+	static Profiler& get();
+
+	/** Returns the steady clock in nanoseconds, the unit events are stamped in. */
+	static uint64_t now();
+
+	/** Records a scope that ran on the calling thread. The name must outlive the profiler. */
+	static void record(const char *name, uint64_t start, uint64_t end);
+
+	/** Names the calling thread in traces. */
+	static void setThreadName(const char *name);
+
+	/**
+	 * Turns recording on or off for the calling thread. Scopes that end
+	 * while it is off are dropped without touching the thread's ring.
+	 * Returns whether recording was on before.
+	 */
+	static bool setThreadEnabled(bool enabled);
+
+	/**
+	 * Works out the shortest, mean and 99th percentile time of each named
+	 * scope, over every thread, for the scopes that ended in the last
+	 * given number of seconds.
+	 */
+	void summarize(const char *const *names, unsigned count, double windowSeconds, ProfileStats *stats) const;
+
+	/**
+	 * Writes every event still in the rings as Chrome trace-event JSON, to
+	 * be opened in chrome://tracing or Perfetto. Returns the number of
+	 * events written, or -1 if the file couldn't be written.
+	 */
+	int exportChromeTrace(const char *path) const;
+
+private:
+	/**
+	 * The events of one thread. Only that thread writes; readers copy the
+	 * events and then throw away any the writer may have reused meanwhile.
+	 */
+	struct ThreadRing
+	{
+		ProfileEvent events[profileRingCapacity];
+		/** How many events have ever been written; the next goes at this index modulo the capacity. */
+		std::atomic<uint64_t> written;
+		char name[32];
+		unsigned id;
+	};
+
+	/** Hands the calling thread's ring back to the profiler when the thread exits. */
+	struct ThreadRingOwner
+	{
+		ThreadRing *ring = NULL;
+		/** Set once the ring has been handed back, so scopes ending later are dropped. */
+		bool released = false;
+		~ThreadRingOwner();
+	};
+
+	mutable std::mutex mutex;
+	/** The rings of threads that are still running. */
+	std::vector<ThreadRing*> rings;
+	/** Rings whose threads have exited, waiting to be reused. They are never freed. */
+	std::vector<ThreadRing*> freeRings;
+	/** The id given to the last ring taken. */
+	unsigned lastId = 0;
+
+	Profiler() {}
+
+	/** The calling thread's ring, once it has recorded something. */
+	static thread_local ThreadRingOwner threadRing;
+
+	/** Whether the calling thread records its scopes. */
+	static thread_local bool threadEnabled;
+
+	/** Returns the calling thread's ring, taking one on first use, or null once the thread is exiting. */
+	static ThreadRing* getThreadRing();
+
+	/** Appends the events of a ring that are safe to read. */
+	static void copyEvents(const ThreadRing &ring, std::vector<ProfileEvent> *events);
+
+	Profiler(const Profiler&);
+	Profiler& operator=(const Profiler&);
+};
+
+/** Times the enclosing block and records it when the block is left. */
+class ProfileScope
+{
+public:
+	explicit ProfileScope(const char *name) : name(name), start(Profiler::now()) {}
+	~ProfileScope() { Profiler::record(name, start, Profiler::now()); }
+
+private:
+	const char *name;
+	uint64_t start;
+
+	ProfileScope(const ProfileScope&);
+	ProfileScope& operator=(const ProfileScope&);
+};
+
+#endif // PROFILER_H
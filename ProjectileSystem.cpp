@@ -0,0 +1,297 @@
+/*
+ * Implementation of the structure-of-arrays projectile system.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include "ProjectileSystem.h"
+#include "BatchIntegrator.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+/** Each array starts on this boundary so it can be loaded with aligned vector instructions. */
+static const size_t arrayAlignment = 32;
+
+static const ShotProperties shotProperties[] =
+{
+	// mass, radius, speed, gravity, damping, pellets, spread, lifetime
+	{ 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0, 0.0f, 0 },			// UNUSED
+	{ 1.5f, 0.03f, 20.0f, 0.5f, 0.99f, 1, 0.0f, 5000 },		// PISTOL
+	{ 0.3f, 0.02f, 18.0f, 0.5f, 0.95f, 8, 3.0f, 5000 },		// SHOTGUN
+	{ 0.0f, 0.0f, 20.0f, 0.0f, 1.0f, 1, 0.0f, 0 },			// HITSCAN
+};
+
+const ShotProperties& getShotProperties(ShotType type)
+{
+	return shotProperties[type];
+}
+
+/** Carves the next aligned array of the given size out of a block. */
+static void* carve(unsigned char *&cursor, size_t bytes)
+{
+	cursor = (unsigned char*)(((uintptr_t)cursor + arrayAlignment - 1) & ~(uintptr_t)(arrayAlignment - 1));
+	void *array = cursor;
+	cursor += bytes;
+	return array;
+}
+
+ProjectileSystem::ProjectileSystem(unsigned capacity)
+: capacity(capacity), live(0), dampingDuration(0)
+{
+	// Pad every array to a whole number of vectors so a batch can run past the last round.
+	size_t count = (capacity + 7) & ~7u;
+	size_t reals = count * sizeof(cyclone::real), words = count * sizeof(unsigned);
+	// Fourteen arrays of reals, the start times and the types, each with room to align it.
+	storage = malloc(14 * (reals + arrayAlignment) + words + arrayAlignment + count + arrayAlignment);
+
+	unsigned char *cursor = (unsigned char*)storage;
+	positionX = (cyclone::real*)carve(cursor, reals);
+	positionY = (cyclone::real*)carve(cursor, reals);
+	positionZ = (cyclone::real*)carve(cursor, reals);
+	previousX = (cyclone::real*)carve(cursor, reals);
+	previousY = (cyclone::real*)carve(cursor, reals);
+	previousZ = (cyclone::real*)carve(cursor, reals);
+	velocityX = (cyclone::real*)carve(cursor, reals);
+	velocityY = (cyclone::real*)carve(cursor, reals);
+	velocityZ = (cyclone::real*)carve(cursor, reals);
+	gravity = (cyclone::real*)carve(cursor, reals);
+	damping = (cyclone::real*)carve(cursor, reals);
+	radius = (cyclone::real*)carve(cursor, reals);
+	mass = (cyclone::real*)carve(cursor, reals);
+	dampingFactor = (cyclone::real*)carve(cursor, reals);
+	startTime = (unsigned*)carve(cursor, words);
+	type = (unsigned char*)carve(cursor, count);
+
+	clear();
+}
+
+ProjectileSystem::~ProjectileSystem()
+{
+	free(storage);
+}
+
+void ProjectileSystem::clear()
+{
+	live = 0;
+}
+
+bool ProjectileSystem::spawn(ShotType shotType, const ShotProperties &properties, const cyclone::Vector3 &position,
+	const cyclone::Vector3 &velocity, unsigned time)
+{
+	if (live >= capacity) return false;
+
+	unsigned index = live++;
+	positionX[index] = position.x;
+	positionY[index] = position.y;
+	positionZ[index] = position.z;
+	previousX[index] = position.x;
+	previousY[index] = position.y;
+	previousZ[index] = position.z;
+	velocityX[index] = velocity.x;
+	velocityY[index] = velocity.y;
+	velocityZ[index] = velocity.z;
+	gravity[index] = properties.gravity;
+	damping[index] = properties.damping;
+	dampingFactor[index] = real_pow(properties.damping, dampingDuration);
+	radius[index] = properties.radius;
+	mass[index] = properties.mass;
+	startTime[index] = time;
+	type[index] = (unsigned char)shotType;
+	return true;
+}
+
+void ProjectileSystem::retire(unsigned index)
+{
+	unsigned last = --live;
+	if (index == last) return;
+
+	positionX[index] = positionX[last];
+	positionY[index] = positionY[last];
+	positionZ[index] = positionZ[last];
+	previousX[index] = previousX[last];
+	previousY[index] = previousY[last];
+	previousZ[index] = previousZ[last];
+	velocityX[index] = velocityX[last];
+	velocityY[index] = velocityY[last];
+	velocityZ[index] = velocityZ[last];
+	gravity[index] = gravity[last];
+	damping[index] = damping[last];
+	dampingFactor[index] = dampingFactor[last];
+	radius[index] = radius[last];
+	mass[index] = mass[last];
+	startTime[index] = startTime[last];
+	type[index] = type[last];
+}
+
+void ProjectileSystem::integrate(cyclone::real duration)
+{
+	// The damping factor only depends on the step length, which rarely changes.
+	if (duration != dampingDuration)
+	{
+		dampingDuration = duration;
+		for (unsigned i = 0; i < live; i++)
+		{
+			dampingFactor[i] = real_pow(damping[i], duration);
+		}
+	}
+
+	// Remember where each round started, so the step can be swept for hits.
+	memcpy(previousX, positionX, live * sizeof(cyclone::real));
+	memcpy(previousY, positionY, live * sizeof(cyclone::real));
+	memcpy(previousZ, positionZ, live * sizeof(cyclone::real));
+
+	// Matches RigidBody::integrate for a body with no forces or spin: the
+	// velocity picks up gravity and is damped, then the position follows.
+	integrateRounds(positionX, positionY, positionZ, velocityX, velocityY, velocityZ,
+		gravity, dampingFactor, live, duration);
+}
+
+/** Returns the squared distance from a point in a box's space to the box. */
+static cyclone::real squareDistanceToBox(const cyclone::Vector3 &point, const cyclone::Vector3 &halfSize)
+{
+	cyclone::real distance = 0;
+	for (unsigned axis = 0; axis < 3; axis++)
+	{
+		cyclone::real offset = point[axis];
+		if (offset > halfSize[axis]) offset -= halfSize[axis];
+		else if (offset < -halfSize[axis]) offset += halfSize[axis];
+		else offset = 0;
+		distance += offset * offset;
+	}
+	return distance;
+}
+
+bool ProjectileSystem::overlapsBox(unsigned index, const cyclone::CollisionBox &box) const
+{
+	// The same test CollisionDetector::boxAndSphere starts with, done in the
+	// box's space without building a sphere primitive.
+	cyclone::Vector3 centre(positionX[index], positionY[index], positionZ[index]);
+	cyclone::Vector3 relCentre = box.getTransform().transformInverse(centre);
+	cyclone::real r = radius[index];
+
+	if (real_abs(relCentre.x) - r > box.halfSize.x ||
+		real_abs(relCentre.y) - r > box.halfSize.y ||
+		real_abs(relCentre.z) - r > box.halfSize.z)
+	{
+		return false;
+	}
+	return squareDistanceToBox(relCentre, box.halfSize) <= r * r;
+}
+
+bool ProjectileSystem::sweepBox(unsigned index, const cyclone::CollisionBox &box, cyclone::real *time) const
+{
+	// Work in the box's space, where it's axis aligned.
+	const cyclone::Matrix4 &transform = box.getTransform();
+	cyclone::Vector3 start = transform.transformInverse(cyclone::Vector3(previousX[index], previousY[index], previousZ[index]));
+	cyclone::Vector3 end = transform.transformInverse(cyclone::Vector3(positionX[index], positionY[index], positionZ[index]));
+	cyclone::Vector3 travel = end - start;
+	cyclone::real r = radius[index];
+
+	// Clip the path against the box grown by the radius on every side,
+	// one pair of faces at a time.
+	cyclone::real enter = 0, exit = 1;
+	for (unsigned axis = 0; axis < 3; axis++)
+	{
+		cyclone::real limit = box.halfSize[axis] + r;
+		if (real_abs(travel[axis]) < real_epsilon)
+		{
+			if (real_abs(start[axis]) > limit) return false;
+			continue;
+		}
+		cyclone::real inverse = 1 / travel[axis];
+		cyclone::real first = (-limit - start[axis]) * inverse, last = (limit - start[axis]) * inverse;
+		if (first > last)
+		{
+			cyclone::real swap = first;
+			first = last;
+			last = swap;
+		}
+		if (first > enter) enter = first;
+		if (last < exit) exit = last;
+		if (enter > exit) return false;
+	}
+
+	// The grown box has square edges where the swept sphere is rounded, so
+	// near an edge the round can be inside the grown box without touching.
+	// Distance from a point on the path to the box is convex along the
+	// path, so the closest approach is found by ternary search and the
+	// first touch by bisection before it. The touch is found a little
+	// inside the surface so the narrow phase agrees that it's a hit.
+	cyclone::real touch = r * r, inside = (0.9f * r) * (0.9f * r);
+	if (squareDistanceToBox(start + travel * enter, box.halfSize) <= inside)
+	{
+		*time = enter;
+		return true;
+	}
+
+	cyclone::real low = enter, high = exit;
+	for (unsigned iteration = 0; iteration < 24; iteration++)
+	{
+		cyclone::real third = (high - low) / 3;
+		if (squareDistanceToBox(start + travel * (low + third), box.halfSize) <
+			squareDistanceToBox(start + travel * (high - third), box.halfSize))
+		{
+			high -= third;
+		}
+		else
+		{
+			low += third;
+		}
+	}
+	cyclone::real closest = (low + high) * 0.5f;
+	cyclone::real closestDistance = squareDistanceToBox(start + travel * closest, box.halfSize);
+	if (closestDistance > touch) return false;
+	if (closestDistance > inside)
+	{
+		// A graze: the closest approach is the best the path offers.
+		*time = closest;
+		return true;
+	}
+
+	low = enter;
+	high = closest;
+	for (unsigned iteration = 0; iteration < 24; iteration++)
+	{
+		cyclone::real middle = (low + high) * 0.5f;
+		if (squareDistanceToBox(start + travel * middle, box.halfSize) <= inside) high = middle;
+		else low = middle;
+	}
+	*time = high;
+	return true;
+}
+
+void ProjectileProxy::setState(const ProjectileSystem &projectiles, unsigned index, cyclone::real time)
+{
+	radius = projectiles.radius[index];
+
+	cyclone::Vector3 start(projectiles.previousX[index], projectiles.previousY[index], projectiles.previousZ[index]);
+	cyclone::Vector3 end(projectiles.positionX[index], projectiles.positionY[index], projectiles.positionZ[index]);
+	cyclone::Vector3 position = start + (end - start) * time;
+
+	body->setMass(projectiles.mass[index]);
+	body->setPosition(position);
+	body->setOrientation(1, 0, 0, 0);
+	body->setVelocity(projectiles.velocityX[index], projectiles.velocityY[index], projectiles.velocityZ[index]);
+	body->setRotation(cyclone::Vector3(0, 0, 0));
+	body->setAcceleration(0, -projectiles.gravity[index], 0);
+	body->setDamping(projectiles.damping[index], 0.8f);
+
+	cyclone::Matrix3 tensor;
+	cyclone::real coeff = 0.4f*body->getMass()*radius*radius;
+	tensor.setInertiaTensorCoeffs(coeff, coeff, coeff);
+	body->setInertiaTensor(tensor);
+
+	body->setCanSleep(false);
+	body->setAwake();
+	body->clearAccumulators();
+	body->calculateDerivedData();
+	calculateInternals();
+}
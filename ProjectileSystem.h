@@ -0,0 +1,157 @@
+/*
+ * Structure-of-arrays storage and integration for projectiles.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef PROJECTILE_SYSTEM_H
+#define PROJECTILE_SYSTEM_H
+
+#include <cyclone.h>
+
+enum ShotType
+{
+    UNUSED = 0,
+    PISTOL,
+    SHOTGUN,
+    /**
+     * Shots are traced instantly along the barrel instead of flying as
+     * rounds; only speed, pellets and spread apply, and speed sets how
+     * hard a hit pushes the target.
+     */
+    HITSCAN
+};
+
+/** Ballistic properties shared by every round of one shot type. */
+struct ShotProperties
+{
+	cyclone::real mass;
+	cyclone::real radius;
+	/** Muzzle speed along the barrel. */
+	cyclone::real speed;
+	/** Downward acceleration applied to the round. */
+	cyclone::real gravity;
+	/** Proportion of velocity kept after one second. */
+	cyclone::real damping;
+	/** Number of rounds released by one trigger pull. */
+	unsigned pellets;
+	/** Maximum deviation of each pellet from the barrel, in degrees. */
+	cyclone::real spread;
+	/** Simulated milliseconds a round stays in flight before it's retired. */
+	unsigned lifetime;
+};
+
+/** Returns the built-in properties of the given shot type, which scenarios can override. */
+const ShotProperties& getShotProperties(ShotType type);
+
+/**
+ * Holds every round in flight in contiguous arrays, one per field, so the
+ * whole set can be integrated in a single branch-free loop.
+ *
+ * Live rounds are kept packed at the front of the arrays: retiring a round
+ * moves the last live round into its place. Indices are therefore only
+ * valid until the next retire.
+ */
+class ProjectileSystem
+{
+public:
+	/** Creates storage for the given maximum number of rounds in flight. */
+	ProjectileSystem(unsigned capacity);
+	~ProjectileSystem();
+
+	/** Retires every round. */
+	void clear();
+
+	/**
+	 * Launches a round with the given properties, stamped with the
+	 * simulation time in milliseconds. Returns false if every round is
+	 * already in flight.
+	 */
+	bool spawn(ShotType type, const ShotProperties &properties, const cyclone::Vector3 &position,
+		const cyclone::Vector3 &velocity, unsigned time);
+
+	/** Retires the round at the given index, moving the last live round into its place. */
+	void retire(unsigned index);
+
+	/** Moves every live round forward in time, several rounds per instruction where supported. */
+	void integrate(cyclone::real duration);
+
+	/** Returns true if the round at the given index touches the box. */
+	bool overlapsBox(unsigned index, const cyclone::CollisionBox &box) const;
+
+	/**
+	 * Sweeps the round at the given index from where it started the last
+	 * step to where it is now, and returns true if it touched the box on
+	 * the way. The box is treated as still for the step. If it hits, time
+	 * is set to the fraction of the step at which the round is first
+	 * inside the box.
+	 */
+	bool sweepBox(unsigned index, const cyclone::CollisionBox &box, cyclone::real *time) const;
+
+	/** Returns the number of rounds in flight. */
+	unsigned getLiveCount() const { return live; }
+
+	/** Returns the maximum number of rounds in flight. */
+	unsigned getCapacity() const { return capacity; }
+
+	/** Per-round state, valid for indices below getLiveCount(). */
+	cyclone::real *positionX, *positionY, *positionZ;
+	/** Positions at the start of the last step, for sweeping. */
+	cyclone::real *previousX, *previousY, *previousZ;
+	cyclone::real *velocityX, *velocityY, *velocityZ;
+	cyclone::real *gravity;
+	cyclone::real *damping;
+	cyclone::real *radius;
+	cyclone::real *mass;
+	unsigned *startTime;
+	unsigned char *type;
+
+private:
+	unsigned capacity;
+	unsigned live;
+
+	/** Velocity kept over one step of dampingDuration, per round. */
+	cyclone::real *dampingFactor;
+	cyclone::real dampingDuration;
+
+	/** One block holding all the arrays above. */
+	void *storage;
+
+	// Each system owns its storage.
+	ProjectileSystem(const ProjectileSystem&);
+	ProjectileSystem& operator=(const ProjectileSystem&);
+};
+
+/**
+ * A collision sphere standing in for one round while the contacts that
+ * involve it are resolved, since the resolver works on rigid bodies.
+ */
+class ProjectileProxy : public cyclone::CollisionSphere
+{
+public:
+	/** The body lives inside the proxy, so pooled proxies need no other allocation. */
+	ProjectileProxy()
+	{
+		body = &state;
+	}
+
+	/**
+	 * Copies the state of the round at the given index into the proxy,
+	 * placed at the given fraction of the way through the last step.
+	 */
+	void setState(const ProjectileSystem &projectiles, unsigned index, cyclone::real time = 1);
+
+private:
+	cyclone::RigidBody state;
+
+	ProjectileProxy(const ProjectileProxy&);
+	ProjectileProxy& operator=(const ProjectileProxy&);
+};
+
+#endif // PROJECTILE_SYSTEM_H
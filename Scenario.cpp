@@ -0,0 +1,352 @@
+/*
+ * Implementation of scenario parsing and the binary scenario cache.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include "Scenario.h"
+#include "MappedFile.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+/** Identifies the cache format; bump the version whenever the layout changes. */
+static const char scenarioCacheMagic[4] = { 'S', 'G', 'S', 'C' };
+static const uint32_t scenarioCacheVersion = 4;
+
+/** The fixed-size header at the start of every scenario cache file, followed by the lanes. */
+struct ScenarioCacheHeader
+{
+	char magic[4];
+	uint32_t version;
+	/** Weapons are stored as they are in memory, so the precision must match. */
+	uint32_t realSize;
+	uint32_t laneCount;
+
+	/** State of the text when the cache was written. */
+	uint64_t sourceModified, sourceSize;
+	uint64_t sourceHash;
+
+	uint32_t rounds, seed;
+	float timestep, groundHeight, retireBelow, retireBeyond;
+	float sleepSpeed, sleepDelay;
+	ShotProperties weapons[4];
+	char scenery[128];
+};
+
+Scenario::Scenario()
+{
+	for (unsigned type = UNUSED; type <= HITSCAN; type++)
+	{
+		weapons[type] = getShotProperties((ShotType)type);
+	}
+	seed = 1;
+	timestep = 1.0f / 120.0f;
+	groundHeight = -2.0f;
+	retireBelow = 0.0f;
+	retireBeyond = 200.0f;
+	sleepSpeed = 0.05f;
+	sleepDelay = 0.5f;
+	setStandard(10, 6);
+}
+
+void Scenario::setStandard(unsigned targetCount, unsigned roundCount)
+{
+	rounds = roundCount;
+	lanes.clear();
+	for (unsigned row = 0; row * 5 < targetCount; row++)
+	{
+		TargetLane lane;
+		lane.count = targetCount - row * 5 < 5 ? targetCount - row * 5 : 5;
+		lane.rows = 1;
+		lane.motion = MOTION_SWEEP;
+		lane.z = 9.5f + 10.0f * row;
+		lane.rowSpacing = 0;
+		lane.height = 2.9f;
+		lane.startX = row % 2 == 0 ? -40.0f : 10.0f;
+		lane.spacing = row % 2 == 0 ? 10.0f : 15.0f;
+		lane.speed = 5.0f;
+		lane.minX = -15.0f;
+		lane.maxX = 15.0f;
+		lanes.push_back(lane);
+	}
+}
+
+unsigned Scenario::getTargetCount() const
+{
+	unsigned total = 0;
+	for (const TargetLane *lane = lanes.data(); lane < lanes.data() + lanes.size(); lane++)
+	{
+		total += lane->count * lane->rows;
+	}
+	return total;
+}
+
+uint64_t Scenario::hash() const
+{
+	const uint32_t counts[2] = { rounds, (uint32_t)lanes.size() };
+	uint64_t result = hashBytes(counts, sizeof(counts));
+	const float rules[5] = { groundHeight, retireBelow, retireBeyond, sleepSpeed, sleepDelay };
+	result = hashBytes(rules, sizeof(rules), result);
+	result = hashBytes(scenery.data(), scenery.size(), result);
+	// The lanes are all 32 bit fields, but a weapon may have padding, so its fields go in one by one.
+	if (!lanes.empty()) result = hashBytes(lanes.data(), sizeof(TargetLane) * lanes.size(), result);
+	for (const ShotProperties *weapon = weapons; weapon < weapons + sizeof(weapons) / sizeof(weapons[0]); weapon++)
+	{
+		const cyclone::real reals[6] = { weapon->mass, weapon->radius, weapon->speed, weapon->gravity, weapon->damping, weapon->spread };
+		const uint32_t words[2] = { weapon->pellets, weapon->lifetime };
+		result = hashBytes(reals, sizeof(reals), result);
+		result = hashBytes(words, sizeof(words), result);
+	}
+	return result;
+}
+
+bool Scenario::load(const char *path)
+{
+	std::string cachePath = std::string(path) + ".scenariocache";
+	if (readCache(cachePath.c_str(), path)) return true;
+
+	if (!parseText(path)) return false;
+	if (!writeCache(cachePath.c_str(), path))
+	{
+		fprintf(stderr, "Could not write scenario cache %s\n", cachePath.c_str());
+	}
+	return true;
+}
+
+/** Returns the next word of a line, advancing the cursor past it, or an empty string at the end. */
+static std::string nextWord(const char *&cursor)
+{
+	while (*cursor && isspace((unsigned char)*cursor)) cursor++;
+	const char *start = cursor;
+	while (*cursor && !isspace((unsigned char)*cursor)) cursor++;
+	return std::string(start, cursor - start);
+}
+
+/** Reads the next word as a number, returning false if it isn't one. */
+static bool nextNumber(const char *&cursor, float *value)
+{
+	std::string word = nextWord(cursor);
+	char *end;
+	*value = strtof(word.c_str(), &end);
+	return !word.empty() && *end == 0;
+}
+
+static bool nextCount(const char *&cursor, uint32_t *value)
+{
+	float number;
+	if (!nextNumber(cursor, &number) || number < 0 || number != (float)(uint32_t)number) return false;
+	*value = (uint32_t)number;
+	return true;
+}
+
+static bool nextReal(const char *&cursor, cyclone::real *value)
+{
+	float number;
+	if (!nextNumber(cursor, &number)) return false;
+	*value = (cyclone::real)number;
+	return true;
+}
+
+bool Scenario::parseText(const char *path)
+{
+	MappedFile file;
+	if (!file.open(path))
+	{
+		fprintf(stderr, "Could not open scenario %s\n", path);
+		return false;
+	}
+	std::string text((const char*)file.data(), file.size());
+	file.close();
+
+	// Start from the built-in gallery, without its lanes.
+	*this = Scenario();
+	lanes.clear();
+
+	unsigned lineNumber = 0;
+	for (size_t start = 0; start < text.size();)
+	{
+		size_t end = text.find('\n', start);
+		if (end == std::string::npos) end = text.size();
+		std::string line = text.substr(start, end - start);
+		start = end + 1;
+		lineNumber++;
+
+		size_t comment = line.find('#');
+		if (comment != std::string::npos) line.erase(comment);
+		const char *cursor = line.c_str();
+		std::string keyword = nextWord(cursor);
+		bool ok = true;
+
+		if (keyword.empty()) continue;
+		else if (keyword == "rounds") ok = nextCount(cursor, &rounds) && rounds > 0;
+		else if (keyword == "seed") ok = nextCount(cursor, &seed);
+		else if (keyword == "timestep") ok = nextNumber(cursor, &timestep) && timestep > 0;
+		else if (keyword == "ground") ok = nextNumber(cursor, &groundHeight);
+		else if (keyword == "scenery")
+		{
+			scenery = nextWord(cursor);
+			ok = !scenery.empty() && nextWord(cursor).empty();
+		}
+		else if (keyword == "retire")
+		{
+			for (std::string word = nextWord(cursor); ok && !word.empty(); word = nextWord(cursor))
+			{
+				if (word == "below") ok = nextNumber(cursor, &retireBelow);
+				else if (word == "beyond") ok = nextNumber(cursor, &retireBeyond);
+				else ok = false;
+			}
+		}
+		else if (keyword == "sleep")
+		{
+			for (std::string word = nextWord(cursor); ok && !word.empty(); word = nextWord(cursor))
+			{
+				if (word == "speed") ok = nextNumber(cursor, &sleepSpeed) && sleepSpeed >= 0;
+				else if (word == "delay") ok = nextNumber(cursor, &sleepDelay) && sleepDelay >= 0;
+				else ok = false;
+			}
+		}
+		else if (keyword == "weapon")
+		{
+			std::string name = nextWord(cursor);
+			ShotProperties *weapon = name == "pistol" ? &weapons[PISTOL] : name == "shotgun" ? &weapons[SHOTGUN] :
+				name == "hitscan" ? &weapons[HITSCAN] : NULL;
+			ok = weapon != NULL;
+			for (std::string word = nextWord(cursor); ok && !word.empty(); word = nextWord(cursor))
+			{
+				if (word == "mass") ok = nextReal(cursor, &weapon->mass) && weapon->mass > 0;
+				else if (word == "radius") ok = nextReal(cursor, &weapon->radius) && weapon->radius > 0;
+				else if (word == "speed") ok = nextReal(cursor, &weapon->speed);
+				else if (word == "gravity") ok = nextReal(cursor, &weapon->gravity);
+				else if (word == "damping") ok = nextReal(cursor, &weapon->damping) && weapon->damping > 0 && weapon->damping <= 1;
+				else if (word == "pellets") ok = nextCount(cursor, &weapon->pellets) && weapon->pellets > 0;
+				else if (word == "spread") ok = nextReal(cursor, &weapon->spread) && weapon->spread >= 0;
+				else if (word == "lifetime") ok = nextCount(cursor, &weapon->lifetime);
+				else ok = false;
+			}
+		}
+		else if (keyword == "lane")
+		{
+			TargetLane lane = { 1, 1, MOTION_STILL, 10.0f, 0.0f, 2.9f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+			for (std::string word = nextWord(cursor); ok && !word.empty(); word = nextWord(cursor))
+			{
+				if (word == "count") ok = nextCount(cursor, &lane.count);
+				else if (word == "z") ok = nextNumber(cursor, &lane.z);
+				else if (word == "height") ok = nextNumber(cursor, &lane.height);
+				else if (word == "start") ok = nextNumber(cursor, &lane.startX);
+				else if (word == "spacing") ok = nextNumber(cursor, &lane.spacing);
+				else if (word == "still") lane.motion = MOTION_STILL;
+				else if (word == "sweep")
+				{
+					lane.motion = MOTION_SWEEP;
+					ok = nextNumber(cursor, &lane.speed) && nextNumber(cursor, &lane.minX) &&
+						nextNumber(cursor, &lane.maxX) && lane.minX < lane.maxX;
+				}
+				else if (word == "repeat") ok = nextCount(cursor, &lane.rows) && nextNumber(cursor, &lane.rowSpacing);
+				else ok = false;
+			}
+			if (ok) lanes.push_back(lane);
+		}
+		else ok = false;
+
+		if (!ok)
+		{
+			fprintf(stderr, "Could not parse scenario %s, line %u: %s\n", path, lineNumber, line.c_str());
+			return false;
+		}
+	}
+
+	if (getTargetCount() == 0)
+	{
+		fprintf(stderr, "Scenario %s has no targets\n", path);
+		return false;
+	}
+	return true;
+}
+
+bool Scenario::writeCache(const char *cachePath, const char *path) const
+{
+	ScenarioCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, scenarioCacheMagic, sizeof(header.magic));
+	header.version = scenarioCacheVersion;
+	header.realSize = sizeof(cyclone::real);
+	header.laneCount = (uint32_t)lanes.size();
+
+	FileStamp stamp;
+	if (!getFileStamp(path, &stamp)) return false;
+	header.sourceModified = stamp.modified;
+	header.sourceSize = stamp.size;
+	header.sourceHash = hashFile(path);
+
+	header.rounds = rounds;
+	header.seed = seed;
+	header.timestep = timestep;
+	header.groundHeight = groundHeight;
+	header.retireBelow = retireBelow;
+	header.retireBeyond = retireBeyond;
+	header.sleepSpeed = sleepSpeed;
+	header.sleepDelay = sleepDelay;
+	memcpy(header.weapons, weapons, sizeof(weapons));
+	if (scenery.size() >= sizeof(header.scenery)) return false;
+	strcpy(header.scenery, scenery.c_str());
+
+	FILE *file = fopen(cachePath, "wb");
+	if (!file) return false;
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	ok = ok && fwrite(lanes.data(), sizeof(TargetLane), lanes.size(), file) == lanes.size();
+	ok = (fclose(file) == 0) && ok;
+
+	if (!ok) remove(cachePath);
+	return ok;
+}
+
+bool Scenario::readCache(const char *cachePath, const char *path)
+{
+	MappedFile cache;
+	if (!cache.open(cachePath)) return false;
+
+	const ScenarioCacheHeader *header = (const ScenarioCacheHeader*)cache.data();
+	if (cache.size() < sizeof(ScenarioCacheHeader) ||
+		memcmp(header->magic, scenarioCacheMagic, sizeof(header->magic)) != 0 ||
+		header->version != scenarioCacheVersion ||
+		header->realSize != sizeof(cyclone::real) ||
+		header->scenery[sizeof(header->scenery) - 1] != '\0' ||
+		sizeof(ScenarioCacheHeader) + sizeof(TargetLane) * (uint64_t)header->laneCount != cache.size())
+	{
+		return false;
+	}
+
+	// Unchanged timestamps mean the cache is current. Otherwise the text
+	// may only have been touched, so fall back to comparing its contents.
+	FileStamp stamp;
+	if (!getFileStamp(path, &stamp)) return false;
+	if ((stamp.modified != header->sourceModified || stamp.size != header->sourceSize) &&
+		hashFile(path) != header->sourceHash)
+	{
+		return false;
+	}
+
+	rounds = header->rounds;
+	seed = header->seed;
+	timestep = header->timestep;
+	groundHeight = header->groundHeight;
+	retireBelow = header->retireBelow;
+	retireBeyond = header->retireBeyond;
+	sleepSpeed = header->sleepSpeed;
+	sleepDelay = header->sleepDelay;
+	memcpy(weapons, header->weapons, sizeof(weapons));
+	scenery = header->scenery;
+	const TargetLane *first = (const TargetLane*)(cache.data() + sizeof(ScenarioCacheHeader));
+	lanes.assign(first, first + header->laneCount);
+	return true;
+}
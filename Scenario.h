@@ -0,0 +1,148 @@
+/*
+ * Gallery layouts and rules read from scenario files.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "ProjectileSystem.h"
+
+/** How the targets of a lane move. */
+enum TargetMotion
+{
+	MOTION_STILL = 0,
+	/** Back and forth across the gallery, turning round at the lane's bounds. */
+	MOTION_SWEEP
+};
+
+/**
+ * A row of evenly spaced targets at one depth, all moving the same way,
+ * optionally repeated further down range.
+ */
+struct TargetLane
+{
+	/** Targets in each row, and how many rows the lane repeats for. */
+	uint32_t count;
+	uint32_t rows;
+	uint32_t motion;
+	/** Depth of the first row, and how much further back each next one is. */
+	float z, rowSpacing;
+	/** Height of the targets' centres. */
+	float height;
+	/** Where the first target of a row starts across the gallery, and the gap to the next. */
+	float startX, spacing;
+	/** Sideways speed, in units per second, and the bounds a sweeping target turns round at. */
+	float speed;
+	float minX, maxX;
+};
+
+/**
+ * Everything that makes one gallery different from another: the target
+ * lanes, the rounds and the weapons, and when rounds are retired.
+ *
+ * Scenarios are written as text (<name>.scenario), which is parsed once
+ * and written to a binary cache next to it (<name>.scenario.scenariocache).
+ * Later loads read the cache, rebuilding it when the text has changed.
+ * The text has one setting per line, and # starts a comment:
+ *
+ *     rounds 6
+ *     seed 1
+ *     timestep 0.008333
+ *     ground -2
+ *     retire below 0 beyond 200
+ *     sleep speed 0.05 delay 0.5
+ *     scenery Models/gallery.obj
+ *     weapon pistol mass 1.5 radius 0.03 speed 20 gravity 0.5 damping 0.99 pellets 1 spread 0 lifetime 5000
+ *     weapon hitscan speed 20 pellets 1 spread 0
+ *     lane count 5 z 9.5 start -40 spacing 10 sweep 5 -15 15 repeat 100 20
+ *
+ * The weapons are pistol, shotgun and hitscan; hitscan shots reach as
+ * far as rounds are retired beyond. Settings left out keep the values of
+ * the built-in gallery. A lane's height defaults to 2.9; "still" instead
+ * of "sweep" makes it stand still.
+ */
+class Scenario
+{
+public:
+	/** Creates the built-in gallery: ten sweeping targets in two rows, and six rounds. */
+	Scenario();
+
+	/**
+	 * Lays the given number of targets out as the built-in gallery does:
+	 * five to a row, each row ten units further back, alternating between
+	 * tight rows from the far left and wide rows from right of centre.
+	 */
+	void setStandard(unsigned targetCount, unsigned roundCount);
+
+	/** Loads a scenario from its cache, rebuilding the cache if it is missing or stale. */
+	bool load(const char *path);
+
+	/** Loads a scenario by parsing its text, without touching the cache. */
+	bool parseText(const char *path);
+
+	/** Returns the total number of targets over every lane and row. */
+	unsigned getTargetCount() const;
+
+	/**
+	 * Returns a hash of every setting but the seed and timestep, which
+	 * recordings keep for themselves, so a replay can tell whether it is in
+	 * the gallery it was recorded in.
+	 */
+	uint64_t hash() const;
+
+	/** Returns the properties of the given weapon in this scenario. */
+	const ShotProperties& getWeapon(ShotType type) const { return weapons[type]; }
+
+	std::vector<TargetLane> lanes;
+
+	/** Indexed by ShotType; the first entry is unused. */
+	ShotProperties weapons[4];
+
+	/** Rounds in the magazine, which is also how many can be in flight at once. */
+	unsigned rounds;
+
+	/** Seeds the pellet spread. */
+	unsigned seed;
+
+	/** Length of one simulation step in seconds. */
+	float timestep;
+
+	/** Height of the floor the targets fall onto. */
+	float groundHeight;
+
+	/** Rounds are retired when they drop below this height or pass this depth. */
+	float retireBelow, retireBeyond;
+
+	/**
+	 * A target moving slower than this, in units or radians per second,
+	 * for this many seconds is put to sleep until a round hits it. A speed
+	 * of zero keeps every target awake.
+	 */
+	float sleepSpeed, sleepDelay;
+
+	/**
+	 * The model whose walls stop rounds and falling targets, or empty for
+	 * an open range with only the ground.
+	 */
+	std::string scenery;
+
+private:
+	/** Writes the scenario to a cache file. */
+	bool writeCache(const char *cachePath, const char *path) const;
+
+	/** Reads a cache file, returning false if it is missing, corrupt or out of date. */
+	bool readCache(const char *cachePath, const char *path);
+};
+
+#endif // SCENARIO_H
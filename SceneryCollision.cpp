@@ -0,0 +1,410 @@
+/*
+ * Implementation of scenery collision.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include "SceneryCollision.h"
+#include "Mesh.h"
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+/** Identifies the cache format; bump the version whenever the layout changes. */
+static const char collisionCacheMagic[4] = { 'S', 'G', 'C', 'C' };
+static const uint32_t collisionCacheVersion = 1;
+
+/** The fixed-size header at the start of every collision cache file, followed by the triangles and then the nodes. */
+struct CollisionCacheHeader
+{
+	char magic[4];
+	uint32_t version;
+
+	/** State of the OBJ file when the cache was written. */
+	uint64_t objModified, objSize;
+	uint64_t sourceHash;
+
+	uint32_t triangleCount, nodeCount;
+};
+
+/** Leaves hold up to this many triangles. */
+static const uint32_t leafSize = 4;
+
+/** Deep enough for a tree over far more triangles than a model can hold. */
+static const unsigned maxDepth = 64;
+
+static cyclone::Vector3 toVector(const float v[3])
+{
+	return cyclone::Vector3(v[0], v[1], v[2]);
+}
+
+/** Returns true if a point on the triangle's plane lies inside the triangle. */
+static bool insideTriangle(const SceneryTriangle &triangle, const cyclone::Vector3 &point)
+{
+	cyclone::Vector3 a = toVector(triangle.a), b = toVector(triangle.b), c = toVector(triangle.c);
+	cyclone::Vector3 normal = toVector(triangle.normal);
+	return ((b - a) % (point - a)) * normal >= 0 &&
+		((c - b) % (point - b)) * normal >= 0 &&
+		((a - c) % (point - c)) * normal >= 0;
+}
+
+/** Returns true if the segment from start along delta, fattened by radius, passes through the node's bounds. */
+static bool segmentTouchesNode(const SceneryNode &node, const cyclone::Vector3 &start,
+	const cyclone::Vector3 &delta, cyclone::real radius, cyclone::real maxTime)
+{
+	cyclone::real near = 0, far = maxTime;
+	for (unsigned i = 0; i < 3; i++)
+	{
+		cyclone::real low = node.min[i] - radius, high = node.max[i] + radius;
+		if (delta[i] == 0)
+		{
+			if (start[i] < low || start[i] > high) return false;
+			continue;
+		}
+		cyclone::real t0 = (low - start[i]) / delta[i], t1 = (high - start[i]) / delta[i];
+		if (t0 > t1) std::swap(t0, t1);
+		near = std::max(near, t0);
+		far = std::min(far, t1);
+		if (near > far) return false;
+	}
+	return true;
+}
+
+static bool boundsOverlap(const SceneryNode &node, const float min[3], const float max[3])
+{
+	return node.min[0] <= max[0] && node.max[0] >= min[0] &&
+		node.min[1] <= max[1] && node.max[1] >= min[1] &&
+		node.min[2] <= max[2] && node.max[2] >= min[2];
+}
+
+SceneryCollision::SceneryCollision()
+: triangles(NULL), triangleCount(0), nodes(NULL), nodeCount(0)
+{
+}
+
+void SceneryCollision::release()
+{
+	triangleData.clear();
+	nodeData.clear();
+	cache.close();
+	triangles = NULL;
+	triangleCount = 0;
+	nodes = NULL;
+	nodeCount = 0;
+}
+
+bool SceneryCollision::load(const char *objPath)
+{
+	std::string cachePath = std::string(objPath) + ".collisioncache";
+	if (mapCache(cachePath.c_str(), objPath)) return true;
+
+	Mesh mesh;
+	if (!mesh.load(objPath)) return false;
+	build(mesh);
+	if (!writeCache(cachePath.c_str(), objPath))
+	{
+		fprintf(stderr, "Could not write collision cache %s\n", cachePath.c_str());
+	}
+	return isLoaded();
+}
+
+void SceneryCollision::build(const Mesh &mesh)
+{
+	release();
+
+	// The mesh is de-indexed for drawing, so its triangles come straight
+	// from the index list. Slivers have no normal to collide along.
+	triangleData.reserve(mesh.indexCount / 3);
+	for (const uint32_t *index = mesh.indices; index + 2 < mesh.indices + mesh.indexCount; index += 3)
+	{
+		SceneryTriangle triangle;
+		memcpy(triangle.a, mesh.vertices[index[0]].position, sizeof(triangle.a));
+		memcpy(triangle.b, mesh.vertices[index[1]].position, sizeof(triangle.b));
+		memcpy(triangle.c, mesh.vertices[index[2]].position, sizeof(triangle.c));
+
+		cyclone::Vector3 normal = (toVector(triangle.b) - toVector(triangle.a)) % (toVector(triangle.c) - toVector(triangle.a));
+		cyclone::real length = normal.magnitude();
+		if (length < 1e-6f) continue;
+		normal *= 1 / length;
+		triangle.normal[0] = normal.x;
+		triangle.normal[1] = normal.y;
+		triangle.normal[2] = normal.z;
+		triangleData.push_back(triangle);
+	}
+	if (triangleData.empty()) return;
+
+	build(0, (uint32_t)triangleData.size());
+	triangles = triangleData.data();
+	triangleCount = (uint32_t)triangleData.size();
+	nodes = nodeData.data();
+	nodeCount = (uint32_t)nodeData.size();
+}
+
+uint32_t SceneryCollision::build(uint32_t begin, uint32_t end)
+{
+	uint32_t nodeIndex = (uint32_t)nodeData.size();
+	nodeData.push_back(SceneryNode());
+
+	// Bound the triangles, and separately their centres, which choose the split.
+	float min[3], max[3], centreMin[3], centreMax[3];
+	for (unsigned i = 0; i < 3; i++)
+	{
+		min[i] = centreMin[i] = FLT_MAX;
+		max[i] = centreMax[i] = -FLT_MAX;
+	}
+	for (const SceneryTriangle *triangle = triangleData.data() + begin; triangle < triangleData.data() + end; triangle++)
+	{
+		for (unsigned i = 0; i < 3; i++)
+		{
+			float low = std::min(triangle->a[i], std::min(triangle->b[i], triangle->c[i]));
+			float high = std::max(triangle->a[i], std::max(triangle->b[i], triangle->c[i]));
+			min[i] = std::min(min[i], low);
+			max[i] = std::max(max[i], high);
+			centreMin[i] = std::min(centreMin[i], (low + high) * 0.5f);
+			centreMax[i] = std::max(centreMax[i], (low + high) * 0.5f);
+		}
+	}
+	memcpy(nodeData[nodeIndex].min, min, sizeof(min));
+	memcpy(nodeData[nodeIndex].max, max, sizeof(max));
+
+	if (end - begin <= leafSize)
+	{
+		nodeData[nodeIndex].first = begin;
+		nodeData[nodeIndex].count = end - begin;
+		return nodeIndex;
+	}
+
+	// Split at the median along the axis the centres spread furthest on.
+	unsigned axis = 0;
+	for (unsigned i = 1; i < 3; i++)
+	{
+		if (centreMax[i] - centreMin[i] > centreMax[axis] - centreMin[axis]) axis = i;
+	}
+	uint32_t middle = begin + (end - begin) / 2;
+	std::nth_element(triangleData.begin() + begin, triangleData.begin() + middle, triangleData.begin() + end,
+		[axis](const SceneryTriangle &a, const SceneryTriangle &b)
+		{
+			return std::min(a.a[axis], std::min(a.b[axis], a.c[axis])) + std::max(a.a[axis], std::max(a.b[axis], a.c[axis])) <
+				std::min(b.a[axis], std::min(b.b[axis], b.c[axis])) + std::max(b.a[axis], std::max(b.b[axis], b.c[axis]));
+		});
+
+	build(begin, middle);
+	uint32_t second = build(middle, end);
+	nodeData[nodeIndex].first = second;
+	nodeData[nodeIndex].count = 0;
+	return nodeIndex;
+}
+
+bool SceneryCollision::sweepSphere(const cyclone::Vector3 &start, const cyclone::Vector3 &end,
+	cyclone::real radius, cyclone::real *time) const
+{
+	if (!isLoaded()) return false;
+
+	cyclone::Vector3 delta = end - start;
+	cyclone::real best = 1;
+	bool found = false;
+
+	unsigned stack[maxDepth];
+	unsigned depth = 0;
+	stack[depth++] = 0;
+	while (depth > 0)
+	{
+		const SceneryNode &node = nodes[stack[--depth]];
+		if (!segmentTouchesNode(node, start, delta, radius, best)) continue;
+		if (node.count == 0)
+		{
+			if (depth + 2 > maxDepth) continue;
+			stack[depth++] = node.first;
+			stack[depth++] = (unsigned)(&node - nodes) + 1;
+			continue;
+		}
+
+		// The sphere's centre meets the face when it comes within radius of
+		// the plane, on whichever side it starts.
+		for (const SceneryTriangle *triangle = triangles + node.first; triangle < triangles + node.first + node.count; triangle++)
+		{
+			cyclone::Vector3 normal = toVector(triangle->normal), a = toVector(triangle->a);
+			cyclone::real startDistance = (start - a) * normal;
+			cyclone::real side = startDistance < 0 ? -1.0f : 1.0f;
+			startDistance = startDistance * side - radius;
+			cyclone::real endDistance = ((end - a) * normal) * side - radius;
+
+			cyclone::real t;
+			if (startDistance <= 0) t = 0;
+			else if (endDistance < 0) t = startDistance / (startDistance - endDistance);
+			else continue;
+			if (t > best) continue;
+
+			cyclone::Vector3 centre = start + delta * t;
+			if (!insideTriangle(*triangle, centre - normal * (((centre - a) * normal)))) continue;
+			best = t;
+			found = true;
+		}
+	}
+
+	if (found) *time = best;
+	return found;
+}
+
+unsigned SceneryCollision::collideBox(const cyclone::CollisionBox &box, cyclone::real maxVertical,
+	cyclone::CollisionData *data) const
+{
+	if (!isLoaded() || data->contactsLeft <= 0) return 0;
+
+	// Find the box's corners and its world space bounds.
+	static const cyclone::real mults[8][3] = { {1,1,1},{-1,1,1},{1,-1,1},{-1,-1,1},
+		{1,1,-1},{-1,1,-1},{1,-1,-1},{-1,-1,-1} };
+	cyclone::Vector3 corners[8];
+	float min[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (unsigned i = 0; i < 8; i++)
+	{
+		cyclone::Vector3 local(mults[i][0] * box.halfSize.x, mults[i][1] * box.halfSize.y, mults[i][2] * box.halfSize.z);
+		corners[i] = box.getTransform().transform(local);
+		for (unsigned axis = 0; axis < 3; axis++)
+		{
+			min[axis] = std::min(min[axis], (float)corners[i][axis]);
+			max[axis] = std::max(max[axis], (float)corners[i][axis]);
+		}
+	}
+
+	unsigned added = 0;
+	unsigned stack[maxDepth];
+	unsigned depth = 0;
+	stack[depth++] = 0;
+	while (depth > 0 && data->contactsLeft > 0)
+	{
+		const SceneryNode &node = nodes[stack[--depth]];
+		if (!boundsOverlap(node, min, max)) continue;
+		if (node.count == 0)
+		{
+			if (depth + 2 > maxDepth) continue;
+			stack[depth++] = node.first;
+			stack[depth++] = (unsigned)(&node - nodes) + 1;
+			continue;
+		}
+
+		for (const SceneryTriangle *triangle = triangles + node.first; triangle < triangles + node.first + node.count; triangle++)
+		{
+			cyclone::Vector3 normal = toVector(triangle->normal), a = toVector(triangle->a);
+			if (real_abs(normal.y) > maxVertical) continue;
+
+			// A corner is only pushed back out of a face it hasn't gone
+			// further behind than the box is thick, so a box can't be
+			// dragged through a thin wall from the far side.
+			cyclone::real thickness = 0;
+			for (unsigned axis = 0; axis < 3; axis++)
+			{
+				thickness += real_abs(box.getAxis(axis) * normal) * box.halfSize[axis] * 2;
+			}
+
+			// Triangles are two-sided, so push the box back the way its centre is.
+			cyclone::real side = (box.getAxis(3) - a) * normal < 0 ? -1.0f : 1.0f;
+			normal *= side;
+			for (const cyclone::Vector3 *corner = corners; corner < corners + 8 && data->contactsLeft > 0; corner++)
+			{
+				cyclone::real distance = (*corner - a) * normal;
+				if (distance >= 0 || distance < -thickness) continue;
+				cyclone::Vector3 surface = *corner - normal * distance;
+				if (!insideTriangle(*triangle, surface)) continue;
+
+				cyclone::Contact *contact = data->contacts;
+				contact->contactPoint = surface;
+				contact->contactNormal = normal;
+				contact->penetration = -distance;
+				contact->setBodyData(box.body, NULL, data->friction, data->restitution);
+				data->addContacts(1);
+				added++;
+			}
+		}
+	}
+	return added;
+}
+
+bool SceneryCollision::writeCache(const char *cachePath, const char *objPath) const
+{
+	CollisionCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, collisionCacheMagic, sizeof(header.magic));
+	header.version = collisionCacheVersion;
+
+	FileStamp stamp;
+	if (!getFileStamp(objPath, &stamp)) return false;
+	header.objModified = stamp.modified;
+	header.objSize = stamp.size;
+	header.sourceHash = hashFile(objPath);
+	header.triangleCount = triangleCount;
+	header.nodeCount = nodeCount;
+
+	FILE *file = fopen(cachePath, "wb");
+	if (!file) return false;
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	ok = ok && fwrite(triangles, sizeof(SceneryTriangle), triangleCount, file) == triangleCount;
+	ok = ok && fwrite(nodes, sizeof(SceneryNode), nodeCount, file) == nodeCount;
+	ok = (fclose(file) == 0) && ok;
+
+	if (!ok) remove(cachePath);
+	return ok;
+}
+
+bool SceneryCollision::mapCache(const char *cachePath, const char *objPath)
+{
+	release();
+	if (!cache.open(cachePath)) return false;
+
+	const CollisionCacheHeader *header = (const CollisionCacheHeader*)cache.data();
+	if (cache.size() < sizeof(CollisionCacheHeader) ||
+		memcmp(header->magic, collisionCacheMagic, sizeof(header->magic)) != 0 ||
+		header->version != collisionCacheVersion ||
+		header->nodeCount == 0 ||
+		sizeof(CollisionCacheHeader) + sizeof(SceneryTriangle) * (uint64_t)header->triangleCount +
+			sizeof(SceneryNode) * (uint64_t)header->nodeCount != cache.size())
+	{
+		cache.close();
+		return false;
+	}
+
+	// Unchanged timestamps mean the cache is current. Otherwise the model
+	// may only have been touched, so fall back to comparing its contents.
+	FileStamp stamp;
+	if (!getFileStamp(objPath, &stamp) ||
+		((stamp.modified != header->objModified || stamp.size != header->objSize) &&
+		hashFile(objPath) != header->sourceHash))
+	{
+		cache.close();
+		return false;
+	}
+
+	// A corrupt tree could send a sweep outside the arrays or round in
+	// circles, so every node is checked once here. A branch's children both
+	// come after it, the first straight after; a leaf's triangles must exist.
+	const SceneryNode *cachedNodes = (const SceneryNode*)(cache.data() + sizeof(CollisionCacheHeader) +
+		sizeof(SceneryTriangle) * (uint64_t)header->triangleCount);
+	for (uint32_t i = 0; i < header->nodeCount; i++)
+	{
+		const SceneryNode &node = cachedNodes[i];
+		bool valid = node.count == 0 ?
+			i + 1 < header->nodeCount && node.first > i + 1 && node.first < header->nodeCount :
+			(uint64_t)node.first + node.count <= header->triangleCount;
+		if (!valid)
+		{
+			cache.close();
+			return false;
+		}
+	}
+
+	triangles = (const SceneryTriangle*)(cache.data() + sizeof(CollisionCacheHeader));
+	triangleCount = header->triangleCount;
+	nodes = (const SceneryNode*)(triangles + triangleCount);
+	nodeCount = header->nodeCount;
+	return true;
+}
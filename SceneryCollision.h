@@ -0,0 +1,113 @@
+/*
+ * Collision against the static triangles of the gallery's scenery.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef SCENERY_COLLISION_H
+#define SCENERY_COLLISION_H
+
+#include <cyclone.h>
+#include <stdint.h>
+#include <vector>
+#include "MappedFile.h"
+
+class Mesh;
+
+/** A triangle of the scenery, with its unit face normal. */
+struct SceneryTriangle
+{
+	float a[3], b[3], c[3];
+	float normal[3];
+};
+
+/**
+ * A node of the scenery's tree: a leaf of count triangles starting at
+ * first, or, with a count of zero, a branch whose first child follows it
+ * and whose second child is at first.
+ */
+struct SceneryNode
+{
+	float min[3], max[3];
+	uint32_t first, count;
+};
+
+/**
+ * The triangles of a static model in a bounding volume hierarchy, for
+ * rounds and falling targets to collide with.
+ *
+ * The tree is built once from the model and written to a binary cache
+ * next to it (<model>.obj.collisioncache), with the triangles stored in
+ * leaf order. Later loads map the cache straight into memory, provided
+ * the OBJ file hasn't changed since. Nothing changes after loading, so
+ * any number of threads can query at once.
+ */
+class SceneryCollision
+{
+public:
+	SceneryCollision();
+
+	/** Loads the model's tree from its cache, building the cache if it is missing or stale. */
+	bool load(const char *objPath);
+
+	/** Builds the tree from a loaded mesh's triangles, without touching any cache. */
+	void build(const Mesh &mesh);
+
+	/** Frees the tree. */
+	void release();
+
+	/** Returns true once a tree has been loaded or built. */
+	bool isLoaded() const { return nodeCount > 0; }
+
+	/**
+	 * Sweeps a sphere from start to end and returns true if it touches a
+	 * triangle's face on the way, setting time to the fraction of the way
+	 * it got first. Triangles are two-sided. Edges are not rounded, which
+	 * only matters for spheres much larger than the rounds.
+	 */
+	bool sweepSphere(const cyclone::Vector3 &start, const cyclone::Vector3 &end,
+		cyclone::real radius, cyclone::real *time) const;
+
+	/**
+	 * Adds a contact for each of the box's corners that has passed
+	 * through a triangle, as boxAndHalfSpace does for a plane, and
+	 * returns how many were added. Triangles whose normal points up or
+	 * down by more than maxVertical are left out. The contacts stop when
+	 * data has no room left.
+	 */
+	unsigned collideBox(const cyclone::CollisionBox &box, cyclone::real maxVertical,
+		cyclone::CollisionData *data) const;
+
+	const SceneryTriangle *triangles;
+	uint32_t triangleCount;
+	const SceneryNode *nodes;
+	uint32_t nodeCount;
+
+private:
+	/** Storage for a tree built from a mesh; empty when the cache is mapped. */
+	std::vector<SceneryTriangle> triangleData;
+	std::vector<SceneryNode> nodeData;
+
+	/** The mapped cache file, when loaded from the cache. */
+	MappedFile cache;
+
+	/** Builds the subtree over part of the triangle storage, returning its node. */
+	uint32_t build(uint32_t begin, uint32_t end);
+
+	/** Writes the built tree to a cache file. */
+	bool writeCache(const char *cachePath, const char *objPath) const;
+
+	/** Maps a cache file, returning false if it is missing, corrupt or out of date. */
+	bool mapCache(const char *cachePath, const char *objPath);
+
+	SceneryCollision(const SceneryCollision&);
+	SceneryCollision& operator=(const SceneryCollision&);
+};
+
+#endif // SCENERY_COLLISION_H
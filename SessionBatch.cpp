@@ -0,0 +1,68 @@
+/*
+ * Implementation of the session batch.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include "SessionBatch.h"
+
+#include <chrono>
+
+SessionBatch::SessionBatch(const Scenario &scenario, unsigned sessionCount, unsigned threadCount)
+: profiling(true), timestep(scenario.timestep), pool(threadCount)
+{
+	// The galleries are made one at a time, so the first to need a cache
+	// writes it and the rest read it.
+	sessions.reserve(sessionCount);
+	Scenario seeded = scenario;
+	for (unsigned i = 0; i < sessionCount; i++)
+	{
+		seeded.seed = scenario.seed + i;
+		sessions.push_back(new ShootingGallery(seeded, 1));
+		sessions.back()->setFixedTimestep(timestep);
+	}
+}
+
+SessionBatch::~SessionBatch()
+{
+	for (ShootingGallery **session = sessions.data(); session < sessions.data() + sessions.size(); session++)
+	{
+		delete *session;
+	}
+}
+
+SessionBatchTimings SessionBatch::run(unsigned steps, const SessionInput &input)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	Clock::time_point start = Clock::now();
+
+	// Sessions are taken one at a time, so the threads stay evenly loaded
+	// even when some sessions are busier than others.
+	pool.parallelFor((unsigned)sessions.size(), 1, [this, steps, &input](unsigned begin, unsigned end, unsigned worker)
+	{
+		// The switch is per thread, and the calling thread takes sessions too, so it is put back after.
+		bool wasProfiling = Profiler::setThreadEnabled(profiling);
+		for (unsigned session = begin; session < end; session++)
+		{
+			ShootingGallery &gallery = *sessions[session];
+			for (unsigned step = 0; step < steps; step++)
+			{
+				if (input) input(session, step, gallery);
+				gallery.step(timestep);
+			}
+		}
+		Profiler::setThreadEnabled(wasProfiling);
+	});
+
+	SessionBatchTimings timings;
+	timings.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	timings.steps = (double)steps * sessions.size();
+	timings.stepsPerSecond = timings.seconds > 0 ? timings.steps / timings.seconds : 0;
+	return timings;
+}
@@ -0,0 +1,97 @@
+/*
+ * Many independent gallery sessions stepped side by side in one process.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef SESSION_BATCH_H
+#define SESSION_BATCH_H
+
+#include <functional>
+#include <vector>
+#include "ShootingGallery.h"
+#include "WorkerPool.h"
+
+/**
+ * Called before each step of a session with the session's index and the
+ * step about to run, to press keys as a player or bot would. Sessions run
+ * on several threads at once, so it must only touch the session it's given
+ * and state of its own for that session.
+ */
+typedef std::function<void(unsigned session, unsigned step, ShootingGallery &gallery)> SessionInput;
+
+/** How one batch run went, over every session. */
+struct SessionBatchTimings
+{
+	/** Wall time of the whole run, in seconds. */
+	double seconds;
+	/** Steps run over all sessions, and how many that is per wall second. */
+	double steps;
+	double stepsPerSecond;
+};
+
+/**
+ * Runs many galleries of one scenario, for automated play-testing and bot
+ * training, without a window.
+ *
+ * Every session is a ShootingGallery of its own, with its own bodies,
+ * rounds, clock and random generator; session i is seeded with the
+ * scenario's seed plus i, so spread weapons differ between sessions. The
+ * galleries share no simulation state, so they are sharded across a pool
+ * of threads, one per core, and each steps on whichever thread takes it.
+ * A gallery does its own collision work on one thread, since the sessions
+ * already keep every core busy.
+ *
+ * Two things are still shared by the whole process. Every session's scopes
+ * go into the one Profiler, mixed together on each thread, unless
+ * setProfiling turns that off for the batch. And setIntegrationPath
+ * changes the kernels every session integrates rounds with.
+ */
+class SessionBatch
+{
+public:
+	/** Creates the given number of sessions of a scenario, sharded across the given number of threads, or one per core if zero. */
+	SessionBatch(const Scenario &scenario, unsigned sessionCount, unsigned threadCount = 0);
+	~SessionBatch();
+
+	/**
+	 * Steps every session the given number of times at its scenario's
+	 * timestep, calling input before each step. Each session runs all its
+	 * steps on one thread before the thread takes another session.
+	 */
+	SessionBatchTimings run(unsigned steps, const SessionInput &input);
+
+	/** Returns the number of sessions. */
+	unsigned getSessionCount() const { return (unsigned)sessions.size(); }
+
+	/** Returns the gallery of the given session. */
+	ShootingGallery& getSession(unsigned index) { return *sessions[index]; }
+
+	/** Returns how many threads the sessions are sharded across. */
+	unsigned getThreadCount() const { return pool.getWorkerCount(); }
+
+	/** Sets whether the sessions record their scopes in the profiler while they run. On by default. */
+	void setProfiling(bool enabled) { profiling = enabled; }
+
+private:
+	std::vector<ShootingGallery*> sessions;
+
+	/** Whether the threads record scopes while running sessions. */
+	bool profiling;
+
+	/** The timestep every session steps at. */
+	cyclone::real timestep;
+
+	WorkerPool pool;
+
+	SessionBatch(const SessionBatch&);
+	SessionBatch& operator=(const SessionBatch&);
+};
+
+#endif // SESSION_BATCH_H
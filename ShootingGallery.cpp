@@ -10,357 +10,101 @@
  * software licence.
  */
 
-#include <gl/glew.h>	// Used by lighting system and drawing text on the window?
-#include <gl/glut.h>
-#include <cyclone.h>
-#include "app.h"
-#include "timing.h"
-#include "utility.h"	// Used to compute rotation matrices and print out numbers.
+#include "ShootingGallery.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <string.h>
 
-#include <stdio.h>
-#include <sstream>		// Used to print variables to strings.
-#include "ObjModel.h"
-#include "PPMImage.h"
-
-
-enum ShotType
+/** The scopes the profiler overlay shows, in the order it shows them. */
+static const char *const profiledScopes[] =
 {
-    UNUSED = 0,
-    PISTOL
-};
-
-/** The AmmoRound class stores the information for instantiating
-and updating bullets, physics is applied when bullets are fired from the gun. */
-class AmmoRound : public cyclone::CollisionSphere
-{
-public:
-    ShotType type;
-    unsigned startTime;
-	cyclone::Vector3 velocityVecLocal = {0.0f, 0.0f, 20.0f}, velocityVecWorld;
-
-    AmmoRound()
-    {
-        body = new cyclone::RigidBody;
-    }
-
-    ~AmmoRound()
-    {
-        delete body;
-    }
-
-    /** Draws the shot, excluding its shadow. */
-    void render(cyclone::Vector3 gunEulerAngle, cyclone::Vector3 ammoCamOffset)
-    {
-        // Get the OpenGL transformationcyclone::Vector3 gunEuler, cyclone::Vector3 ammoOffsetWorld
-		glDisable(GL_TEXTURE_2D);
-		glColor3f(0.8f, 0.3f, 0.0f);
-        GLfloat mat[16];
-        body->getGLTransform(mat);
-        glPushMatrix();
-        glMultMatrixf(mat);
-        glutSolidSphere(radius, 20, 20);
-        glPopMatrix();
-    }
-
-    /** Sets the shot to a specific location. */
-    void setState(ShotType shotType, cyclone::Vector3 position, cyclone::Vector3 angle)
-    {		
-		type = shotType;
-
-        // Set the properties of the shot
-        switch(type)
-        {
-        case PISTOL:
-            body->setMass(1.50f);
-			body->setPosition(position.x, position.y, position.z);
-			body->setOrientation(1, 0, 0, 0);
-			velocityVecWorld = computeRotatedVector(velocityVecLocal, angle);  // Derive the world velocity of the bullet from the angle of the gun
-            body->setVelocity(velocityVecWorld.x, velocityVecWorld.y, velocityVecWorld.z);  
-            body->setAcceleration(0.0f, -.50f, 0.0f);
-            body->setDamping(0.99f, 0.8f);
-            radius = 0.03f;
-            break;
-        }
-
-        body->setCanSleep(false);
-        body->setAwake();
-
-        cyclone::Matrix3 tensor;
-        cyclone::real coeff = 0.4f*body->getMass()*radius*radius;
-        tensor.setInertiaTensorCoeffs(coeff,coeff,coeff);
-        body->setInertiaTensor(tensor);
-
-        // Set the data common to all particle types
-        startTime = TimingData::get().lastFrameTimestamp;
-
-        // Clear the force accumulators
-        body->calculateDerivedData();
-        calculateInternals();
-    }
+	"display", "drawScene", "buildHud", "step", "updateObjects", "generateContacts", "resolveContacts"
 };
 
-/** The Bullseye class stores the information for instantiating
-and updating targets, physics is applied when collisions with bullets are detected. */
-class Bullseye : public cyclone::CollisionBox
-{
-public:
-	// Holds the OBJ model in memory.
-	ObjModel bullseye;
-	// ID for calling a list.
-	GLuint bullseyeID;
-	// Holds the hit status of a bullseye.
-	bool hit = false;    
-	
-	Bullseye()
-    {
-        body = new cyclone::RigidBody;
-    }
-
-    ~Bullseye()
-    {
-        delete body;
-    }
-
-	/** Read the bullseye model into memory and create a display list*/
-	void loadBullseyeModel()
-	{
-		bullseye.ReadFile("Models/target.obj");
-		bullseyeID = glGenLists(1);
-		glNewList(bullseyeID, GL_COMPILE);
-		bullseye.Draw();
-		glEndList();		
-	}
-
-	/** Draws the bullseye, excluding its shadow. */
-    void render()
-    {     
-		// Get the OpenGL transformation
-        GLfloat mat[16];
-        body->getGLTransform(mat);
-
-        glPushMatrix();
-        glMultMatrixf(mat);
-		// The model doesn't really need scaling but the rigid-body must be sized according to the model dimensions!
-		glScalef(halfSize.x /1.2, halfSize.y /3.0, halfSize.z / 1.0); 		
-		glCallList(bullseyeID);		
-		glPopMatrix();
-    }
-
-    /** Sets the bullseye to a specific location. */
-    void setState(cyclone::real x, cyclone::real z)
-    {
-        body->setPosition(x, 2.9, z);
-		body->setOrientation(0,0,1,0);
-		body->setVelocity(5, 0, 0);
-        body->setRotation(cyclone::Vector3(0,0,0));
-        halfSize = cyclone::Vector3(1.2,3,1); // Half-dimensions of the target model.
-
-        cyclone::real mass = halfSize.x * halfSize.y * halfSize.z * .10f;
-        body->setMass(mass);
-
-        cyclone::Matrix3 tensor;
-        tensor.setBlockInertiaTensor(halfSize, mass);
-        body->setInertiaTensor(tensor);
+/** Room for a falling bullseye's contacts with the scenery: a few walls' worth of corners. */
+static const unsigned sceneryContactRoom = 32;
 
-        body->setLinearDamping(0.95f);
-        body->setAngularDamping(0.8f);
-        body->clearAccumulators();
-        body->setAcceleration(0,0,0);
+/** Scenery faces whose normal's height is above this are floors or ceilings, not walls. */
+static const cyclone::real maxWallVertical = 0.7f;
 
-        body->setCanSleep(false);
-        body->setAwake();
-
-        body->calculateDerivedData();
-        calculateInternals();
-    }
-};
+/** Returns the built-in gallery resized to the given number of targets and rounds. */
+static Scenario standardScenario(unsigned targetCount, unsigned roundCount)
+{
+	Scenario scenario;
+	scenario.setStandard(targetCount, roundCount);
+	return scenario;
+}
 
-/** The Gun class stores the information for instantiating 
-and updating a Gun model, physics is not applied. */
-class Gun : public cyclone::CollisionBox
+// Method definitions
+ShootingGallery::ShootingGallery(unsigned targetCount, unsigned roundCount)
+: ShootingGallery(standardScenario(targetCount, roundCount))
 {
-public:
-	Gun()
-	{
-		body = new cyclone::RigidBody;
-	}
+}
 
-	~Gun()
-	{
-		delete body;
-	}
+ShootingGallery::ShootingGallery(const Scenario &scenario, unsigned workerCount):RigidBodyApplication(),
+scenario(scenario), ammoRounds(scenario.rounds), ammoCount(scenario.rounds), projectiles(scenario.rounds),
+bullseyes(scenario.getTargetCount()), currentShotType(PISTOL), workers(workerCount), simulationRunning(false)
+{
+	fixedTimestep = scenario.timestep;
+	randomSeed = scenario.seed;
 
-	ObjModel gun;
-	GLuint gunID;
+	// No window is that size, so the first frame always lays out the HUD.
+	memset(&hudShown, 0, sizeof(hudShown));
+	hudShown.width = -1;
 
-	/** Reads the OBJ model file into memory and creates a display list.*/
-	void loadGunModel()
+	// The bodies are taken from the pool in one go, so they sit together.
+	bullseyeData = new Bullseye[bullseyes];
+	for (Bullseye *bullseye = bullseyeData; bullseye < bullseyeData + bullseyes; bullseye++)
 	{
-		gun.ReadFile("Models/revolver.obj");
-		gunID = glGenLists(1);
-		glNewList(gunID, GL_COMPILE);
-		gun.Draw();
-		glEndList();
+		bullseye->body = bodies.acquire();
 	}
-
-	/** Draws the model without a shadow. */
-	void render(cyclone::Vector3 gunEulerAngle, cyclone::Vector3 gunCamOffset)
+	for (Gun *gun = revolver; gun < revolver + guns; gun++)
 	{
-		// Get the OpenGL transformation
-		GLfloat mat[16];
-		body->getGLTransform(mat);
-
-		glPushMatrix();
-		glMultMatrixf(mat);
-		glTranslatef(0, gunCamOffset.y, 0);
-		glRotatef(gunEulerAngle.y, 0, 1, 0);
-		glRotatef(gunEulerAngle.x, 1, 0, 0);	
-		glTranslatef(gunCamOffset.x, 0, gunCamOffset.z);
-		glScalef(1.0f, 1.0f, 1.0f);
-		glCallList(gunID);
-		glPopMatrix();
+		gun->body = bodies.acquire();
 	}
+	workerContacts = new WorkerContacts[workers.getWorkerCount()];
+	islands = NULL;
+	islandCount = 0;
+	islandHits = NULL;
+	stepContacts = NULL;
 
-	/*Sets the location of the gun*/
-	void setState(cyclone::Vector3 position)
-	{
-		body->setPosition(position.x, position.y, position.z);
-		body->setOrientation(1, 0, 0, 0);
-		body->setVelocity(0, 0, 0);
-		body->setRotation(cyclone::Vector3(0, 0, 0));
-		halfSize = cyclone::Vector3(1, 1, 1);
-
-		cyclone::real mass = halfSize.x * halfSize.y * halfSize.z * 10.0f;
-		body->setMass(mass);
-
-		cyclone::Matrix3 tensor;
-		tensor.setBlockInertiaTensor(halfSize, mass);
-		body->setInertiaTensor(tensor);
-
-		body->setLinearDamping(0.95f);
-		body->setAngularDamping(0.8f);
-		body->clearAccumulators();
-		body->setAcceleration(0, 0, 0);
-
-		body->setCanSleep(false);
-		body->setAwake();
+	groundPlane.direction = cyclone::Vector3(0,1,0);
+	groundPlane.offset = scenario.groundHeight; // Collision plane lowered so the targets have a chance to fall down before removing
 
-		body->calculateDerivedData();
-		calculateInternals();
+	if (!scenario.scenery.empty() && !scenery.load(scenario.scenery.c_str()))
+	{
+		fprintf(stderr, "Could not load scenery %s, so the range is open\n", scenario.scenery.c_str());
 	}
-};
-
-/** The main demo class definition. */
-class ShootingGallery : public RigidBodyApplication
-{
-	/** Holds the maximum number of  rounds that can be fired. */
-    const static unsigned ammoRounds = 6;
-
-	/** Mutable count of ammunition remaining in the weapon.*/
-	int ammoCount = ammoRounds;
 
-    /** Holds the particle data. */
-    AmmoRound ammo[ammoRounds];
-	
-	/** Holds the number of guns in the simulation. */
-	const static unsigned guns = 1;
-
-	/** Holds the gun data. */
-	Gun revolver[guns];
-
-    /** Holds the number of bullseye targets in the simulation. */
-    const static unsigned bullseyes = 10;
-
-    /** Holds the bullseye data. */
-    Bullseye bullseyeData[bullseyes];
-
-    /** Holds the current shot type. */
-    ShotType currentShotType;
-
-    /** Resets the position of all the boxes and primes the explosion. */
-    virtual void reset();
-
-    /** Build the contacts for the current situation. */
-    virtual void generateContacts();
-
-    /** Processes the objects in the simulation forward in time. */
-    virtual void updateObjects(cyclone::real duration);
-
-    /** Dispatches a round. */
-    void fire();
-
-	/** Records the number of targets hit. */
-	int score = 0;
-	int targetsRemaining = bullseyes;
-
-	/** Store the OBJ file for the static scenery. */
-	ObjModel gallery;
-	int galleryID;
-	
-	/** Read in and create a call list for the static scenery. */
-	void loadScene();
-
-	/** Draw the static scenery. */
-	void drawScene();
-
-	/** Hold offset vectors of Camera, Ammo from the gun in Local and Worldspace. */
-	cyclone::Vector3
-		cameraOffsetLocal = { 0.0f, 4.5f, -3.0f },		// offset from world point {0,0,0}
-		cameraOffsetWorld = { cameraOffsetLocal.x, cameraOffsetLocal.y, cameraOffsetLocal.z },
-		aimOffsetLocal = { 0.0f, 4.5f, 50.0f },			// offset from world point {0,0,0}
-		aimOffsetWorld = { aimOffsetLocal.x, aimOffsetLocal.y, aimOffsetLocal.z },
-		gunOffsetLocal = { -0.33f, 4.25f, -1.5f },		// offset from world point {0,0,0}
-		gunOffsetWorld = { gunOffsetLocal.x, gunOffsetLocal.y, gunOffsetLocal.z },
-		ammoOffsetLocal = { 0.33f, 0.25f, -2.0f },		// offset from world camera point
-		ammoOffsetWorld = { ammoOffsetLocal.x, ammoOffsetLocal.y, ammoOffsetLocal.z },
-		gunEuler = { 0.0f, 0.0f, 0.0f };
-	
-public:
-    /** Creates a new demo object. */
-    ShootingGallery();
-
-    /** Returns the window title for the demo. */
-    virtual const char* getTitle();
-
-    /** Sets up the rendering. */
-    virtual void initGraphics();
-    
-    /** Display world. */
-    virtual void display();
-
-    /** Handle a keypress. */
-    virtual void key(unsigned char key);
-
-	/** Handle a special keypress (Arrow keys for this app). */
-	virtual void specialKey(int specialKey);
-};
-
-// Method definitions
-ShootingGallery::ShootingGallery():RigidBodyApplication(),
-currentShotType(PISTOL)
-{
     pauseSimulation = false;
     reset();
+	publishSnapshot(std::chrono::steady_clock::now());
+}
+
+ShootingGallery::~ShootingGallery()
+{
+	stopSimulationThread();
+	delete[] workerContacts;
+	delete[] bullseyeData;
+	AssetRegistry::get().releaseMesh(gallery);
+	AssetRegistry::get().releaseMesh(roundMesh);
 }
 
 void ShootingGallery::loadScene()
 {
 	glEnable(GL_COLOR_MATERIAL);
 	glDisable(GL_LIGHTING);
-	gallery.ReadFile("Models/gallery.obj");
-	galleryID = glGenLists(1);
-	glNewList(galleryID, GL_COMPILE);	
-	gallery.Draw();
-	glEndList();
+	gallery = AssetRegistry::get().acquireMesh("Models/gallery.obj");
 	glDisable(GL_COLOR_MATERIAL);
 	glEnable(GL_LIGHTING);
 }
 
 void ShootingGallery::drawScene()
 {
+	ProfileScope scope("drawScene");
 	glPushMatrix();
 	glTranslatef(0, 0, 0);
-	glCallList(galleryID);
+	renderer.draw(gallery);
 	glPopMatrix();
 }
 
@@ -389,8 +133,33 @@ void ShootingGallery::initGraphics()
 	glEnable(GL_LIGHTING);
 	glEnable(GL_LIGHT0);
 
+	glewInit();
+	renderer.init();
+	Profiler::setThreadName("display");
+
+	// Rasterize the HUD's fonts into one atlas up front.
+	hudFace = hud.addFace("Models/Fonts/CONEI___.TTF", 15);
+	hudLargeFace = hud.addFace("Models/Fonts/CONEI___.TTF", 28);
+	hudBannerFace = hud.addFace("Models/Fonts/CoffeeTin Initials.ttf", 44);
+	hud.init();
+
+	AssetRegistry::get().setProgressCallback([](const AssetLoadProgress &progress)
+	{
+		printf("Loaded %s (%u of %u) in %.1f ms\n", progress.path, progress.loaded, progress.requested, progress.milliseconds);
+	});
+
+	// Parse every model at once on the loader threads, so the scenery, guns
+	// and bullseyes below only look up models that are already registered.
+	static const char *const models[] = { "Models/gallery.obj", "Models/revolver.obj", "Models/target.obj" };
+	const unsigned modelCount = sizeof(models) / sizeof(models[0]);
+	MeshHandle preloaded[modelCount];
+	AssetRegistry::get().loadMeshes(models, modelCount, preloaded);
+
 	ShootingGallery::loadScene();
 
+	const float roundColour[3] = { 0.8f, 0.3f, 0.0f };
+	roundMesh = AssetRegistry::get().acquireSphereMesh(20, 20, roundColour);
+
 	for (Gun *gun = revolver; gun < revolver + guns; gun++)
 	{
 		gun->loadGunModel();
@@ -399,8 +168,16 @@ void ShootingGallery::initGraphics()
 	{
 		bullseye->loadBullseyeModel();
 	}
+	for (MeshHandle *handle = preloaded; handle < preloaded + modelCount; handle++)
+	{
+		AssetRegistry::get().releaseMesh(*handle);
+	}
+	AssetRegistry::get().printReport();
 
     Application::initGraphics();
+
+	// With a spare core the simulation can step while the frame is drawn.
+	if (std::thread::hardware_concurrency() > 1) startSimulationThread();
 }
 
 void ShootingGallery::reset()
@@ -413,32 +190,38 @@ void ShootingGallery::reset()
 	gunEuler = { 0, 0, 0 };
 	score = 0;	
 	targetsRemaining = bullseyes;
+	ammoCount = ammoRounds;
+	simulationTime = 0;
+	accumulator = 0;
+	random.seed(randomSeed);
 
 	// Make all shots unused
-    for (AmmoRound *shot = ammo; shot < ammo+ammoRounds; shot++)
-    {
-        shot->type = UNUSED;
-    }
-
-    // Initialise the bullseye
-    cyclone::real x = -40.0f, z = 9.5;
-	int perRow=0;
-    for (Bullseye *bullseye = bullseyeData; bullseye < bullseyeData+bullseyes; bullseye++)
-    {
-		if (perRow < 5)		// Spawn the first 5 targets in the front row.
-		{
-			bullseye->setState(x, z);
-			x += 10.0f;
-			perRow++;
-		}
-		else				// Spawn the rest of the targets in the back row.
+	projectiles.clear();
+	targetGrid.clear();
+	targetBvh.clear();
+	hitscanShots.clear();
+
+    // Initialise the bullseyes lane by lane, a row at a time.
+	Bullseye *bullseye = bullseyeData;
+	for (const TargetLane *lane = scenario.lanes.data(); lane < scenario.lanes.data() + scenario.lanes.size(); lane++)
+	{
+		for (unsigned row = 0; row < lane->rows; row++)
 		{
-			z = 19.5;
-			bullseye->setState(x, z);
-			x += 15.0f;
+			for (unsigned column = 0; column < lane->count; column++, bullseye++)
+			{
+				bullseye->setState(*lane, lane->startX + lane->spacing * column, lane->z + lane->rowSpacing * row);
+				bullseye->hit = FALSE;
+			}
 		}
-		bullseye->hit = FALSE;
-    }
+	}
+
+	// Every bullseye starts awake; updateActivity puts the idle ones to sleep.
+	activeBullseyes.resize(bullseyes);
+	for (unsigned i = 0; i < bullseyes; i++)
+	{
+		activeBullseyes[i] = i;
+		bullseyeData[i].activeSlot = i;
+	}
 
 	// Initialize the gun
 	for (Gun *gun = revolver; gun < revolver + guns; gun++)
@@ -454,210 +237,930 @@ const char* ShootingGallery::getTitle()
 
 void ShootingGallery::fire()
 {
-    // Find the first available round.
-    AmmoRound *shot;
-    for (shot = ammo; shot < ammo+ammoRounds; shot++)
-    {
-        if (shot->type == UNUSED) break;
-    }
+    // If every round is in flight, then exit - we can't fire.
+	bool hitscan = currentShotType == HITSCAN;
+	if (!hitscan && projectiles.getLiveCount() >= projectiles.getCapacity()) return;
+
+	// Each pellet leaves the barrel at a small random angle to it.
+	const ShotProperties &shot = scenario.getWeapon(currentShotType);
+	cyclone::Vector3 muzzle = cameraOffsetWorld - ammoOffsetWorld;
+	for (unsigned pellet = 0; pellet < shot.pellets; pellet++)
+	{
+		cyclone::Vector3 angle = gunEuler;
+		if (shot.spread > 0)
+		{
+			angle.x += random.randomBinomial(shot.spread);
+			angle.y += random.randomBinomial(shot.spread);
+		}
+		cyclone::Vector3 velocity = computeRotatedVector(cyclone::Vector3(0, 0, muzzleSpeed > 0 ? muzzleSpeed : shot.speed), angle);
+		if (hitscan)
+		{
+			HitscanShot ray = { muzzle, computeRotatedVector(cyclone::Vector3(0, 0, 1), angle), velocity };
+			hitscanShots.push_back(ray);
+			continue;
+		}
+		if (!projectiles.spawn(currentShotType, shot, muzzle, velocity, (unsigned)simulationTime)) break;
+	}
+	if (ammoCount > 0) ammoCount--;
+}
 
-    // If we didn't find a round, then exit - we can't fire.
-    if (shot >= ammo+ammoRounds) return;
+unsigned ShootingGallery::getLiveRounds() const
+{
+	return projectiles.getLiveCount();
+}
 
-    // Set the shot
-	shot->setState(currentShotType, cameraOffsetWorld - ammoOffsetWorld, gunEuler);
-	if (ammoCount > 0) ammoCount--;
+void ShootingGallery::update()
+{
+	// Texture levels arrive over the first few frames; report once they're all in.
+	if (texturesStreaming && AssetRegistry::get().updateStreaming() == 0)
+	{
+		texturesStreaming = false;
+		AssetRegistry::get().printReport();
+	}
+
+	if (simulationThread.joinable())
+	{
+		Application::update();
+		return;
+	}
+
+	// Measure the frame with the steady clock, which has finer resolution
+	// than the millisecond frame timings.
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	double frameDuration = clockStarted ? std::chrono::duration<double>(now - lastUpdate).count() : 0;
+	lastUpdate = now;
+	clockStarted = true;
+
+	// Exit immediately if we aren't running the simulation
+	if (pauseSimulation)
+	{
+		Application::update();
+		return;
+	}
+	else if (autoPauseSimulation)
+	{
+		// Advance exactly one step.
+		pauseSimulation = true;
+		autoPauseSimulation = false;
+		frameDuration = fixedTimestep;
+	}
+
+	advance(frameDuration);
+	publishSnapshot(now - std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(accumulator)));
+	Application::update();
 }
 
-void ShootingGallery::updateObjects(cyclone::real duration)
+void ShootingGallery::startSimulationThread()
 {
-    // Update the physics of each particle in turn
-    for (AmmoRound *shot = ammo; shot < ammo+ammoRounds; shot++)
-    {
-        if (shot->type != UNUSED)
-        {
-            // Run the physics
-            shot->body->integrate(duration);
-            shot->calculateInternals();
-
-            // Check if the particle is now invalid
-            if (shot->body->getPosition().y < 0.0f ||
-                shot->startTime+5000 < TimingData::get().lastFrameTimestamp ||
-                shot->body->getPosition().z > 200.0f)
-            {
-                // We simply set the shot type to be unused, so the
-                // memory it occupies can be reused by another shot.
-                shot->type = UNUSED;
-				if (ammoCount <= 0)	ammoCount = 6;
-            }
-        }
-    }
+	if (simulationThread.joinable()) return;
+	simulationRunning = true;
+	simulationThread = std::thread(&ShootingGallery::simulationLoop, this);
+}
+
+void ShootingGallery::stopSimulationThread()
+{
+	if (!simulationThread.joinable()) return;
+	simulationRunning = false;
+	simulationThread.join();
+}
+
+void ShootingGallery::simulationLoop()
+{
+	Profiler::setThreadName("simulation");
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point last = Clock::now();
+	while (simulationRunning)
+	{
+		bool changed = false;
+		InputEvent event;
+		while (inputQueue.pop(event))
+		{
+			applyInput(event);
+			changed = true;
+		}
+
+		Clock::time_point now = Clock::now();
+		double frameDuration = std::chrono::duration<double>(now - last).count();
+		last = now;
+		if (pauseSimulation)
+		{
+			frameDuration = 0;
+		}
+		else if (autoPauseSimulation)
+		{
+			pauseSimulation = true;
+			autoPauseSimulation = false;
+			frameDuration = fixedTimestep;
+		}
+
+		// The snapshot is stamped with when its step fell due, so the
+		// renderer can tell how far it is into the next one.
+		Clock::duration behind = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(accumulator));
+		if (advance(frameDuration) > 0 || changed)
+		{
+			behind = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(accumulator));
+			publishSnapshot(now - behind);
+		}
+
+		// Sleep until the next step is due.
+		std::this_thread::sleep_for(std::chrono::duration<double>(fixedTimestep - accumulator));
+	}
+}
+
+void ShootingGallery::publishSnapshot(std::chrono::steady_clock::time_point stepTime)
+{
+	WorldSnapshot &world = snapshots.beginWrite();
+	captureSnapshot(world);
+
+	if (spectating)
+	{
+		spectatorFrame.clear();
+		bool keyframe = spectatorEncoder.encode(world, &spectatorFrame);
+		spectatorFrames++;
+		spectatorBytes += spectatorFrame.size();
+		if (keyframe)
+		{
+			spectatorKeyframes++;
+			spectatorKeyframeBytes += spectatorFrame.size();
+		}
+
+		// Draw what the spectator rebuilt in place of the world itself.
+		if (spectator.receive(spectatorFrame.data(), spectatorFrame.size())) world = spectator.getWorld();
+		else spectatorEncoder.requestKeyframe();
+	}
+
+	world.stepTime = stepTime;
+	world.timestep = fixedTimestep;
+	snapshots.publish();
+}
+
+void ShootingGallery::captureSnapshot(WorldSnapshot &world) const
+{
+	world.rounds.resize(projectiles.getLiveCount());
+	for (unsigned i = 0; i < projectiles.getLiveCount(); i++)
+	{
+		RoundSnapshot &round = world.rounds[i];
+		round.previous[0] = (float)projectiles.previousX[i];
+		round.previous[1] = (float)projectiles.previousY[i];
+		round.previous[2] = (float)projectiles.previousZ[i];
+		round.current[0] = (float)projectiles.positionX[i];
+		round.current[1] = (float)projectiles.positionY[i];
+		round.current[2] = (float)projectiles.positionZ[i];
+		round.radius = (float)projectiles.radius[i];
+	}
 
-    // Update the bullseyes
+	world.bullseyes.resize(bullseyes);
 	for (Bullseye *bullseye = bullseyeData; bullseye < bullseyeData + bullseyes; bullseye++)
 	{
-		// Run the physics
+		BullseyeSnapshot &state = world.bullseyes[bullseye - bullseyeData];
+		state.previousPosition = bullseye->previousPosition;
+		state.previousOrientation = bullseye->previousOrientation;
+		bullseye->body->getPosition(&state.position);
+		bullseye->body->getOrientation(&state.orientation);
+		state.halfSize = bullseye->halfSize;
+	}
+
+	world.gunTransforms.resize(guns * 16);
+	for (const Gun *gun = revolver; gun < revolver + guns; gun++)
+	{
+		gun->body->getGLTransform(&world.gunTransforms[(gun - revolver) * 16]);
+	}
+	world.cameraOffsetWorld = cameraOffsetWorld;
+	world.aimOffsetWorld = aimOffsetWorld;
+	world.gunOffsetWorld = gunOffsetWorld;
+	world.gunEuler = gunEuler;
+
+	world.score = score;
+	world.targetsRemaining = targetsRemaining;
+	world.ammoCount = ammoCount;
+	world.timestep = fixedTimestep;
+}
+
+unsigned ShootingGallery::advance(double frameDuration)
+{
+	accumulator += frameDuration;
+
+	// Drop what can't be caught up on this frame.
+	if (accumulator > maxStepsPerFrame * (double)fixedTimestep)
+	{
+		accumulator = maxStepsPerFrame * (double)fixedTimestep;
+	}
+
+	unsigned steps = 0;
+	bool wasReplaying = isReplaying();
+	while (accumulator >= fixedTimestep)
+	{
+		step(fixedTimestep);
+		accumulator -= fixedTimestep;
+		steps++;
+	}
+
+	// The demo says how a replay B started went, once, on the frame it ends.
+	if (wasReplaying && replayFinished())
+	{
+		printf("Replay of %u steps %s the recording\n", session.stepCount, replayMatched() ? "matched" : "diverged from");
+	}
+
+	return steps;
+}
+
+void ShootingGallery::step(cyclone::real duration, StepTimings *timings)
+{
+	ProfileScope scope("step");
+
+	// A replay applies each keypress before the step it was recorded before.
+	while (sessionMode == SESSION_REPLAYING && replayNext < session.events.size() &&
+		session.events[replayNext].step <= sessionStep)
+	{
+		const InputEvent &event = session.events[replayNext++].event;
+		if (event.special) handleSpecialKey(event.key);
+		else handleKey((unsigned char)event.key);
+	}
+
+	typedef std::chrono::high_resolution_clock Clock;
+	Clock::time_point start = Clock::now();
+
+	// Keep the state the display blends from. Bullseyes that aren't active
+	// stored theirs when they stopped, and haven't moved since.
+	for (const unsigned *index = activeBullseyes.data(); index < activeBullseyes.data() + activeBullseyes.size(); index++)
+	{
+		bullseyeData[*index].storePreviousState();
+	}
+
+	updateObjects(duration);
+	Clock::time_point updated = Clock::now();
+	generateContacts();
+	Clock::time_point collided = Clock::now();
+	resolveContacts(duration);
+	updateActivity(duration);
+
+	if (timings)
+	{
+		typedef std::chrono::duration<double, std::milli> Milliseconds;
+		timings->updateObjects = Milliseconds(updated - start).count();
+		timings->generateContacts = Milliseconds(collided - updated).count();
+		timings->resolveContacts = Milliseconds(Clock::now() - collided).count();
+		timings->integrate = integrateTime;
+	}
+
+	sessionStep++;
+	if (sessionMode == SESSION_REPLAYING && sessionStep >= session.stepCount)
+	{
+		endReplay();
+		replayEnded = true;
+		replayResult = hashState() == session.finalStateHash && score == session.finalScore;
+	}
+}
+
+void ShootingGallery::updateObjects(cyclone::real duration)
+{
+	ProfileScope scope("updateObjects");
+	typedef std::chrono::high_resolution_clock Clock;
+	Clock::time_point start = Clock::now();
+	simulationTime += duration * 1000.0;
+
+    // Run the physics for every round at once
+	projectiles.integrate(duration);
+
+	for (const unsigned *index = activeBullseyes.data(); index < activeBullseyes.data() + activeBullseyes.size(); index++)
+	{
+		Bullseye *bullseye = bullseyeData + *index;
 		bullseye->body->integrate(duration);
+		bullseye->forceApplied = false;
+	}
+	integrateTime = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	// Retire the rounds that are now invalid. Retiring moves the last round
+	// into the current slot, so the index only advances past kept rounds.
+	for (unsigned i = 0; i < projectiles.getLiveCount();)
+	{
+		if (projectiles.positionY[i] < scenario.retireBelow ||
+			projectiles.startTime[i] + scenario.getWeapon((ShotType)projectiles.type[i]).lifetime < simulationTime ||
+			projectiles.positionZ[i] > scenario.retireBeyond)
+		{
+			projectiles.retire(i);
+			if (ammoCount <= 0)	ammoCount = ammoRounds;
+		}
+		else i++;
+	}
+
+    // Update the active bullseyes
+	for (const unsigned *index = activeBullseyes.data(); index < activeBullseyes.data() + activeBullseyes.size(); index++)
+	{
+		Bullseye *bullseye = bullseyeData + *index;
 		bullseye->calculateInternals();
 
-		// Oscillate the bullseyes
-		if (bullseye->body->getPosition().x <= (- 15.0f))
-			bullseye->body->setVelocity(5.0f, 0.0f, 0.0f);
-		else if (bullseye->body->getPosition().x >= (15.0f))
-			bullseye->body->setVelocity(-5.0f, 0.0f, 0.0f);
+		// Oscillate the sweeping bullseyes between their lane's bounds.
+		if (bullseye->motion != MOTION_SWEEP) continue;
+		if (bullseye->body->getPosition().x <= bullseye->minX)
+			bullseye->body->setVelocity(real_abs(bullseye->speed), 0.0f, 0.0f);
+		else if (bullseye->body->getPosition().x >= bullseye->maxX)
+			bullseye->body->setVelocity(-real_abs(bullseye->speed), 0.0f, 0.0f);
     }
 }
 
 void ShootingGallery::display()
 {
+	ProfileScope scope("display");
+
+	// Draw the newest finished step, which the simulation won't touch while
+	// it's being drawn, blended towards the step before it.
+	const WorldSnapshot &world = snapshots.acquire();
+	cyclone::real interpolation = world.getInterpolation(std::chrono::steady_clock::now());
+
     // Clear the viewport and set the camera direction.
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+	// The camera was set at the end of the last frame, so the matrices now
+	// are the ones this frame is drawn with.
+	renderer.resetStats();
+	if (cullingEnabled || detailLevelsEnabled)
+	{
+		GLfloat projection[16], modelview[16];
+		glGetFloatv(GL_PROJECTION_MATRIX, projection);
+		glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+		viewFrustum.extract(projection, modelview);
+		detailView.set(projection, modelview, height);
+	}
+	renderer.setFrustum(cullingEnabled ? &viewFrustum : NULL);
+	renderer.setDetailView(detailLevelsEnabled ? &detailView : NULL);
+
 	// Draw the static environment.
 	ShootingGallery::drawScene();
 
-    // Render each bullet particle in turn.
-    for (AmmoRound *shot = ammo; shot < ammo+ammoRounds; shot++)
-    {
-        if (shot->type != UNUSED)
-        {
-            shot->render(gunEuler, ammoOffsetWorld - cameraOffsetLocal);
-        }
-    }
+    // Render every live bullet particle in a single instanced draw.
+	unsigned liveRounds = (unsigned)world.rounds.size();
+	instanceTransforms.resize(liveRounds * 16);
+	for (unsigned i = 0; i < liveRounds; i++)
+	{
+		world.getRoundTransform(i, interpolation, &instanceTransforms[i * 16]);
+	}
+	renderer.drawInstances(roundMesh, instanceTransforms.data(), liveRounds);
 
-    // Render gun and target models.
+    // Render gun and target models. The gun is held in front of the camera
+	// and placed by its own matrices, so it is never culled or simplified.
+	renderer.setFrustum(NULL);
+	renderer.setDetailView(NULL);
 	for (Gun *gun = revolver; gun < revolver+guns; gun++)
 	{
-		gun->render(gunEuler, gunOffsetWorld-cameraOffsetLocal);
+		gun->render(renderer, &world.gunTransforms[(gun - revolver) * 16], world.gunEuler, world.gunOffsetWorld-cameraOffsetLocal);
 	}
-
-    for (Bullseye *bullseye = bullseyeData; bullseye < bullseyeData+bullseyes; bullseye++)
-    {
-		bullseye->render();
-    }
-
-	glDisable(GL_LIGHTING);
-	glDisable(GL_TEXTURE_2D);
-	
-	// Display the game instructions.
-	glColor3f(0.0, 0.0, 0.0);	renderText(10.0f, height - 24.0, "Space: Fire \nWASD/Up/Down: Aim \nR: Reset \nEsc: Quit");
-	glColor3f(1.0, 1.0, 1.0);	renderText(9.0f, height - 23.0, "Space: Fire \nWASD/Up/Down: Aim \nR: Reset \nEsc: Quit");
-	
-	// Display the score.
-	glColor3f(0.0, 0.0, 0.0); renderText(width*0.45, height - 72.0, "Score: ");
-	glColor3f(1.0, 1.0, 1.0); renderText(width*0.4495, height - 71.0, "Score: ");
-	stringstream ss1, ss2, ss3;
-	ss1 << score;
-	printLargeString(ss1.str());
-
-	// Display the number of targets left.
-	glColor3f(0.0, 0.0, 0.0); renderText(width*0.45, height - 96.0, "Targets Remaining: ");
-	glColor3f(1.0, 1.0, 1.0); renderText(width*0.4495, height - 95.0, "Targets Remaining: ");
-	ss2 << targetsRemaining;
-	printLargeString(ss2.str());
-
-	// Display Ammo count
-	glColor3f(0.0, 0.0, 0.0); renderText(width*0.90, height - 24.0, "Ammo: ");
-	glColor3f(1.0, 1.0, 1.0); renderText(width*0.8995, height - 23.0, "Ammo: ");
-	ss3 << ammoCount;
-	printLargeString(ss3.str());
-
-	// Display a warning message if player aims outside acceptable target area.
-	if (gunEuler.x <= -30 || gunEuler.y <= -45 || gunEuler.y >= 45)
+	renderer.setFrustum(cullingEnabled ? &viewFrustum : NULL);
+	renderer.setDetailView(detailLevelsEnabled ? &detailView : NULL);
+
+	// The bullseyes all share one model, so they are drawn together too.
+	// Fallen ones have shrunk to nothing and are left out altogether.
+	unsigned standing = 0;
+	instanceTransforms.resize(bullseyes * 16);
+	for (unsigned i = 0; i < bullseyes; i++)
 	{
-		glColor3f(1.0, 1.0, 0.0); renderText(width * 0.425, height -150.0, "Please aim at the targets only!");
-		glColor3f(1.0, 0.0, 0.0); renderText(width * 0.4249, height - 149.0, "Please aim at the targets only!");
+		const cyclone::Vector3 &halfSize = world.bullseyes[i].halfSize;
+		if (halfSize.x == 0 && halfSize.y == 0 && halfSize.z == 0) continue;
+		world.getBullseyeTransform(i, interpolation, &instanceTransforms[standing++ * 16]);
 	}
-
-	// Display a Win message
-	if (score == 10)
+	if (standing > 0) renderer.drawInstances(bullseyeData->bullseye, instanceTransforms.data(), standing);
+	RenderStats drawn = renderer.getStats();
+
+	// The HUD is only laid out again when something on it changes, and
+	// is always drawn in a single call.
+	HudFields fields;
+	memset(&fields, 0, sizeof(fields));
+	fields.width = width;
+	fields.height = height;
+	fields.score = world.score;
+	fields.targetsRemaining = world.targetsRemaining;
+	fields.ammoCount = world.ammoCount;
+	fields.aimWarning = world.gunEuler.x <= -30 || world.gunEuler.y <= -45 || world.gunEuler.y >= 45;
+	fields.won = world.score == (int)bullseyes;
+	fields.culling = cullingEnabled;
+	fields.detailLevels = detailLevelsEnabled;
+	fields.drawCalls = (int)drawn.drawCalls;
+	fields.trianglesDrawn = (int)drawn.trianglesDrawn;
+	fields.trianglesTotal = (int)(drawn.trianglesDrawn + drawn.trianglesCulled + drawn.trianglesSimplified);
+
+	// The profiler's figures change every frame, so the overlay only takes
+	// them a few times a second, over the last two seconds.
+	static_assert(sizeof(profiledScopes) / sizeof(profiledScopes[0]) == profiledScopeCount, "One name per profiled scope");
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (profilerOverlay && now - profileRefreshed >= std::chrono::milliseconds(500))
 	{
-		glColor3f(0.0, 0.0, 0.0); renderText(width * 0.4755, height - 151.0, "You Win!");
-		glColor3f(1.0, 0.0, 0.0); renderText(width * 0.475, height - 150.0, "You Win!");
-		glColor3f(1.0, 0.5, 0.0); renderText(width * 0.4749, height - 149.0, "You Win!");
-		glColor3f(1.0, 1.0, 0.0); renderText(width * 0.4745, height - 148.0, "You Win!");
-		glColor3f(0.0, 1.0, 0.0); renderText(width * 0.474, height - 147.0, "You Win!");
-		glColor3f(0.0, 1.0, 1.0); renderText(width * 0.4735, height - 146.0, "You Win!");
-		glColor3f(0.0, 0.0, 1.0); renderText(width * 0.473, height - 145.0, "You Win!");
-		glColor3f(1.0, 0.0, 1.0); renderText(width * 0.4725, height - 144.0, "You Win!");
+		Profiler::get().summarize(profiledScopes, profiledScopeCount, 2.0, profileStats);
+		profileRefreshed = now;
+		profileRevision++;
 	}
+	fields.profiling = profilerOverlay;
+	fields.profileRevision = profileRevision;
+	if (memcmp(&fields, &hudShown, sizeof(fields)) != 0) buildHud(fields);
+	hud.draw(width, height);
 
 	// Configure the Game Camera to look where you are aiming.
 	glLoadIdentity();
 	gluLookAt(
 		cameraOffsetLocal.x,	// Does not change. 
-		cameraOffsetWorld.y,
+		world.cameraOffsetWorld.y,
 		cameraOffsetLocal.z,	// Does not change. 
-		aimOffsetWorld.x,
-		aimOffsetWorld.y,
-		aimOffsetWorld.z,
+		world.aimOffsetWorld.x,
+		world.aimOffsetWorld.y,
+		world.aimOffsetWorld.z,
 		0.0, 1.0, 0.0);	
 }
 
-void ShootingGallery::generateContacts()
+void ShootingGallery::buildHud(const HudFields &fields)
 {
-    // Create the ground plane data
-    cyclone::CollisionPlane plane;
-    plane.direction = cyclone::Vector3(0,1,0);
-    plane.offset = -2.0f; // Collision plane lowered so the targets have a chance to fall down before removing
+	ProfileScope scope("buildHud");
+	static const GLubyte black[4] = { 0, 0, 0, 255 }, white[4] = { 255, 255, 255, 255 };
+	static const GLubyte yellow[4] = { 255, 255, 0, 255 }, red[4] = { 255, 0, 0, 255 };
+	static const char *instructions = "Space: Fire \n1/2/3: Pistol/Shotgun/Hitscan \nWASD/Up/Down: Aim \nR: Reset \nC/L: Culling/Detail levels \nP/T: Profile/Trace \nV/B: Record/Replay \nEsc: Quit";
+	static const char *labels[3] = { "Score: ", "Targets Remaining: ", "Ammo: " };
+	const float labelX[3] = { fields.width * 0.45f, fields.width * 0.45f, fields.width * 0.90f };
+	const float labelY[3] = { fields.height - 72.0f, fields.height - 96.0f, fields.height - 24.0f };
+
+	// The instructions and labels only move with the window. Each piece of
+	// text has a black shadow one pixel down and to the right.
+	if (fields.width != hudStaticWidth || fields.height != hudStaticHeight)
+	{
+		hudStatic.clear();
+		hud.append(&hudStatic, hudFace, 10.0f, fields.height - 24.0f, instructions, black);
+		hud.append(&hudStatic, hudFace, 9.0f, fields.height - 23.0f, instructions, white);
+		for (unsigned i = 0; i < 3; i++)
+		{
+			hud.append(&hudStatic, hudFace, labelX[i], labelY[i], labels[i], black);
+			hud.append(&hudStatic, hudFace, labelX[i] - 1.0f, labelY[i] + 1.0f, labels[i], white);
+		}
+		hudStaticWidth = fields.width;
+		hudStaticHeight = fields.height;
+	}
+	hudBatch = hudStatic;
 
-    // Set up the collision data structure
-    cData.reset(maxContacts);
-    cData.friction = (cyclone::real)0.9;
-    cData.restitution = (cyclone::real)0.1;
-    cData.tolerance = (cyclone::real)0.01;
+	// The numbers follow on from their labels in the large face.
+	const int values[3] = { fields.score, fields.targetsRemaining, fields.ammoCount };
+	for (unsigned i = 0; i < 3; i++)
+	{
+		char number[16];
+		sprintf(number, "%d", values[i]);
+		float x = labelX[i] + hud.measure(hudFace, labels[i]);
+		hud.append(&hudBatch, hudLargeFace, x + 1.0f, labelY[i] - 1.0f, number, black);
+		hud.append(&hudBatch, hudLargeFace, x, labelY[i], number, white);
+	}
 
+	char cullingLine[128];
+	sprintf(cullingLine, "Culling %s, detail levels %s: %d draws, %d of %d triangles",
+		fields.culling ? "on" : "off", fields.detailLevels ? "on" : "off",
+		fields.drawCalls, fields.trianglesDrawn, fields.trianglesTotal);
+	hud.append(&hudBatch, hudFace, 10.0f, 10.0f, cullingLine, black);
+	hud.append(&hudBatch, hudFace, 9.0f, 11.0f, cullingLine, white);
 
-    // Check ground plane collisions
-    for (Bullseye *bullseye = bullseyeData; bullseye < bullseyeData+bullseyes; bullseye++)
-    {
-        if (!cData.hasMoreContacts()) return;
-		if (cyclone::CollisionDetector::boxAndHalfSpace(*bullseye, plane, &cData))
+	// The profiler overlay sits above the culling line, a row per scope.
+	if (fields.profiling)
+	{
+		static const char *headings[4] = { "ms over 2 s", "min", "avg", "p99" };
+		const float columns[4] = { 10.0f, 310.0f, 380.0f, 450.0f };
+		float y = 34.0f + 16.0f * profiledScopeCount;
+		for (unsigned row = 0; row <= profiledScopeCount; row++, y -= 16.0f)
 		{
-			// Shrink the bullseye to zero after it falls and increment the score count and decrement the target count.
-			bullseye->halfSize.z = 0;
-			bullseye->halfSize.y = 0;
-			bullseye->halfSize.x = 0;	
-			bullseye->body->setAwake(false);
+			char cells[4][32];
+			if (row == 0)
+			{
+				for (unsigned column = 0; column < 4; column++) strcpy(cells[column], headings[column]);
+			}
+			else
+			{
+				const ProfileStats &stats = profileStats[row - 1];
+				sprintf(cells[0], "%s (%u)", stats.name, stats.count);
+				sprintf(cells[1], "%.3f", stats.minimum);
+				sprintf(cells[2], "%.3f", stats.average);
+				sprintf(cells[3], "%.3f", stats.p99);
+			}
+
+			// The figures are right-aligned so their decimal points line up.
+			for (unsigned column = 0; column < 4; column++)
+			{
+				float x = column == 0 ? columns[0] : columns[column] - hud.measure(hudFace, cells[column]);
+				hud.append(&hudBatch, hudFace, x + 1.0f, y - 1.0f, cells[column], black);
+				hud.append(&hudBatch, hudFace, x, y, cells[column], row == 0 ? yellow : white);
+			}
+		}
+	}
 
+	// Display a warning message if player aims outside acceptable target area.
+	if (fields.aimWarning)
+	{
+		const char *warning = "Please aim at the targets only!";
+		float x = (fields.width - hud.measure(hudFace, warning)) * 0.5f;
+		hud.append(&hudBatch, hudFace, x + 1.0f, fields.height - 150.0f, warning, yellow);
+		hud.append(&hudBatch, hudFace, x, fields.height - 149.0f, warning, red);
+	}
+
+	// Display a Win message, stacked in rainbow layers.
+	if (fields.won)
+	{
+		static const GLubyte layers[8][4] = {
+			{ 0, 0, 0, 255 }, { 255, 0, 0, 255 }, { 255, 128, 0, 255 }, { 255, 255, 0, 255 },
+			{ 0, 255, 0, 255 }, { 0, 255, 255, 255 }, { 0, 0, 255, 255 }, { 255, 0, 255, 255 }
+		};
+		const char *banner = "You Win!";
+		float x = (fields.width - hud.measure(hudBannerFace, banner)) * 0.5f;
+		for (unsigned layer = 0; layer < 8; layer++)
+		{
+			hud.append(&hudBatch, hudBannerFace, x + 3.5f - layer, fields.height - 190.0f + layer, banner, layers[layer]);
+		}
+	}
+
+	hud.upload(hudBatch);
+	hudShown = fields;
+}
 
-			// Ensure the score only increments once for each bullseye
-			if (bullseye->hit == false) 
+void WorkerContacts::reset()
+{
+	hits.clear();
+	retired.clear();
+	contactCount = 0;
+	proxies.releaseAll();
+	candidatePairs = 0;
+	shotContacts = 0;
+	sceneryHits = 0;
+	targetsDown = 0;
+}
+
+void WorkerContacts::prepare(cyclone::CollisionData &data, unsigned room)
+{
+	if (contacts.size() < contactCount + room) contacts.resize((contactCount + room) * 2);
+	data.contactArray = contacts.data();
+	data.contacts = contacts.data() + contactCount;
+	data.contactsLeft = (int)(contacts.size() - contactCount);
+	data.contactCount = 0;
+	data.friction = (cyclone::real)0.9;
+	data.restitution = (cyclone::real)0.1;
+	data.tolerance = (cyclone::real)0.01;
+}
+
+GalleryAllocations ShootingGallery::getAllocations() const
+{
+	GalleryAllocations allocations = { bodies.getCounters(), { 0, 0, 0, 0, 0 }, stepArena.getCounters() };
+	for (const WorkerContacts *worker = workerContacts; worker < workerContacts + workers.getWorkerCount(); worker++)
+	{
+		const AllocationCounters &counters = worker->proxies.getCounters();
+		allocations.proxies.heapBlocks += counters.heapBlocks;
+		allocations.proxies.reservedBytes += counters.reservedBytes;
+		allocations.proxies.allocations += counters.allocations;
+		allocations.proxies.live += counters.live;
+		allocations.proxies.peakLive += counters.peakLive;
+	}
+	return allocations;
+}
+
+void ShootingGallery::setWorkerCount(unsigned count)
+{
+	workers.setWorkerCount(count);
+	delete[] workerContacts;
+	workerContacts = new WorkerContacts[workers.getWorkerCount()];
+}
+
+void ShootingGallery::generateContacts()
+{
+	ProfileScope scope("generateContacts");
+	stepArena.reset();
+	unsigned workerCount = workers.getWorkerCount();
+	for (WorkerContacts *worker = workerContacts; worker < workerContacts + workerCount; worker++)
+	{
+		worker->reset();
+	}
+
+	// Move the active bullseyes that have changed cells in the broad phase.
+	// Sleeping ones stay where they are, so rounds can still reach them.
+	for (const unsigned *index = activeBullseyes.data(); index < activeBullseyes.data() + activeBullseyes.size(); index++)
+	{
+		targetGrid.update(*index, bullseyeData[*index]);
+		targetBvh.update(*index, bullseyeData[*index]);
+	}
+
+	// Hitscan shots land before any round, so a bullseye they wake gets an island.
+	collisionCounters.rayQueries = (unsigned)hitscanShots.size();
+	collisionCounters.rayHits = 0;
+	if (!hitscanShots.empty()) traceHitscanShots();
+
+	// Sweep each shot over its last step against the bullseyes sharing the
+	// grid cells it crossed, so fast rounds can't pass through a target
+	// between steps. This only reads the world, so the rounds are shared
+	// between the workers.
+	workers.parallelFor(projectiles.getLiveCount(), 64, [this](unsigned begin, unsigned end, unsigned worker)
+	{
+		WorkerContacts &scratch = workerContacts[worker];
+		for (unsigned i = begin; i < end; i++)
+		{
+			cyclone::real r = projectiles.radius[i];
+			cyclone::real startX = projectiles.previousX[i], endX = projectiles.positionX[i];
+			cyclone::real startZ = projectiles.previousZ[i], endZ = projectiles.positionZ[i];
+			scratch.candidates.clear();
+			targetGrid.query((startX < endX ? startX : endX) - r, (startZ < endZ ? startZ : endZ) - r,
+				(startX > endX ? startX : endX) + r, (startZ > endZ ? startZ : endZ) + r, scratch.candidates);
+			scratch.candidatePairs += (unsigned)scratch.candidates.size();
+
+			// The round hits whichever bullseye it reaches first, unless it
+			// reaches the scenery before any of them.
+			cyclone::real sceneryTime = 2;
+			scenery.sweepSphere(cyclone::Vector3(startX, projectiles.previousY[i], startZ),
+				cyclone::Vector3(endX, projectiles.positionY[i], endZ), r, &sceneryTime);
+			RoundHit hit = { i, bullseyes, sceneryTime };
+			for (const unsigned *candidate = scratch.candidates.data(); candidate < scratch.candidates.data() + scratch.candidates.size(); candidate++)
+			{
+				cyclone::real time;
+				if (projectiles.sweepBox(i, bullseyeData[*candidate], &time) && time < hit.time)
+				{
+					hit.bullseye = *candidate;
+					hit.time = time;
+				}
+			}
+			if (hit.bullseye < bullseyes) scratch.hits.push_back(hit);
+			else if (sceneryTime <= 1)
 			{
-				score++;
-				targetsRemaining--;
-				bullseye->hit = true;
-			}			
+				scratch.retired.push_back(i);
+				scratch.sceneryHits++;
+			}
 		}
+	});
 
-        // Check for collisions with each shot
-        for (AmmoRound *shot = ammo; shot < ammo+ammoRounds; shot++)
-        {			
-            if (shot->type != UNUSED)
-            {
-                
-				if (!cData.hasMoreContacts()) return;
-
-                // When we get a collision, remove the shot and the bullseye
-                if (cyclone::CollisionDetector::boxAndSphere(*bullseye, *shot, &cData))
-                {
-                    shot->type = UNUSED;
-					if (ammoCount <= 0) ammoCount = 6;
+	// A round reaching a sleeping bullseye wakes it, so it gets an island.
+	wokenBullseyes.clear();
+	for (WorkerContacts *worker = workerContacts; worker < workerContacts + workerCount; worker++)
+	{
+		for (const RoundHit *hit = worker->hits.data(); hit < worker->hits.data() + worker->hits.size(); hit++)
+		{
+			if (bullseyeData[hit->bullseye].activity == BULLSEYE_ASLEEP) wokenBullseyes.push_back(hit->bullseye);
+		}
+	}
+	if (!wokenBullseyes.empty()) wakeBullseyes(wokenBullseyes);
+
+	// Group the hits by bullseye, one island for each active bullseye. Each
+	// island's hits go in round order, so the result doesn't depend on how
+	// the rounds were shared out.
+	islandCount = (unsigned)activeBullseyes.size();
+	islands = stepArena.allocateArray<ContactIsland>(islandCount);
+	unsigned hitCount = 0;
+	for (WorkerContacts *worker = workerContacts; worker < workerContacts + workerCount; worker++)
+	{
+		for (const RoundHit *hit = worker->hits.data(); hit < worker->hits.data() + worker->hits.size(); hit++)
+		{
+			islands[bullseyeData[hit->bullseye].activeSlot].hitCount++;
+		}
+		hitCount += (unsigned)worker->hits.size();
+	}
+	for (unsigned slot = 0, first = 0; slot < islandCount; slot++)
+	{
+		islands[slot].firstHit = first;
+		first += islands[slot].hitCount;
+		islands[slot].hitCount = 0;
+	}
+	islandHits = stepArena.allocateArray<RoundHit>(hitCount);
+	for (WorkerContacts *worker = workerContacts; worker < workerContacts + workerCount; worker++)
+	{
+		for (const RoundHit *hit = worker->hits.data(); hit < worker->hits.data() + worker->hits.size(); hit++)
+		{
+			ContactIsland &island = islands[bullseyeData[hit->bullseye].activeSlot];
+			islandHits[island.firstHit + island.hitCount++] = *hit;
+		}
+	}
+
+	// Generate each island's contacts. Only the island's own bullseye and
+	// proxies are changed, and each worker writes to its own buffer.
+	workers.parallelFor(islandCount, 16, [this](unsigned begin, unsigned end, unsigned worker)
+	{
+		WorkerContacts &scratch = workerContacts[worker];
+		for (unsigned slot = begin; slot < end; slot++)
+		{
+			Bullseye *bullseye = bullseyeData + activeBullseyes[slot];
+			ContactIsland &island = islands[slot];
+			island.worker = worker;
+			island.firstContact = scratch.contactCount;
+			cyclone::CollisionData data;
+
+			// Check ground plane collisions. A box touches the plane with at most its eight corners.
+			scratch.prepare(data, 8);
+			if (cyclone::CollisionDetector::boxAndHalfSpace(*bullseye, groundPlane, &data))
+			{
+				// Shrink the bullseye to zero after it falls and increment the score count and decrement the target count.
+				bullseye->halfSize.z = 0;
+				bullseye->halfSize.y = 0;
+				bullseye->halfSize.x = 0;	
+				bullseye->body->setAwake(false);
+
+				// Ensure the score only increments once for each bullseye
+				if (bullseye->hit == false) 
+				{
+					scratch.targetsDown++;
+					bullseye->hit = true;
+				}			
+			}
+			scratch.contactCount += data.contactCount;
+
+			// Falling bullseyes bounce off the scenery's walls. Floors are
+			// left to the ground plane: the lanes run in trenches that the
+			// bullseyes drop through out of sight, which is what scores them.
+			if (scenery.isLoaded() && !bullseye->hit && bullseye->body->getAcceleration().squareMagnitude() > 0)
+			{
+				scratch.prepare(data, sceneryContactRoom);
+				scenery.collideBox(*bullseye, maxWallVertical, &data);
+				scratch.contactCount += data.contactCount;
+			}
+
+			RoundHit *firstHit = islandHits + island.firstHit;
+			std::sort(firstHit, firstHit + island.hitCount,
+				[](const RoundHit &a, const RoundHit &b) { return a.round < b.round; });
+			for (RoundHit *hit = firstHit; hit < firstHit + island.hitCount; hit++)
+			{
+				// The resolver needs a rigid body for the round, so the contact is
+				// generated against a proxy, placed where the round met the bullseye,
+				// that lives until the contacts are resolved.
+				ProjectileProxy *shot = scratch.proxies.acquire();
+				shot->setState(projectiles, hit->round, hit->time);
+
+				// When we get a collision, remove the shot and the bullseye
+				scratch.prepare(data, 1);
+				if (cyclone::CollisionDetector::boxAndSphere(*bullseye, *shot, &data))
+				{
+					scratch.contactCount += data.contactCount;
+					scratch.shotContacts++;
+					scratch.retired.push_back(hit->round);
 					// Stop the target in its track when hit.
 					bullseye->body->setVelocity(0, 0, 0);
 					// Allow gravity to act on the target when hit.
-					bullseye->body->setAcceleration(0,-10.0f, 0);					 
-					// Add force of bullet impact on the target where it is hit.
-					bullseye->body->addForceAtBodyPoint(shot->body->getVelocity(), shot->body->getPosition());
-                }
-            }
-        }
-    }
+					bullseye->body->setAcceleration(0,-10.0f, 0);
+					// Add force of bullet impact on the target where it is hit. The
+					// round's position is in world space, as it is for hitscan shots.
+					bullseye->body->addForceAtPoint(shot->body->getVelocity(), shot->body->getPosition());
+					bullseye->forceApplied = true;
+				}
+				else scratch.proxies.release(shot);
+			}
+			island.contactCount = scratch.contactCount - island.firstContact;
+		}
+	});
+
+	// Merge the workers' buffers in island order. Every island's place is
+	// known up front, so the copies need no locks.
+	unsigned contactCount = 0;
+	for (ContactIsland *island = islands; island < islands + islandCount; island++)
+	{
+		contactCount += island->contactCount;
+	}
+	stepContacts = stepArena.allocateArray<cyclone::Contact>(contactCount);
+	for (unsigned slot = 0, first = 0; slot < islandCount; slot++)
+	{
+		ContactIsland &island = islands[slot];
+		const cyclone::Contact *source = workerContacts[island.worker].contacts.data() + island.firstContact;
+		std::copy(source, source + island.contactCount, stepContacts + first);
+		island.firstContact = first;
+		first += island.contactCount;
+	}
+
+	// Tally the counts, and retire the rounds that hit from the last down,
+	// since retiring moves the last round into the freed slot.
+	collisionCounters.candidatePairs = 0;
+	collisionCounters.shotContacts = 0;
+	collisionCounters.sceneryHits = 0;
+	retiredRounds.clear();
+	for (WorkerContacts *worker = workerContacts; worker < workerContacts + workerCount; worker++)
+	{
+		collisionCounters.candidatePairs += worker->candidatePairs;
+		collisionCounters.shotContacts += worker->shotContacts;
+		collisionCounters.sceneryHits += worker->sceneryHits;
+		score += worker->targetsDown;
+		targetsRemaining -= worker->targetsDown;
+		retiredRounds.insert(retiredRounds.end(), worker->retired.begin(), worker->retired.end());
+	}
+	std::sort(retiredRounds.begin(), retiredRounds.end());
+	for (unsigned *round = retiredRounds.data() + retiredRounds.size(); round > retiredRounds.data();)
+	{
+		projectiles.retire(*--round);
+		if (ammoCount <= 0) ammoCount = ammoRounds;
+	}
     // NB We aren't checking box-box collisions.
 }
 
+void ShootingGallery::resolveContacts(cyclone::real duration)
+{
+	ProfileScope scope("resolveContacts");
+	workers.parallelFor(islandCount, 16, [this, duration](unsigned begin, unsigned end, unsigned worker)
+	{
+		cyclone::ContactResolver &resolver = workerContacts[worker].resolver;
+		for (const ContactIsland *island = islands + begin; island < islands + end; island++)
+		{
+			if (island->contactCount == 0) continue;
+			resolver.setIterations(island->contactCount * 8);
+			resolver.resolveContacts(stepContacts + island->firstContact, island->contactCount, duration);
+		}
+	});
+}
+
+void ShootingGallery::traceHitscanShots()
+{
+	targetBvh.refit();
+	hitscanHits.resize(hitscanShots.size());
+	workers.parallelFor((unsigned)hitscanShots.size(), 64, [this](unsigned begin, unsigned end, unsigned worker)
+	{
+		for (unsigned i = begin; i < end; i++)
+		{
+			// Shots stop at the first wall in their way.
+			const HitscanShot &shot = hitscanShots[i];
+			cyclone::real reach = scenario.retireBeyond, time;
+			if (scenery.sweepSphere(shot.origin, shot.origin + shot.direction * reach, 0, &time)) reach *= time;
+			if (!targetBvh.raycast(shot.origin, shot.direction, reach, &hitscanHits[i])) hitscanHits[i].box = bullseyes;
+		}
+	});
+
+	// Wake the sleeping bullseyes that were hit, then push them all as a round would.
+	wokenBullseyes.clear();
+	for (const BvhRayHit *hit = hitscanHits.data(); hit < hitscanHits.data() + hitscanHits.size(); hit++)
+	{
+		if (hit->box < bullseyes && bullseyeData[hit->box].activity == BULLSEYE_ASLEEP) wokenBullseyes.push_back(hit->box);
+	}
+	if (!wokenBullseyes.empty()) wakeBullseyes(wokenBullseyes);
+
+	for (unsigned i = 0; i < hitscanHits.size(); i++)
+	{
+		if (hitscanHits[i].box >= bullseyes) continue;
+		Bullseye *bullseye = bullseyeData + hitscanHits[i].box;
+		bullseye->body->setVelocity(0, 0, 0);
+		bullseye->body->setAcceleration(0, -10.0f, 0);
+		// The ray gives the hit point in world space.
+		bullseye->body->addForceAtPoint(hitscanShots[i].force, hitscanHits[i].point);
+		bullseye->forceApplied = true;
+		collisionCounters.rayHits++;
+	}
+
+	// The shots are spent as soon as they're traced.
+	hitscanShots.clear();
+	if (ammoCount <= 0) ammoCount = ammoRounds;
+}
+
+void ShootingGallery::wakeBullseyes(const std::vector<unsigned> &woken)
+{
+	for (const unsigned *index = woken.data(); index < woken.data() + woken.size(); index++)
+	{
+		// Several rounds can reach the same bullseye in a step.
+		Bullseye &bullseye = bullseyeData[*index];
+		if (bullseye.activity != BULLSEYE_ASLEEP) continue;
+		bullseye.activity = BULLSEYE_ACTIVE;
+		bullseye.restingTime = 0;
+		bullseye.body->setAwake();
+		activeBullseyes.push_back(*index);
+	}
+
+	// Keeping the list in index order keeps the islands, and so the
+	// contacts, in the same order however the bullseyes were woken.
+	std::sort(activeBullseyes.begin(), activeBullseyes.end());
+	for (unsigned slot = 0; slot < activeBullseyes.size(); slot++)
+	{
+		bullseyeData[activeBullseyes[slot]].activeSlot = slot;
+	}
+}
+
+void ShootingGallery::updateActivity(cyclone::real duration)
+{
+	cyclone::real sleepSpeed = scenario.sleepSpeed;
+	unsigned kept = 0;
+	for (unsigned slot = 0; slot < activeBullseyes.size(); slot++)
+	{
+		unsigned index = activeBullseyes[slot];
+		Bullseye &bullseye = bullseyeData[index];
+
+		// Down bullseyes are out of play for good, so they leave the broad
+		// phase too and rounds pass where they lie.
+		if (bullseye.hit)
+		{
+			bullseye.activity = BULLSEYE_FALLEN;
+			bullseye.storePreviousState();
+			targetGrid.remove(index);
+			targetBvh.remove(index);
+			continue;
+		}
+
+		// Only a bullseye left to itself, with nothing accelerating it, can
+		// rest; sweeping ones never slow down enough to.
+		const cyclone::RigidBody *body = bullseye.body;
+		if (!bullseye.forceApplied && body->getAcceleration().squareMagnitude() == 0 &&
+			body->getVelocity().squareMagnitude() + body->getRotation().squareMagnitude() < sleepSpeed * sleepSpeed)
+		{
+			bullseye.restingTime += duration;
+		}
+		else bullseye.restingTime = 0;
+
+		if (sleepSpeed > 0 && bullseye.restingTime >= scenario.sleepDelay)
+		{
+			bullseye.activity = BULLSEYE_ASLEEP;
+			bullseye.body->setAwake(false);
+			bullseye.storePreviousState();
+			continue;
+		}
+
+		bullseye.activeSlot = kept;
+		activeBullseyes[kept++] = index;
+	}
+	activeBullseyes.resize(kept);
+}
+
 /** This method controls the effect of standard keys. */
-void ShootingGallery::key(unsigned char key)
+void ShootingGallery::handleKey(unsigned char key)
 {
     switch(key)
     {
@@ -701,16 +1204,62 @@ void ShootingGallery::key(unsigned char key)
 		else if (gunEuler.y < -90) gunEuler.y = -90;		
 		break;
 
+	case '1': currentShotType = PISTOL; break;
+	case '2': currentShotType = SHOTGUN; break;
+	case '3': currentShotType = HITSCAN; break;
+
 	case ' ': fire(); break;
 
     case 'r': case 'R': reset(); break;
-
-	case 27: exit(0); break;
     }
  }
 
+/**
+ * Keys are handed to the simulation thread when there is one, so the
+ * game state is only ever changed by the thread that steps it.
+ */
+void ShootingGallery::key(unsigned char key)
+{
+	if (key == 27)
+	{
+		stopSimulationThread();
+		exit(0);
+	}
+
+	// Culling only affects drawing, so it's handled here rather than by the simulation.
+	if (key == 'c' || key == 'C')
+	{
+		cullingEnabled = !cullingEnabled;
+		return;
+	}
+	if (key == 'l' || key == 'L')
+	{
+		detailLevelsEnabled = !detailLevelsEnabled;
+		return;
+	}
+
+	// As is profiling, which only reads what every thread has recorded.
+	if (key == 'p' || key == 'P')
+	{
+		profilerOverlay = !profilerOverlay;
+		profileRefreshed = std::chrono::steady_clock::time_point();
+		return;
+	}
+	if (key == 't' || key == 'T')
+	{
+		int events = Profiler::get().exportChromeTrace("trace.json");
+		if (events < 0) fprintf(stderr, "Could not write trace.json\n");
+		else printf("Wrote %d events to trace.json\n", events);
+		return;
+	}
+
+	InputEvent event = { false, key };
+	if (!simulationThread.joinable()) applyInput(event);
+	else inputQueue.push(event);
+}
+
 /** This method controls the effect of the arrow keys. */
-void ShootingGallery::specialKey(int specialKey)
+void ShootingGallery::handleSpecialKey(int specialKey)
 {
 	if (specialKey == GLUT_KEY_UP)		// move gun vertically up (increases gluLookAt eye y and target y value)
 	{
@@ -733,12 +1282,179 @@ void ShootingGallery::specialKey(int specialKey)
 	}
 }
 
+void ShootingGallery::specialKey(int specialKey)
+{
+	InputEvent event = { true, specialKey };
+	if (!simulationThread.joinable()) applyInput(event);
+	else inputQueue.push(event);
+}
+
+void ShootingGallery::applyInput(const InputEvent &event)
+{
+	// V records a session to session.replay, and B replays it.
+	if (!event.special && (event.key == 'v' || event.key == 'V'))
+	{
+		if (sessionMode != SESSION_RECORDING)
+		{
+			startRecording();
+			printf("Recording\n");
+			return;
+		}
+		const InputRecording &recording = stopRecording();
+		if (!recording.save("session.replay")) fprintf(stderr, "Could not write session.replay\n");
+		else printf("Recorded %u steps and %u keypresses to session.replay\n", recording.stepCount, (unsigned)recording.events.size());
+		return;
+	}
+	if (!event.special && (event.key == 'b' || event.key == 'B'))
+	{
+		InputRecording recording;
+		if (!recording.load("session.replay")) fprintf(stderr, "Could not load session.replay\n");
+		else if (startReplay(recording)) printf("Replaying %u steps\n", recording.stepCount);
+		return;
+	}
+
+	// O passes the world through the snapshot stream to a loopback spectator.
+	if (!event.special && (event.key == 'o' || event.key == 'O'))
+	{
+		spectating = !spectating;
+		if (spectating)
+		{
+			spectatorEncoder.requestKeyframe();
+			spectatorFrames = spectatorKeyframes = 0;
+			spectatorBytes = spectatorKeyframeBytes = 0;
+			printf("Spectating\n");
+		}
+		else if (spectatorFrames > 0)
+		{
+			unsigned deltas = spectatorFrames - spectatorKeyframes;
+			printf("Sent the spectator %u keyframes of %.0f bytes and %u deltas of %.0f bytes on average\n",
+				spectatorKeyframes, spectatorKeyframes ? spectatorKeyframeBytes / spectatorKeyframes : 0.0,
+				deltas, deltas ? (spectatorBytes - spectatorKeyframeBytes) / deltas : 0.0);
+		}
+		return;
+	}
+
+	// While replaying, the recording is the only input.
+	if (sessionMode == SESSION_REPLAYING) return;
+	if (sessionMode == SESSION_RECORDING) session.add(sessionStep, event);
+
+	if (event.special) handleSpecialKey(event.key);
+	else handleKey((unsigned char)event.key);
+}
+
+void ShootingGallery::startRecording()
+{
+	if (sessionMode == SESSION_REPLAYING) endReplay();
+	reset();
+	currentShotType = PISTOL;
+	session.clear();
+	session.seed = randomSeed;
+	session.timestep = fixedTimestep;
+	session.targetCount = bullseyes;
+	session.roundCount = ammoRounds;
+	session.scenarioHash = hashScenario();
+	sessionStep = 0;
+	sessionMode = SESSION_RECORDING;
+}
+
+const InputRecording& ShootingGallery::stopRecording()
+{
+	session.stepCount = sessionStep;
+	session.finalScore = score;
+	session.finalStateHash = hashState();
+	sessionMode = SESSION_LIVE;
+	return session;
+}
+
+bool ShootingGallery::startReplay(const InputRecording &recording)
+{
+	if (recording.targetCount != bullseyes || recording.roundCount != ammoRounds)
+	{
+		fprintf(stderr, "Could not replay a recording of %u targets and %u rounds in a gallery of %u and %u\n",
+			recording.targetCount, recording.roundCount, bullseyes, ammoRounds);
+		return false;
+	}
+	if (recording.scenarioHash != hashScenario())
+	{
+		fprintf(stderr, "Could not replay a recording made in a different scenario\n");
+		return false;
+	}
+
+	// A replay started during another keeps the timestep and seed from before the first.
+	if (sessionMode != SESSION_REPLAYING)
+	{
+		liveTimestep = fixedTimestep;
+		liveSeed = randomSeed;
+	}
+	session = recording;
+	randomSeed = recording.seed;
+	fixedTimestep = recording.timestep;
+	reset();
+	currentShotType = PISTOL;
+	sessionStep = 0;
+	replayNext = 0;
+	replayEnded = false;
+	sessionMode = SESSION_REPLAYING;
+	return true;
+}
+
+void ShootingGallery::endReplay()
+{
+	sessionMode = SESSION_LIVE;
+	fixedTimestep = liveTimestep;
+	randomSeed = liveSeed;
+}
+
+uint64_t ShootingGallery::hashScenario() const
+{
+	return hashBytes(&muzzleSpeed, sizeof(muzzleSpeed), scenario.hash());
+}
+
+/** Chains the components of a vector, leaving out the padding, into a hash. */
+static uint64_t hashVector(const cyclone::Vector3 &vector, uint64_t hash)
+{
+	const cyclone::real components[3] = { vector.x, vector.y, vector.z };
+	return hashBytes(components, sizeof(components), hash);
+}
+
+uint64_t ShootingGallery::hashState() const
+{
+	const int counts[3] = { score, targetsRemaining, ammoCount };
+	uint64_t hash = hashBytes(counts, sizeof(counts));
+	hash = hashVector(gunEuler, hash);
+	hash = hashVector(cameraOffsetWorld, hash);
+
+	for (const Bullseye *bullseye = bullseyeData; bullseye < bullseyeData + bullseyes; bullseye++)
+	{
+		cyclone::Quaternion orientation = bullseye->body->getOrientation();
+		const cyclone::real rotation[4] = { orientation.r, orientation.i, orientation.j, orientation.k };
+		hash = hashVector(bullseye->body->getPosition(), hash);
+		hash = hashVector(bullseye->body->getVelocity(), hash);
+		hash = hashBytes(rotation, sizeof(rotation), hash);
+		hash = hashBytes(&bullseye->hit, sizeof(bullseye->hit), hash);
+	}
+
+	unsigned live = projectiles.getLiveCount();
+	hash = hashBytes(&live, sizeof(live), hash);
+	hash = hashBytes(projectiles.positionX, sizeof(cyclone::real) * live, hash);
+	hash = hashBytes(projectiles.positionY, sizeof(cyclone::real) * live, hash);
+	hash = hashBytes(projectiles.positionZ, sizeof(cyclone::real) * live, hash);
+	return hash;
+}
+
 /**
  * Called by the common demo framework to create an application
  * object (with new) and return a pointer.
  */
 Application* getApplication()
 {
-    return new ShootingGallery();
+	// The gallery's layout comes from its scenario file, or the built-in one if that can't be read.
+	Scenario scenario;
+	if (!scenario.load("Scenarios/gallery.scenario"))
+	{
+		fprintf(stderr, "Using the built-in gallery\n");
+		scenario = Scenario();
+	}
+    return new ShootingGallery(scenario);
 }
 
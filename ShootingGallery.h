@@ -0,0 +1,709 @@
+/*
+ * Class interfaces for the Shooting Gallery demo.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef SHOOTING_GALLERY_H
+#define SHOOTING_GALLERY_H
+
+#include <gl/glew.h>	// Used by lighting system and drawing text on the window?
+#include <gl/glut.h>
+#include <cyclone.h>
+#include "app.h"
+#include "timing.h"
+#include "utility.h"	// Used to compute rotation matrices and print out numbers.
+
+#include <stdio.h>
+#include <chrono>		// Used to time the simulation phases.
+#include "AssetRegistry.h"
+#include "HudText.h"
+#include "InputRecording.h"
+#include "MeshRenderer.h"
+#include "Profiler.h"
+#include "ProjectileSystem.h"
+#include "Scenario.h"
+#include "BroadPhaseGrid.h"
+#include "SceneryCollision.h"
+#include "SnapshotStream.h"
+#include "SpscQueue.h"
+#include "TargetBvh.h"
+#include "WorldSnapshot.h"
+#include "WorkerPool.h"
+#include "Allocators.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+
+/** Whether a bullseye is stepped, asleep until a round hits it, or down and out of play. */
+enum BullseyeActivity
+{
+	BULLSEYE_ACTIVE,
+	BULLSEYE_ASLEEP,
+	BULLSEYE_FALLEN
+};
+
+/** The Bullseye class stores the information for instantiating
+and updating targets, physics is applied when collisions with bullets are detected. */
+class Bullseye : public cyclone::CollisionBox
+{
+public:
+	// Handle of the shared OBJ model.
+	MeshHandle bullseye = 0;
+	// Holds the hit status of a bullseye.
+	bool hit = false;    
+	// Set when a force is added to the body this step, which keeps it from resting.
+	bool forceApplied = false;
+	// Copied from the target's lane, so stepping doesn't need to look it up.
+	uint32_t motion = MOTION_STILL;
+	cyclone::real speed = 0, minX = 0, maxX = 0;
+	// Only active bullseyes are stepped; see ShootingGallery::updateActivity.
+	BullseyeActivity activity = BULLSEYE_ACTIVE;
+	// Seconds the body has moved slower than the sleep speed.
+	cyclone::real restingTime = 0;
+	// Where the bullseye is in the gallery's active list while it's active.
+	unsigned activeSlot = 0;
+	// Where the body was before the last step, for drawing between steps.
+	cyclone::Vector3 previousPosition;
+	cyclone::Quaternion previousOrientation;
+
+	/** The body is lent by the gallery's body pool. */
+    ~Bullseye()
+    {
+		AssetRegistry::get().releaseMesh(bullseye);
+    }
+
+	/** Look up the shared bullseye model, loading it for the first target. */
+	void loadBullseyeModel()
+	{
+		bullseye = AssetRegistry::get().acquireMesh("Models/target.obj");
+	}
+
+	/** Remembers where the body is before it's stepped. */
+	void storePreviousState()
+	{
+		body->getPosition(&previousPosition);
+		body->getOrientation(&previousOrientation);
+	}
+
+    /** Sets the bullseye to a specific location in its lane, moving as the lane does. */
+    void setState(const TargetLane &lane, cyclone::real x, cyclone::real z)
+    {
+		motion = lane.motion;
+		speed = lane.motion == MOTION_SWEEP ? lane.speed : 0;
+		minX = lane.minX;
+		maxX = lane.maxX;
+
+        body->setPosition(x, lane.height, z);
+		body->setOrientation(0,0,1,0);
+		body->setVelocity(speed, 0, 0);
+        body->setRotation(cyclone::Vector3(0,0,0));
+        halfSize = cyclone::Vector3(1.2,3,1); // Half-dimensions of the target model.
+
+        cyclone::real mass = halfSize.x * halfSize.y * halfSize.z * .10f;
+        body->setMass(mass);
+
+        cyclone::Matrix3 tensor;
+        tensor.setBlockInertiaTensor(halfSize, mass);
+        body->setInertiaTensor(tensor);
+
+        body->setLinearDamping(0.95f);
+        body->setAngularDamping(0.8f);
+        body->clearAccumulators();
+        body->setAcceleration(0,0,0);
+
+        // The gallery puts bullseyes to sleep itself, by the scenario's sleep
+        // speed and delay, and takes them off the active list when it does.
+        // Cyclone's own sleeping would stop bodies on its own threshold while
+        // they are still listed, so it is turned off.
+        body->setCanSleep(false);
+        body->setAwake();
+        forceApplied = false;
+        activity = BULLSEYE_ACTIVE;
+        restingTime = 0;
+
+        body->calculateDerivedData();
+        calculateInternals();
+        storePreviousState();
+    }
+};
+
+/** The Gun class stores the information for instantiating 
+and updating a Gun model, physics is not applied. */
+class Gun : public cyclone::CollisionBox
+{
+public:
+	/** The body is lent by the gallery's body pool. */
+	~Gun()
+	{
+		AssetRegistry::get().releaseMesh(gun);
+	}
+
+	MeshHandle gun = 0;
+
+	/** Looks up the shared gun model, loading it if needed.*/
+	void loadGunModel()
+	{
+		gun = AssetRegistry::get().acquireMesh("Models/revolver.obj");
+	}
+
+	/** Draws the model without a shadow, given the body's OpenGL transformation. */
+	void render(MeshRenderer &renderer, const GLfloat mat[16], cyclone::Vector3 gunEulerAngle, cyclone::Vector3 gunCamOffset)
+	{
+		glPushMatrix();
+		glMultMatrixf(mat);
+		glTranslatef(0, gunCamOffset.y, 0);
+		glRotatef(gunEulerAngle.y, 0, 1, 0);
+		glRotatef(gunEulerAngle.x, 1, 0, 0);	
+		glTranslatef(gunCamOffset.x, 0, gunCamOffset.z);
+		glScalef(1.0f, 1.0f, 1.0f);
+		renderer.draw(gun);
+		glPopMatrix();
+	}
+
+	/*Sets the location of the gun*/
+	void setState(cyclone::Vector3 position)
+	{
+		body->setPosition(position.x, position.y, position.z);
+		body->setOrientation(1, 0, 0, 0);
+		body->setVelocity(0, 0, 0);
+		body->setRotation(cyclone::Vector3(0, 0, 0));
+		halfSize = cyclone::Vector3(1, 1, 1);
+
+		cyclone::real mass = halfSize.x * halfSize.y * halfSize.z * 10.0f;
+		body->setMass(mass);
+
+		cyclone::Matrix3 tensor;
+		tensor.setBlockInertiaTensor(halfSize, mass);
+		body->setInertiaTensor(tensor);
+
+		body->setLinearDamping(0.95f);
+		body->setAngularDamping(0.8f);
+		body->clearAccumulators();
+		body->setAcceleration(0, 0, 0);
+
+		body->setCanSleep(false);
+		body->setAwake();
+
+		body->calculateDerivedData();
+		calculateInternals();
+	}
+};
+
+/** Wall-clock cost of each phase of one simulation step, in milliseconds. */
+struct StepTimings
+{
+	double updateObjects;
+	double generateContacts;
+	double resolveContacts;
+	/** The part of updateObjects spent integrating rounds and bullseyes. */
+	double integrate;
+};
+
+/** How much work the last generateContacts did between rounds and bullseyes. */
+struct CollisionCounters
+{
+	/** Round and bullseye pairs the broad phase passed to the narrow phase. */
+	unsigned candidatePairs;
+	/** Pairs that turned out to touch. */
+	unsigned shotContacts;
+	/** Hitscan shots traced, and how many hit a bullseye. */
+	unsigned rayQueries, rayHits;
+	/** Rounds retired against the scenery. */
+	unsigned sceneryHits;
+};
+
+/** Heap use of the gallery's allocators. */
+struct GalleryAllocations
+{
+	/** Rigid bodies for the bullseyes and guns, kept for the life of the gallery. */
+	AllocationCounters bodies;
+	/** Round proxies for contacts, summed over the workers and recycled each step. */
+	AllocationCounters proxies;
+	/** Islands, hits and merged contacts for one step. */
+	AllocationCounters step;
+};
+
+/** A hitscan shot fired since the last step, waiting to be traced. */
+struct HitscanShot
+{
+	cyclone::Vector3 origin;
+	/** Along the barrel, of unit length. */
+	cyclone::Vector3 direction;
+	/** The force the shot pushes the bullseye it hits with. */
+	cyclone::Vector3 force;
+};
+
+/** What a round's sweep found: the bullseye it reaches first, and when. */
+struct RoundHit
+{
+	unsigned round;
+	unsigned bullseye;
+	cyclone::real time;
+};
+
+/**
+ * A bullseye with the rounds hitting it and the contacts they make. Rounds
+ * only ever touch one bullseye and bullseyes don't touch each other, so
+ * islands share no bodies and can be handled in parallel.
+ */
+struct ContactIsland
+{
+	unsigned firstHit, hitCount;
+	unsigned firstContact, contactCount;
+	/** The worker whose buffer the contacts were generated in. */
+	unsigned worker;
+};
+
+/** One worker's share of a step's collision work, kept between steps to avoid reallocating. */
+struct WorkerContacts
+{
+	WorkerContacts() : resolver(1) {}
+
+	std::vector<unsigned> candidates;
+	std::vector<RoundHit> hits;
+	std::vector<unsigned> retired;
+
+	/** Contacts generated so far this step; the vector grows as needed, so none are dropped. */
+	std::vector<cyclone::Contact> contacts;
+	unsigned contactCount;
+
+	/** Stand-ins for the rounds in this worker's contacts, one per contact, recycled each step. */
+	ObjectPool<ProjectileProxy> proxies;
+
+	unsigned candidatePairs;
+	unsigned shotContacts;
+	unsigned sceneryHits;
+	int targetsDown;
+
+	cyclone::ContactResolver resolver;
+
+	/** Clears the counts for a new step. */
+	void reset();
+
+	/** Points data past the contacts so far, with room for at least the given number more. */
+	void prepare(cyclone::CollisionData &data, unsigned room);
+
+};
+
+/**
+ * Everything the HUD shows. The text is only laid out again when one of
+ * these changes; the fields are all ints so two can be compared bytewise.
+ */
+struct HudFields
+{
+	int width, height;
+	int score, targetsRemaining, ammoCount;
+	int aimWarning, won;
+	int culling, detailLevels, drawCalls, trianglesDrawn, trianglesTotal;
+	/** Whether the profiler overlay is shown, and which refresh of its figures. */
+	int profiling, profileRevision;
+};
+
+/** The main demo class definition. */
+class ShootingGallery : public RigidBodyApplication
+{
+	/** The layout, weapons and rules this gallery was made from. */
+	Scenario scenario;
+
+	/** Holds the maximum number of  rounds that can be fired. */
+    unsigned ammoRounds;
+
+	/** Mutable count of ammunition remaining in the weapon.*/
+	int ammoCount;
+
+    /** Holds every round in flight. */
+    ProjectileSystem projectiles;
+
+	/** Holds the number of guns in the simulation. */
+	const static unsigned guns = 1;
+
+	/** Holds the gun data. */
+	Gun revolver[guns];
+
+    /** Holds the number of bullseye targets in the simulation. */
+    unsigned bullseyes;
+
+    /** Holds the bullseye data. */
+    Bullseye *bullseyeData;
+
+	/**
+	 * Indices of the bullseyes that are awake and standing, in order. Only
+	 * these are integrated, moved in the broad phase and given islands, so
+	 * a step costs what the moving bullseyes cost. Sleeping bullseyes stay
+	 * in the broad phase so rounds can still hit, and wake, them.
+	 */
+	std::vector<unsigned> activeBullseyes;
+
+	/** Puts the given bullseyes back in the active list, in order. */
+	void wakeBullseyes(const std::vector<unsigned> &woken);
+
+	/**
+	 * After a step, puts bullseyes that have rested for the scenario's sleep
+	 * delay to sleep and drops fallen ones from the active list and the
+	 * broad phase.
+	 */
+	void updateActivity(cyclone::real duration);
+
+    /** Holds the current shot type. */
+    ShotType currentShotType;
+
+    /** Resets the position of all the boxes and primes the explosion. */
+    virtual void reset();
+
+    /** Build the contacts for the current situation. */
+    virtual void generateContacts();
+
+    /** Processes the objects in the simulation forward in time. */
+    virtual void updateObjects(cyclone::real duration);
+
+    /** Dispatches a round, or a spread of pellets. Hitscan shots are queued for the next step. */
+    void fire();
+
+	/**
+	 * Traces the queued hitscan shots against the bullseye hierarchy, in
+	 * parallel, and pushes the bullseyes they hit in the order they were
+	 * fired.
+	 */
+	void traceHitscanShots();
+
+	/** Length of one simulation step in seconds. */
+	cyclone::real fixedTimestep = 1.0f / 120.0f;
+
+	/**
+	 * Most steps run for one frame. Time beyond that is dropped, so a slow
+	 * frame can't lead to more steps and slower frames after it.
+	 */
+	unsigned maxStepsPerFrame = 8;
+
+	/** Wall-clock seconds not yet simulated. */
+	double accumulator = 0;
+
+	/** When update was last called, and whether it has been. */
+	std::chrono::steady_clock::time_point lastUpdate;
+	bool clockStarted = false;
+
+	/** Overrides the muzzle speed of every shot type when positive. */
+	cyclone::real muzzleSpeed = 0;
+
+	/** Seeds the pellet spread, so runs with the same input are repeatable. */
+	unsigned randomSeed = 1;
+	cyclone::Random random;
+
+	/** Records the number of targets hit. */
+	int score = 0;
+	int targetsRemaining;
+
+	/** Buckets the bullseyes by position so each round is only tested against nearby ones. */
+	BroadPhaseGrid targetGrid;
+
+	/** The scenario's walls, or nothing for an open range. */
+	SceneryCollision scenery;
+
+	/**
+	 * Bounds the standing bullseyes for the hitscan shots. It's refitted,
+	 * not rebuilt, as they move, and only on steps with shots to trace.
+	 */
+	TargetBvh targetBvh;
+
+	/** Hitscan shots waiting for the next step, and where each one hit. */
+	std::vector<HitscanShot> hitscanShots;
+	std::vector<BvhRayHit> hitscanHits;
+
+	/** Holds the bodies of the bullseyes and guns side by side. */
+	ObjectPool<cyclone::RigidBody, 64> bodies;
+
+	/** The floor the bullseyes fall onto. */
+	cyclone::CollisionPlane groundPlane;
+
+	/** Shares contact generation and resolution between the cores. */
+	WorkerPool workers;
+	WorkerContacts *workerContacts;
+
+	/** Holds the islands, hits and merged contacts, which only last one step. */
+	FrameArena stepArena;
+
+	/** This step's islands, one per active bullseye in active list order, and the hits they index. */
+	ContactIsland *islands;
+	unsigned islandCount;
+	RoundHit *islandHits;
+
+	/** Sleeping bullseyes a round reached this step, to wake before the islands are built. */
+	std::vector<unsigned> wokenBullseyes;
+
+	/** Every contact this step, merged from the workers and grouped by island. */
+	cyclone::Contact *stepContacts;
+
+	/** Rounds that hit a bullseye this step, to retire once the workers are done. */
+	std::vector<unsigned> retiredRounds;
+
+	/** Resolves each island's contacts separately, in parallel. */
+	void resolveContacts(cyclone::real duration);
+
+	/** Counts from the last generateContacts. */
+	CollisionCounters collisionCounters = { 0, 0, 0, 0, 0 };
+
+	/** Wall-clock milliseconds spent integrating in the last updateObjects. */
+	double integrateTime = 0;
+
+	/** Simulated milliseconds since the last reset, used to expire rounds. */
+	double simulationTime = 0;
+
+	/** Handle of the OBJ model for the static scenery. */
+	MeshHandle gallery = 0;
+
+	/** Handle of the sphere mesh drawn for every round. */
+	MeshHandle roundMesh = 0;
+
+	/** Set until every texture has finished streaming in. */
+	bool texturesStreaming = true;
+
+	/** Draws meshes from GPU buffers, instancing the rounds and bullseyes. */
+	MeshRenderer renderer;
+
+	/** What the camera sees this frame, and whether to skip what it doesn't; toggled with C. */
+	Frustum viewFrustum;
+	bool cullingEnabled = true;
+
+	/** How the camera projects this frame, and whether to draw distant meshes simplified; toggled with L. */
+	DetailView detailView;
+	bool detailLevelsEnabled = true;
+
+	/** The HUD's fonts, its text as last laid out, and the part that only moves when the window does. */
+	HudText hud;
+	int hudFace = -1, hudLargeFace = -1, hudBannerFace = -1;
+	HudFields hudShown;
+	std::vector<TextVertex> hudStatic, hudBatch;
+	int hudStaticWidth = -1, hudStaticHeight = -1;
+
+	/** The scopes the profiler overlay shows. */
+	const static unsigned profiledScopeCount = 7;
+
+	/** Whether the profiler overlay is shown; toggled with P. */
+	bool profilerOverlay = false;
+
+	/** The overlay's figures, refreshed a few times a second rather than every frame. */
+	ProfileStats profileStats[profiledScopeCount];
+	std::chrono::steady_clock::time_point profileRefreshed;
+	int profileRevision = 0;
+
+	/** Lays out the HUD's text for the given fields and uploads it. */
+	void buildHud(const HudFields &fields);
+
+	/** Carries the world from the simulation to display(). */
+	SnapshotExchange snapshots;
+
+	/** Keypresses waiting for the simulation thread. */
+	SpscQueue<InputEvent, 256> inputQueue;
+
+	/** Runs the simulation when the machine has more than one core. */
+	std::thread simulationThread;
+	std::atomic<bool> simulationRunning;
+
+	/** Copies what display() needs into the next snapshot, as of the given time. */
+	void publishSnapshot(std::chrono::steady_clock::time_point stepTime);
+
+	/**
+	 * Whether each published snapshot goes through the snapshot stream to a
+	 * loopback spectator first, so display() draws the world the spectator
+	 * rebuilt; toggled with O.
+	 */
+	bool spectating = false;
+	SnapshotEncoder spectatorEncoder;
+	SpectatorClient spectator;
+	std::vector<unsigned char> spectatorFrame;
+
+	/** Frames and bytes sent to the spectator since it was turned on. */
+	unsigned spectatorFrames = 0, spectatorKeyframes = 0;
+	double spectatorBytes = 0, spectatorKeyframeBytes = 0;
+
+	/** Body of the simulation thread: applies input and keeps the steps in time with the clock. */
+	void simulationLoop();
+
+	/** Starts and stops the simulation thread. */
+	void startSimulationThread();
+	void stopSimulationThread();
+
+	/** Apply a keypress to the simulation. */
+	void handleKey(unsigned char key);
+	void handleSpecialKey(int specialKey);
+
+	/** Whether keypresses are being recorded or replayed. */
+	enum SessionMode
+	{
+		SESSION_LIVE,
+		SESSION_RECORDING,
+		SESSION_REPLAYING
+	};
+	SessionMode sessionMode = SESSION_LIVE;
+
+	/** Steps since the recording or replay began, which is what its keypresses are stamped with. */
+	uint32_t sessionStep = 0;
+
+	/** The session being recorded or replayed, and the next of its keypresses to replay. */
+	InputRecording session;
+	size_t replayNext = 0;
+
+	/** Whether the last replay has run every step, and whether it ended as its recording did. */
+	bool replayEnded = false;
+	bool replayResult = false;
+
+	/** The timestep and seed the gallery had before a replay took them over, put back when it ends. */
+	cyclone::real liveTimestep = 0;
+	unsigned liveSeed = 0;
+
+	/** Ends a replay, putting the gallery's own timestep and seed back. */
+	void endReplay();
+
+	/** Returns the scenario's hash, with this gallery's muzzle speed, for recordings to be checked against. */
+	uint64_t hashScenario() const;
+
+	/**
+	 * Applies a keypress from the keyboard to the simulation, recording it
+	 * if a recording is running. V and B start and stop recording and
+	 * replaying, and O the loopback spectator; none of them are recorded.
+	 */
+	void applyInput(const InputEvent &event);
+
+	/** Per-instance transforms gathered each frame, kept to avoid reallocating. */
+	std::vector<GLfloat> instanceTransforms;
+	
+	/** Look up the static scenery model, loading it if needed. */
+	void loadScene();
+
+	/** Draw the static scenery. */
+	void drawScene();
+
+	/** Hold offset vectors of Camera, Ammo from the gun in Local and Worldspace. */
+	cyclone::Vector3
+		cameraOffsetLocal = { 0.0f, 4.5f, -3.0f },		// offset from world point {0,0,0}
+		cameraOffsetWorld = { cameraOffsetLocal.x, cameraOffsetLocal.y, cameraOffsetLocal.z },
+		aimOffsetLocal = { 0.0f, 4.5f, 50.0f },			// offset from world point {0,0,0}
+		aimOffsetWorld = { aimOffsetLocal.x, aimOffsetLocal.y, aimOffsetLocal.z },
+		gunOffsetLocal = { -0.33f, 4.25f, -1.5f },		// offset from world point {0,0,0}
+		gunOffsetWorld = { gunOffsetLocal.x, gunOffsetLocal.y, gunOffsetLocal.z },
+		ammoOffsetLocal = { 0.33f, 0.25f, -2.0f },		// offset from world camera point
+		ammoOffsetWorld = { ammoOffsetLocal.x, ammoOffsetLocal.y, ammoOffsetLocal.z },
+		gunEuler = { 0.0f, 0.0f, 0.0f };
+	
+public:
+    /** Creates a new demo object with the given number of targets and rounds, laid out as the built-in gallery. */
+    ShootingGallery(unsigned targetCount = 10, unsigned roundCount = 6);
+
+	/**
+	 * Creates a gallery sized and laid out by a scenario, sharing its
+	 * collision work between the given number of threads, or one per core
+	 * if zero. Galleries run side by side by a SessionBatch take one each.
+	 */
+	explicit ShootingGallery(const Scenario &scenario, unsigned workerCount = 0);
+
+	~ShootingGallery();
+
+	/**
+	 * Advances the simulation by one step without touching OpenGL, so it can
+	 * be driven headless. Per-phase wall-clock costs are written to timings
+	 * if it is given.
+	 */
+	void step(cyclone::real duration, StepTimings *timings = NULL);
+
+	/**
+	 * Adds the given seconds of real time to the accumulator and runs as
+	 * many fixed steps as it covers. Returns the number of steps run.
+	 */
+	unsigned advance(double frameDuration);
+
+	/** Sets the length of one simulation step in seconds. */
+	void setFixedTimestep(cyclone::real duration) { fixedTimestep = duration; }
+
+	/** Returns the number of targets knocked down since the last reset. */
+	int getScore() const { return score; }
+
+	/** Returns the number of rounds currently in flight. */
+	unsigned getLiveRounds() const;
+
+	/** Returns the number of bullseyes awake and standing, which are the ones stepped. */
+	unsigned getActiveBullseyes() const { return (unsigned)activeBullseyes.size(); }
+
+	/** Fires every shot type at the given speed, or at its own speed if zero. */
+	void setMuzzleSpeed(cyclone::real speed) { muzzleSpeed = speed; }
+
+	/** Sets how many threads share the collision work, or one per core if zero. */
+	void setWorkerCount(unsigned count);
+
+	/** Returns how many threads share the collision work. */
+	unsigned getWorkerCount() const { return workers.getWorkerCount(); }
+
+	/** Returns the heap use of the body pool, proxy pools and step arena. */
+	GalleryAllocations getAllocations() const;
+
+	/**
+	 * Resets the gallery and records every keypress applied from now on,
+	 * against the step it was applied before.
+	 */
+	void startRecording();
+
+	/** Stops recording and returns the session, stamped with how it ended. */
+	const InputRecording& stopRecording();
+
+	/**
+	 * Resets the gallery to a recording's seed and timestep and replays its
+	 * keypresses from the next step. Keys from the keyboard are ignored
+	 * until it ends, when the gallery's own timestep and seed come back.
+	 * Returns false if the recording was made in a different scenario.
+	 */
+	bool startReplay(const InputRecording &recording);
+
+	/** Returns true until a replay has run every step of its recording. */
+	bool isReplaying() const { return sessionMode == SESSION_REPLAYING; }
+
+	/** Returns true once a replay has run every step, until the next one starts. */
+	bool replayFinished() const { return replayEnded; }
+
+	/** Returns true if the last replay to finish ended with the recording's score and state. */
+	bool replayMatched() const { return replayResult; }
+
+	/**
+	 * Returns a hash of the state that decides how a session plays out: the
+	 * score, ammunition, aim, bullseyes and rounds in flight.
+	 */
+	uint64_t hashState() const;
+
+	/**
+	 * Copies the world as display() or a spectator sees it into world,
+	 * leaving its step time for the caller to stamp.
+	 */
+	void captureSnapshot(WorldSnapshot &world) const;
+
+	/** Returns the broad and narrow phase counts from the last step. */
+	const CollisionCounters& getCollisionCounters() const { return collisionCounters; }
+
+    /** Returns the window title for the demo. */
+    virtual const char* getTitle();
+
+    /** Sets up the rendering. */
+    virtual void initGraphics();
+    
+    /**
+     * Runs the simulation at a fixed rate, independent of the display. When
+     * the simulation has its own thread this only asks for a redisplay.
+     */
+    virtual void update();
+
+    /** Display world, interpolated between the last two steps. */
+    virtual void display();
+
+    /** Handle a keypress, passing it to the simulation thread if there is one. */
+    virtual void key(unsigned char key);
+
+	/** Handle a special keypress (Arrow keys for this app). */
+	virtual void specialKey(int specialKey);
+};
+
+#endif // SHOOTING_GALLERY_H
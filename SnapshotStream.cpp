@@ -0,0 +1,396 @@
+/*
+ * Implementation of the snapshot stream.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include "SnapshotStream.h"
+
+#include <math.h>
+#include <string.h>
+
+/** Marks the first byte of each frame. */
+static const unsigned char keyframeKind = 'K';
+static const unsigned char deltaKind = 'D';
+
+/** What a delta sends for each bullseye it lists. */
+static const unsigned char changedPosition = 1;
+static const unsigned char changedOrientation = 2;
+static const unsigned char changedSize = 4;
+
+/** Steps per unit of the quantized lengths and orientation components. */
+static const double positionScale = 1024.0;
+static const double orientationScale = 32767.0;
+
+/** Appends an integer, seven bits to a byte, low bits first. */
+static void writeVarint(std::vector<unsigned char> *bytes, uint32_t value)
+{
+	while (value >= 0x80)
+	{
+		bytes->push_back((unsigned char)(value | 0x80));
+		value >>= 7;
+	}
+	bytes->push_back((unsigned char)value);
+}
+
+/** Reads an integer written by writeVarint, returning false if it runs off the end. */
+static bool readVarint(const unsigned char *&cursor, const unsigned char *end, uint32_t *value)
+{
+	*value = 0;
+	for (unsigned shift = 0; shift < 35 && cursor < end; shift += 7)
+	{
+		unsigned char byte = *cursor++;
+		*value |= (uint32_t)(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0) return true;
+	}
+	return false;
+}
+
+/** Appends a signed integer, interleaved with the positive ones so small differences of either sign stay short. */
+static void writeSigned(std::vector<unsigned char> *bytes, int32_t value)
+{
+	writeVarint(bytes, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+}
+
+/** Reads an integer written by writeSigned. */
+static bool readSigned(const unsigned char *&cursor, const unsigned char *end, int32_t *value)
+{
+	uint32_t packed;
+	if (!readVarint(cursor, end, &packed)) return false;
+	*value = (int32_t)(packed >> 1) ^ -(int32_t)(packed & 1);
+	return true;
+}
+
+/** Appends floats as they are held in memory. */
+static void writeFloats(std::vector<unsigned char> *bytes, const float *values, size_t count)
+{
+	const unsigned char *raw = (const unsigned char*)values;
+	bytes->insert(bytes->end(), raw, raw + count * sizeof(float));
+}
+
+/** Reads floats written by writeFloats. */
+static bool readFloats(const unsigned char *&cursor, const unsigned char *end, float *values, size_t count)
+{
+	if ((size_t)(end - cursor) < count * sizeof(float)) return false;
+	memcpy(values, cursor, count * sizeof(float));
+	cursor += count * sizeof(float);
+	return true;
+}
+
+static int32_t quantize(cyclone::real value, double scale)
+{
+	return (int32_t)floor(value * scale + 0.5);
+}
+
+static void quantizeBullseye(const BullseyeSnapshot &bullseye, QuantizedBullseye *quantized)
+{
+	quantized->position[0] = quantize(bullseye.position.x, positionScale);
+	quantized->position[1] = quantize(bullseye.position.y, positionScale);
+	quantized->position[2] = quantize(bullseye.position.z, positionScale);
+
+	// q and -q are the same rotation, so only one sign of the real part is sent.
+	cyclone::real sign = bullseye.orientation.r < 0 ? (cyclone::real)-1 : (cyclone::real)1;
+	for (unsigned i = 0; i < 4; i++)
+	{
+		quantized->orientation[i] = quantize(bullseye.orientation.data[i] * sign, orientationScale);
+	}
+
+	quantized->halfSize[0] = quantize(bullseye.halfSize.x, positionScale);
+	quantized->halfSize[1] = quantize(bullseye.halfSize.y, positionScale);
+	quantized->halfSize[2] = quantize(bullseye.halfSize.z, positionScale);
+}
+
+/** Collects the gun and camera state a frame sends when it changes. */
+static void gatherView(const WorldSnapshot &world, std::vector<float> *view)
+{
+	view->assign(world.gunTransforms.begin(), world.gunTransforms.end());
+	const cyclone::Vector3 *vectors[] = { &world.cameraOffsetWorld, &world.aimOffsetWorld, &world.gunOffsetWorld, &world.gunEuler };
+	for (unsigned i = 0; i < 4; i++)
+	{
+		view->push_back((float)vectors[i]->x);
+		view->push_back((float)vectors[i]->y);
+		view->push_back((float)vectors[i]->z);
+	}
+}
+
+SnapshotEncoder::SnapshotEncoder(unsigned keyframeInterval)
+: sequence(0), keyframeInterval(keyframeInterval), sinceKeyframe(0), keyframeDue(true)
+{
+}
+
+bool SnapshotEncoder::encode(const WorldSnapshot &world, std::vector<unsigned char> *frame)
+{
+	bool keyframe = keyframeDue || sinceKeyframe + 1 >= keyframeInterval || baseline.size() != world.bullseyes.size();
+	sequence++;
+
+	frame->push_back(keyframe ? keyframeKind : deltaKind);
+	writeVarint(frame, sequence);
+	if (keyframe)
+	{
+		float timestep = (float)world.timestep;
+		writeFloats(frame, &timestep, 1);
+	}
+	writeVarint(frame, (uint32_t)world.bullseyes.size());
+
+	if (keyframe)
+	{
+		baseline.resize(world.bullseyes.size());
+		for (size_t index = 0; index < world.bullseyes.size(); index++)
+		{
+			QuantizedBullseye &sent = baseline[index];
+			quantizeBullseye(world.bullseyes[index], &sent);
+			for (unsigned i = 0; i < 3; i++) writeSigned(frame, sent.position[i]);
+			for (unsigned i = 0; i < 4; i++) writeSigned(frame, sent.orientation[i]);
+			for (unsigned i = 0; i < 3; i++) writeSigned(frame, sent.halfSize[i]);
+		}
+	}
+	else
+	{
+		// The changes are gathered first, since the count goes in front of them.
+		changes.clear();
+		uint32_t changed = 0, nextIndex = 0;
+		for (size_t index = 0; index < world.bullseyes.size(); index++)
+		{
+			QuantizedBullseye current;
+			quantizeBullseye(world.bullseyes[index], &current);
+			QuantizedBullseye &sent = baseline[index];
+
+			unsigned char mask = 0;
+			if (memcmp(current.position, sent.position, sizeof(current.position)) != 0) mask |= changedPosition;
+			if (memcmp(current.orientation, sent.orientation, sizeof(current.orientation)) != 0) mask |= changedOrientation;
+			if (memcmp(current.halfSize, sent.halfSize, sizeof(current.halfSize)) != 0) mask |= changedSize;
+			if (mask == 0) continue;
+
+			writeVarint(&changes, (uint32_t)index - nextIndex);
+			changes.push_back(mask);
+			if (mask & changedPosition)
+			{
+				for (unsigned i = 0; i < 3; i++) writeSigned(&changes, current.position[i] - sent.position[i]);
+			}
+			if (mask & changedOrientation)
+			{
+				for (unsigned i = 0; i < 4; i++) writeSigned(&changes, current.orientation[i] - sent.orientation[i]);
+			}
+			if (mask & changedSize)
+			{
+				for (unsigned i = 0; i < 3; i++) writeSigned(&changes, current.halfSize[i] - sent.halfSize[i]);
+			}
+			sent = current;
+			nextIndex = (uint32_t)index + 1;
+			changed++;
+		}
+		writeVarint(frame, changed);
+		frame->insert(frame->end(), changes.begin(), changes.end());
+	}
+
+	writeSigned(frame, world.score);
+	writeSigned(frame, world.targetsRemaining);
+	writeSigned(frame, world.ammoCount);
+
+	gatherView(world, &view);
+	if (keyframe || view != viewBaseline)
+	{
+		frame->push_back(1);
+		writeVarint(frame, (uint32_t)view.size());
+		writeFloats(frame, view.data(), view.size());
+		viewBaseline.swap(view);
+	}
+	else frame->push_back(0);
+
+	// Rounds are sent whole; each one's previous position goes as an offset from its current one.
+	writeVarint(frame, (uint32_t)world.rounds.size());
+	for (const RoundSnapshot *round = world.rounds.data(); round < world.rounds.data() + world.rounds.size(); round++)
+	{
+		for (unsigned i = 0; i < 3; i++)
+		{
+			int32_t current = quantize(round->current[i], positionScale);
+			writeSigned(frame, current);
+			writeSigned(frame, quantize(round->previous[i], positionScale) - current);
+		}
+		writeVarint(frame, (uint32_t)quantize(round->radius, positionScale));
+	}
+
+	keyframeDue = false;
+	sinceKeyframe = keyframe ? 0 : sinceKeyframe + 1;
+	return keyframe;
+}
+
+SpectatorClient::SpectatorClient()
+: sequence(0), synchronised(false)
+{
+	world.score = world.targetsRemaining = world.ammoCount = 0;
+	world.timestep = 0;
+}
+
+void SpectatorClient::rebuild(uint32_t index)
+{
+	const QuantizedBullseye &quantized = state[index];
+	BullseyeSnapshot &bullseye = world.bullseyes[index];
+	bullseye.position = cyclone::Vector3(
+		(cyclone::real)(quantized.position[0] / positionScale),
+		(cyclone::real)(quantized.position[1] / positionScale),
+		(cyclone::real)(quantized.position[2] / positionScale));
+	bullseye.orientation = cyclone::Quaternion(
+		(cyclone::real)(quantized.orientation[0] / orientationScale),
+		(cyclone::real)(quantized.orientation[1] / orientationScale),
+		(cyclone::real)(quantized.orientation[2] / orientationScale),
+		(cyclone::real)(quantized.orientation[3] / orientationScale));
+	bullseye.orientation.normalise();
+	bullseye.halfSize = cyclone::Vector3(
+		(cyclone::real)(quantized.halfSize[0] / positionScale),
+		(cyclone::real)(quantized.halfSize[1] / positionScale),
+		(cyclone::real)(quantized.halfSize[2] / positionScale));
+}
+
+bool SpectatorClient::receive(const unsigned char *frame, size_t size)
+{
+	const unsigned char *cursor = frame, *end = frame + size;
+	if (cursor == end) return false;
+	unsigned char kind = *cursor++;
+	uint32_t frameSequence, bullseyeCount;
+	if (kind != keyframeKind && kind != deltaKind) return false;
+	if (!readVarint(cursor, end, &frameSequence)) return false;
+
+	// A delta is only good against the frame before it.
+	if (kind == deltaKind && (!synchronised || frameSequence != sequence + 1))
+	{
+		synchronised = false;
+		return false;
+	}
+
+	// From here a bad frame leaves the world half updated.
+	synchronised = false;
+	if (kind == keyframeKind)
+	{
+		float timestep;
+		if (!readFloats(cursor, end, &timestep, 1)) return false;
+		world.timestep = timestep;
+		if (!readVarint(cursor, end, &bullseyeCount)) return false;
+
+		// Each bullseye takes at least ten bytes, so a bad count can't ask for more than the frame holds.
+		if (bullseyeCount > (size_t)(end - cursor) / 10) return false;
+		state.resize(bullseyeCount);
+		world.bullseyes.resize(bullseyeCount);
+		for (uint32_t index = 0; index < bullseyeCount; index++)
+		{
+			QuantizedBullseye &quantized = state[index];
+			for (unsigned i = 0; i < 3; i++) if (!readSigned(cursor, end, &quantized.position[i])) return false;
+			for (unsigned i = 0; i < 4; i++) if (!readSigned(cursor, end, &quantized.orientation[i])) return false;
+			for (unsigned i = 0; i < 3; i++) if (!readSigned(cursor, end, &quantized.halfSize[i])) return false;
+			rebuild(index);
+
+			BullseyeSnapshot &bullseye = world.bullseyes[index];
+			bullseye.previousPosition = bullseye.position;
+			bullseye.previousOrientation = bullseye.orientation;
+		}
+		moved.clear();
+	}
+	else
+	{
+		if (!readVarint(cursor, end, &bullseyeCount) || bullseyeCount != state.size()) return false;
+
+		// What moved last frame has stopped unless this frame moves it again.
+		for (const uint32_t *index = moved.data(); index < moved.data() + moved.size(); index++)
+		{
+			BullseyeSnapshot &bullseye = world.bullseyes[*index];
+			bullseye.previousPosition = bullseye.position;
+			bullseye.previousOrientation = bullseye.orientation;
+		}
+		moved.clear();
+
+		uint32_t changed, nextIndex = 0;
+		if (!readVarint(cursor, end, &changed)) return false;
+		for (uint32_t i = 0; i < changed; i++)
+		{
+			uint32_t gap;
+			if (!readVarint(cursor, end, &gap) || gap >= bullseyeCount - nextIndex || cursor == end) return false;
+			uint32_t index = nextIndex + gap;
+			unsigned char mask = *cursor++;
+
+			QuantizedBullseye &quantized = state[index];
+			int32_t difference;
+			if (mask & changedPosition)
+			{
+				for (unsigned j = 0; j < 3; j++)
+				{
+					if (!readSigned(cursor, end, &difference)) return false;
+					quantized.position[j] += difference;
+				}
+			}
+			if (mask & changedOrientation)
+			{
+				for (unsigned j = 0; j < 4; j++)
+				{
+					if (!readSigned(cursor, end, &difference)) return false;
+					quantized.orientation[j] += difference;
+				}
+			}
+			if (mask & changedSize)
+			{
+				for (unsigned j = 0; j < 3; j++)
+				{
+					if (!readSigned(cursor, end, &difference)) return false;
+					quantized.halfSize[j] += difference;
+				}
+			}
+
+			BullseyeSnapshot &bullseye = world.bullseyes[index];
+			bullseye.previousPosition = bullseye.position;
+			bullseye.previousOrientation = bullseye.orientation;
+			rebuild(index);
+			moved.push_back(index);
+			nextIndex = index + 1;
+		}
+	}
+
+	if (!readSigned(cursor, end, &world.score)) return false;
+	if (!readSigned(cursor, end, &world.targetsRemaining)) return false;
+	if (!readSigned(cursor, end, &world.ammoCount)) return false;
+
+	if (cursor == end) return false;
+	if (*cursor++)
+	{
+		uint32_t viewCount;
+		if (!readVarint(cursor, end, &viewCount) || viewCount < 12 || (viewCount - 12) % 16 != 0) return false;
+		if ((size_t)(end - cursor) < viewCount * sizeof(float)) return false;
+
+		size_t gunFloats = viewCount - 12;
+		world.gunTransforms.resize(gunFloats);
+		float vectors[12];
+		if (!readFloats(cursor, end, world.gunTransforms.data(), gunFloats)) return false;
+		if (!readFloats(cursor, end, vectors, 12)) return false;
+		world.cameraOffsetWorld = cyclone::Vector3(vectors[0], vectors[1], vectors[2]);
+		world.aimOffsetWorld = cyclone::Vector3(vectors[3], vectors[4], vectors[5]);
+		world.gunOffsetWorld = cyclone::Vector3(vectors[6], vectors[7], vectors[8]);
+		world.gunEuler = cyclone::Vector3(vectors[9], vectors[10], vectors[11]);
+	}
+
+	uint32_t roundCount;
+	if (!readVarint(cursor, end, &roundCount) || roundCount > (size_t)(end - cursor) / 7) return false;
+	world.rounds.resize(roundCount);
+	for (RoundSnapshot *round = world.rounds.data(); round < world.rounds.data() + roundCount; round++)
+	{
+		for (unsigned i = 0; i < 3; i++)
+		{
+			int32_t current, offset;
+			if (!readSigned(cursor, end, &current) || !readSigned(cursor, end, &offset)) return false;
+			round->current[i] = (float)(current / positionScale);
+			round->previous[i] = (float)((current + offset) / positionScale);
+		}
+		uint32_t radius;
+		if (!readVarint(cursor, end, &radius)) return false;
+		round->radius = (float)(radius / positionScale);
+	}
+	if (cursor != end) return false;
+
+	sequence = frameSequence;
+	synchronised = true;
+	world.stepTime = std::chrono::steady_clock::now();
+	return true;
+}
@@ -0,0 +1,115 @@
+/*
+ * Quantized world snapshots, delta-compressed for spectators.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef SNAPSHOT_STREAM_H
+#define SNAPSHOT_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "WorldSnapshot.h"
+
+/**
+ * A bullseye as it goes over the stream: positions and sizes in 1/1024ths
+ * of a unit, and orientation components in 1/32767ths with the real part
+ * kept positive.
+ */
+struct QuantizedBullseye
+{
+	int32_t position[3];
+	int32_t orientation[4];
+	int32_t halfSize[3];
+};
+
+/**
+ * Turns a sequence of world snapshots into a stream of frames.
+ *
+ * A keyframe holds every bullseye. The frames between keyframes are
+ * deltas against the frame before: they list only the bullseyes whose
+ * quantized state changed, as differences from what was last sent, so
+ * sleeping and fallen targets cost nothing. Rounds always move, so every
+ * frame carries all of them; the gun and camera are sent when they change.
+ * Frames must arrive in order and none may be dropped; a client that
+ * loses its place asks for a keyframe.
+ */
+class SnapshotEncoder
+{
+public:
+	/** Creates an encoder that sends a keyframe at least every keyframeInterval frames. */
+	SnapshotEncoder(unsigned keyframeInterval = 600);
+
+	/**
+	 * Appends the next frame for world to frame, and returns true if it
+	 * is a keyframe. Only the bullseyes that changed are written, though
+	 * every one is checked.
+	 */
+	bool encode(const WorldSnapshot &world, std::vector<unsigned char> *frame);
+
+	/** Makes the next frame a keyframe, for a client joining or resynchronising. */
+	void requestKeyframe() { keyframeDue = true; }
+
+	/** Returns the sequence number of the last frame written. */
+	uint32_t getSequence() const { return sequence; }
+
+private:
+	/** What the client holds after the last frame. */
+	std::vector<QuantizedBullseye> baseline;
+	std::vector<float> viewBaseline;
+
+	/** Scratch space for a delta's changes and the view, kept between frames. */
+	std::vector<unsigned char> changes;
+	std::vector<float> view;
+
+	uint32_t sequence;
+	unsigned keyframeInterval;
+	unsigned sinceKeyframe;
+	bool keyframeDue;
+};
+
+/**
+ * The receiving end of a snapshot stream: rebuilds the world a frame at a
+ * time, for a spectator to draw. A delta only touches the bullseyes it
+ * lists, plus those it listed last time, which stop moving.
+ */
+class SpectatorClient
+{
+public:
+	SpectatorClient();
+
+	/**
+	 * Applies a frame. Returns false if the frame is corrupt or isn't the
+	 * one after the last applied, in which case the world is left as it
+	 * was or half updated and only a keyframe is taken until one arrives.
+	 */
+	bool receive(const unsigned char *frame, size_t size);
+
+	/** Returns the rebuilt world, stamped with when its last frame arrived. */
+	const WorldSnapshot& getWorld() const { return world; }
+
+	/** Returns true once a keyframe has been taken and no frame has been lost since. */
+	bool isSynchronised() const { return synchronised; }
+
+private:
+	WorldSnapshot world;
+	std::vector<QuantizedBullseye> state;
+
+	/** Bullseyes the last frame moved, whose previous state catches up on the next. */
+	std::vector<uint32_t> moved;
+
+	uint32_t sequence;
+	bool synchronised;
+
+	/** Sets a bullseye's world state from its quantized state. */
+	void rebuild(uint32_t index);
+};
+
+#endif // SNAPSHOT_STREAM_H
@@ -0,0 +1,62 @@
+/*
+ * Lock-free queue for passing values from one thread to one other thread.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+
+/**
+ * A fixed size ring buffer with exactly one producer thread and one
+ * consumer thread. Neither side ever blocks: push fails when the queue is
+ * full and pop fails when it's empty. Capacity must be a power of two.
+ */
+template <class T, unsigned Capacity>
+class SpscQueue
+{
+public:
+	SpscQueue() : head(0), tail(0) {}
+
+	/** Adds a value from the producer thread. Returns false if the queue is full. */
+	bool push(const T &value)
+	{
+		unsigned write = tail.load(std::memory_order_relaxed);
+		if (write - head.load(std::memory_order_acquire) == Capacity) return false;
+		items[write & (Capacity - 1)] = value;
+		tail.store(write + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** Takes the oldest value on the consumer thread. Returns false if the queue is empty. */
+	bool pop(T &value)
+	{
+		unsigned read = head.load(std::memory_order_relaxed);
+		if (read == tail.load(std::memory_order_acquire)) return false;
+		value = items[read & (Capacity - 1)];
+		head.store(read + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	static_assert((Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+	T items[Capacity];
+
+	// The counters run freely and wrap; only their difference matters.
+	// Each is written by one side, so padding keeps them on separate cache lines.
+	char headPadding[64];
+	std::atomic<unsigned> head;
+	char tailPadding[64];
+	std::atomic<unsigned> tail;
+};
+
+#endif // SPSC_QUEUE_H
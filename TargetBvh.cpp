@@ -0,0 +1,257 @@
+/*
+ * Implementation of the target bounding volume hierarchy.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include "TargetBvh.h"
+
+#include <algorithm>
+
+/** Leaves hold up to this many boxes; testing a few boxes is cheaper than another level. */
+static const unsigned leafSize = 4;
+
+/** Deep enough for a tree over far more boxes than a gallery can hold. */
+static const unsigned maxDepth = 64;
+
+TargetBvh::TargetBvh()
+{
+	clear();
+}
+
+void TargetBvh::clear()
+{
+	boxBounds.clear();
+	boxes.clear();
+	order.clear();
+	nodes.clear();
+	needsBuild = needsRefit = false;
+}
+
+void TargetBvh::update(unsigned index, const cyclone::CollisionBox &box)
+{
+	if (index >= boxes.size())
+	{
+		boxBounds.resize(index + 1);
+		boxes.resize(index + 1, NULL);
+	}
+	if (!boxes[index]) needsBuild = true;
+	boxes[index] = &box;
+
+	// The world space extent of an oriented box along an axis is the sum of
+	// its half sizes projected onto that axis.
+	cyclone::Vector3 centre = box.getAxis(3);
+	cyclone::Vector3 axes[3] = { box.getAxis(0), box.getAxis(1), box.getAxis(2) };
+	Bounds &bounds = boxBounds[index];
+	for (unsigned i = 0; i < 3; i++)
+	{
+		cyclone::real extent = 0;
+		for (unsigned axis = 0; axis < 3; axis++)
+		{
+			extent += real_abs(axes[axis][i]) * box.halfSize[axis];
+		}
+		bounds.min[i] = centre[i] - extent;
+		bounds.max[i] = centre[i] + extent;
+	}
+	needsRefit = true;
+}
+
+void TargetBvh::remove(unsigned index)
+{
+	if (index >= boxes.size() || !boxes[index]) return;
+
+	// The box keeps its place in the tree, with bounds no ray can enter.
+	Bounds &bounds = boxBounds[index];
+	for (unsigned i = 0; i < 3; i++)
+	{
+		bounds.min[i] = REAL_MAX;
+		bounds.max[i] = -REAL_MAX;
+	}
+	needsRefit = true;
+}
+
+void TargetBvh::refit()
+{
+	if (needsBuild)
+	{
+		order.clear();
+		for (unsigned index = 0; index < boxes.size(); index++)
+		{
+			if (boxes[index]) order.push_back(index);
+		}
+		nodes.clear();
+		if (!order.empty()) build(0, (unsigned)order.size());
+		needsBuild = needsRefit = false;
+		return;
+	}
+	if (!needsRefit) return;
+
+	for (Node *node = nodes.data() + nodes.size(); node > nodes.data();)
+	{
+		node--;
+		Bounds &bounds = node->bounds;
+		if (node->count > 0)
+		{
+			bounds = boxBounds[order[node->first]];
+			for (const unsigned *index = order.data() + node->first + 1; index < order.data() + node->first + node->count; index++)
+			{
+				const Bounds &box = boxBounds[*index];
+				for (unsigned i = 0; i < 3; i++)
+				{
+					bounds.min[i] = std::min(bounds.min[i], box.min[i]);
+					bounds.max[i] = std::max(bounds.max[i], box.max[i]);
+				}
+			}
+		}
+		else
+		{
+			const Bounds &left = node[1].bounds, &right = nodes[node->first].bounds;
+			for (unsigned i = 0; i < 3; i++)
+			{
+				bounds.min[i] = std::min(left.min[i], right.min[i]);
+				bounds.max[i] = std::max(left.max[i], right.max[i]);
+			}
+		}
+	}
+	needsRefit = false;
+}
+
+unsigned TargetBvh::build(unsigned begin, unsigned end)
+{
+	unsigned nodeIndex = (unsigned)nodes.size();
+	nodes.push_back(Node());
+
+	// Bound the boxes, and separately their centres, which choose the split.
+	Bounds bounds, centres;
+	for (unsigned i = 0; i < 3; i++)
+	{
+		bounds.min[i] = centres.min[i] = REAL_MAX;
+		bounds.max[i] = centres.max[i] = -REAL_MAX;
+	}
+	for (const unsigned *index = order.data() + begin; index < order.data() + end; index++)
+	{
+		const Bounds &box = boxBounds[*index];
+		for (unsigned i = 0; i < 3; i++)
+		{
+			cyclone::real centre = (box.min[i] + box.max[i]) * 0.5f;
+			bounds.min[i] = std::min(bounds.min[i], box.min[i]);
+			bounds.max[i] = std::max(bounds.max[i], box.max[i]);
+			centres.min[i] = std::min(centres.min[i], centre);
+			centres.max[i] = std::max(centres.max[i], centre);
+		}
+	}
+	nodes[nodeIndex].bounds = bounds;
+
+	if (end - begin <= leafSize)
+	{
+		nodes[nodeIndex].first = begin;
+		nodes[nodeIndex].count = end - begin;
+		return nodeIndex;
+	}
+
+	// Split at the median along the axis the centres spread furthest on,
+	// which keeps the tree balanced however the lanes are laid out.
+	unsigned axis = 0;
+	for (unsigned i = 1; i < 3; i++)
+	{
+		if (centres.max[i] - centres.min[i] > centres.max[axis] - centres.min[axis]) axis = i;
+	}
+	unsigned middle = begin + (end - begin) / 2;
+	const std::vector<Bounds> &all = boxBounds;
+	std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+		[&all, axis](unsigned a, unsigned b) { return all[a].min[axis] + all[a].max[axis] < all[b].min[axis] + all[b].max[axis]; });
+
+	build(begin, middle);
+	unsigned second = build(middle, end);
+	nodes[nodeIndex].first = second;
+	nodes[nodeIndex].count = 0;
+	return nodeIndex;
+}
+
+cyclone::real TargetBvh::enter(const Bounds &bounds, const cyclone::Vector3 &origin,
+	const cyclone::Vector3 &inverseDirection, cyclone::real maxDistance)
+{
+	// Swapping the slabs would turn empty bounds inside out, so they're caught first.
+	if (bounds.min[0] > bounds.max[0]) return -1;
+
+	cyclone::real near = 0, far = maxDistance;
+	for (unsigned i = 0; i < 3; i++)
+	{
+		cyclone::real t0 = (bounds.min[i] - origin[i]) * inverseDirection[i];
+		cyclone::real t1 = (bounds.max[i] - origin[i]) * inverseDirection[i];
+		if (t0 > t1) std::swap(t0, t1);
+		near = std::max(near, t0);
+		far = std::min(far, t1);
+		if (near > far) return -1;
+	}
+	return near;
+}
+
+bool TargetBvh::raycast(const cyclone::Vector3 &origin, const cyclone::Vector3 &direction,
+	cyclone::real maxDistance, BvhRayHit *hit) const
+{
+	if (nodes.empty()) return false;
+
+	// A zero component gives an infinite inverse, which the slab test handles.
+	cyclone::Vector3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	hit->box = (unsigned)boxes.size();
+	hit->distance = maxDistance;
+
+	unsigned stack[maxDepth];
+	unsigned depth = 0;
+	if (enter(nodes[0].bounds, origin, inverseDirection, maxDistance) >= 0) stack[depth++] = 0;
+	while (depth > 0)
+	{
+		const Node &node = nodes[stack[--depth]];
+		if (node.count > 0)
+		{
+			// Trace the ray through each box in the box's own space, where
+			// it's axis-aligned. The rotation keeps distances the same.
+			for (const unsigned *index = order.data() + node.first; index < order.data() + node.first + node.count; index++)
+			{
+				if (boxBounds[*index].min[0] > boxBounds[*index].max[0]) continue;
+				const cyclone::CollisionBox &box = *boxes[*index];
+				const cyclone::Matrix4 &transform = box.getTransform();
+				cyclone::Vector3 localOrigin = transform.transformInverse(origin);
+				cyclone::Vector3 localDirection = transform.transformInverseDirection(direction);
+				Bounds local;
+				for (unsigned i = 0; i < 3; i++)
+				{
+					local.min[i] = -box.halfSize[i];
+					local.max[i] = box.halfSize[i];
+				}
+				cyclone::Vector3 localInverse(1.0f / localDirection.x, 1.0f / localDirection.y, 1.0f / localDirection.z);
+				cyclone::real distance = enter(local, localOrigin, localInverse, hit->distance);
+				if (distance >= 0 && (distance < hit->distance || hit->box == boxes.size()))
+				{
+					hit->box = *index;
+					hit->distance = distance;
+				}
+			}
+			continue;
+		}
+
+		// Visit the nearer child first, so the farther one can often be
+		// skipped once something closer has been hit.
+		unsigned first = (unsigned)(&node - nodes.data()) + 1, second = node.first;
+		cyclone::real firstDistance = enter(nodes[first].bounds, origin, inverseDirection, hit->distance);
+		cyclone::real secondDistance = enter(nodes[second].bounds, origin, inverseDirection, hit->distance);
+		if (firstDistance >= 0 && secondDistance >= 0 && secondDistance < firstDistance)
+		{
+			std::swap(first, second);
+			std::swap(firstDistance, secondDistance);
+		}
+		if (secondDistance >= 0 && depth < maxDepth) stack[depth++] = second;
+		if (firstDistance >= 0 && depth < maxDepth) stack[depth++] = first;
+	}
+
+	if (hit->box == boxes.size()) return false;
+	hit->point = origin + direction * hit->distance;
+	return true;
+}
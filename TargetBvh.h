@@ -0,0 +1,110 @@
+/*
+ * Bounding volume hierarchy over the targets, for tracing hitscan shots.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef TARGET_BVH_H
+#define TARGET_BVH_H
+
+#include <cyclone.h>
+#include <vector>
+
+/** Where a ray first meets a box. */
+struct BvhRayHit
+{
+	/** Index of the box, as given to TargetBvh::update. */
+	unsigned box;
+	/** Distance along the ray, which is in units when its direction is. */
+	cyclone::real distance;
+	cyclone::Vector3 point;
+};
+
+/**
+ * A binary tree of axis-aligned bounds around oriented boxes, queried with
+ * rays. The tree is built once, split at the median of the boxes' centres
+ * along their widest axis, and after that only refitted: each node's bounds
+ * are recomputed from its children's, bottom up, keeping its shape. The
+ * targets only sway about their lanes, so the tree stays tight without
+ * being rebuilt.
+ *
+ * Boxes are held by index, like the broad phase grid, and are read through
+ * the pointer given to update when the tree is refitted and traced.
+ */
+class TargetBvh
+{
+public:
+	TargetBvh();
+
+	/** Removes every box and the tree. */
+	void clear();
+
+	/** Records where the box with the given index is now, adding it if it's new. */
+	void update(unsigned index, const cyclone::CollisionBox &box);
+
+	/** Leaves the box with the given index out of every query, without changing the tree's shape. */
+	void remove(unsigned index);
+
+	/**
+	 * Brings the tree up to date with the boxes' last updates: builds it
+	 * if boxes have been added since it was built, otherwise refits it.
+	 * Does nothing if nothing has changed.
+	 */
+	void refit();
+
+	/**
+	 * Finds the nearest box the ray from origin along direction meets
+	 * within the given distance. Returns false if there isn't one. Rays
+	 * don't change the tree, so several threads can trace at once.
+	 */
+	bool raycast(const cyclone::Vector3 &origin, const cyclone::Vector3 &direction,
+		cyclone::real maxDistance, BvhRayHit *hit) const;
+
+	/** Returns the number of nodes in the tree, for reporting. */
+	unsigned getNodeCount() const { return (unsigned)nodes.size(); }
+
+private:
+	/** Axis-aligned bounds; empty bounds have their minimum above their maximum. */
+	struct Bounds
+	{
+		cyclone::real min[3], max[3];
+	};
+
+	/**
+	 * A node is a leaf of count boxes starting at first in the order
+	 * array, or, with a count of zero, a branch whose first child follows
+	 * it and whose second child is at first. Children always come after
+	 * their parent, so refitting walks the array backwards.
+	 */
+	struct Node
+	{
+		Bounds bounds;
+		unsigned first, count;
+	};
+
+	/** Builds the subtree over part of the order array, returning its node. */
+	unsigned build(unsigned begin, unsigned end);
+
+	/** Returns the distance at which the ray enters the bounds, or a negative number if it misses them. */
+	static cyclone::real enter(const Bounds &bounds, const cyclone::Vector3 &origin,
+		const cyclone::Vector3 &inverseDirection, cyclone::real maxDistance);
+
+	/** Each box's current world bounds, and the box itself, by index. */
+	std::vector<Bounds> boxBounds;
+	std::vector<const cyclone::CollisionBox*> boxes;
+
+	/** Box indices, grouped so each leaf's are together. */
+	std::vector<unsigned> order;
+	std::vector<Node> nodes;
+
+	/** Whether boxes were added since the tree was built, or moved since it was refitted. */
+	bool needsBuild, needsRefit;
+};
+
+#endif // TARGET_BVH_H
@@ -0,0 +1,90 @@
+/*
+ * Implementation of texture loading.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include "Texture.h"
+#include "MappedFile.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Reads the next whitespace separated header number of a PPM file, skipping comments. */
+static bool readHeaderValue(const unsigned char *&cursor, const unsigned char *end, unsigned *value)
+{
+	while (cursor < end)
+	{
+		if (*cursor == '#')
+		{
+			while (cursor < end && *cursor != '\n') cursor++;
+		}
+		else if (isspace(*cursor)) cursor++;
+		else break;
+	}
+	if (cursor >= end || !isdigit(*cursor)) return false;
+
+	*value = 0;
+	while (cursor < end && isdigit(*cursor))
+	{
+		*value = *value * 10 + (*cursor++ - '0');
+	}
+	return true;
+}
+
+bool readPPM(const char *path, Image *image)
+{
+	MappedFile file;
+	if (!file.open(path) || file.size() < 2) return false;
+
+	const unsigned char *cursor = file.data(), *end = file.data() + file.size();
+	if (cursor[0] != 'P' || cursor[1] != '6') return false;
+	cursor += 2;
+
+	unsigned width, height, maxValue;
+	if (!readHeaderValue(cursor, end, &width) ||
+		!readHeaderValue(cursor, end, &height) ||
+		!readHeaderValue(cursor, end, &maxValue) || maxValue != 255)
+	{
+		return false;
+	}
+	// A single whitespace character separates the header from the pixels.
+	cursor++;
+
+	size_t rowBytes = (size_t)width * 3;
+	if (cursor + rowBytes * height > end) return false;
+
+	// PPM rows run top to bottom, OpenGL expects them bottom to top.
+	image->width = width;
+	image->height = height;
+	image->pixels.resize(rowBytes * height);
+	for (unsigned row = 0; row < height; row++)
+	{
+		memcpy(&image->pixels[rowBytes * (height - 1 - row)], cursor + rowBytes * row, rowBytes);
+	}
+	return true;
+}
+
+GLuint createPlaceholderTexture()
+{
+	static const unsigned char white[3] = { 255, 255, 255 };
+
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, white);
+	return texture;
+}
@@ -0,0 +1,37 @@
+/*
+ * Texture loading for the Shooting Gallery models.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <gl/glew.h>
+#include <vector>
+
+/** Holds an 8 bit RGB image in memory, rows stored bottom to top. */
+struct Image
+{
+	unsigned width = 0;
+	unsigned height = 0;
+	std::vector<unsigned char> pixels;
+};
+
+/** Decodes a binary (P6) PPM file into an image. Returns false on failure. */
+bool readPPM(const char *path, Image *image);
+
+/**
+ * Creates a repeating, mip-mapped texture holding a single white texel,
+ * which draws like an untextured surface until the real levels are
+ * uploaded over it.
+ */
+GLuint createPlaceholderTexture();
+
+#endif // TEXTURE_H
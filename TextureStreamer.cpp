@@ -0,0 +1,267 @@
+/*
+ * Implementation of the texture streamer and its cache format.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include "TextureStreamer.h"
+#include "BlockCompression.h"
+#include "Profiler.h"
+#include "Texture.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
+/** Identifies the cache format; bump the version whenever the layout changes. */
+static const char textureCacheMagic[4] = { 'S', 'G', 'T', 'C' };
+static const uint32_t textureCacheVersion = 2;
+
+/** The only format written so far: the PPMs have no alpha, so BC3 isn't needed. */
+static const uint32_t textureFormatBC1 = 1;
+
+/** The fixed-size header at the start of every texture cache file. */
+struct TextureCacheHeader
+{
+	char magic[4];
+	uint32_t version;
+
+	/** State of the PPM file when the cache was written. */
+	uint64_t sourceModified, sourceSize;
+	uint64_t sourceHash;
+
+	uint32_t format;
+	uint32_t levelCount;
+	TextureCacheLevel levels[maxTextureLevels];
+};
+
+/** Levels in the cache file are aligned so they can be used in place. */
+static const uint64_t levelAlignment = 16;
+
+static uint64_t alignLevel(uint64_t offset)
+{
+	return (offset + levelAlignment - 1) & ~(levelAlignment - 1);
+}
+
+/** Reads a level's memory once, so page faults happen here rather than during the upload. */
+static void touchPages(const unsigned char *data, uint64_t size)
+{
+	volatile unsigned char sink = 0;
+	for (uint64_t offset = 0; offset < size; offset += 4096) sink ^= data[offset];
+	(void)sink;
+}
+
+/** Maps a cache file, returning false if it is missing, corrupt or out of date. */
+static bool mapCache(TextureStream &stream, const std::string &cachePath)
+{
+	if (!stream.file.open(cachePath.c_str())) return false;
+
+	const TextureCacheHeader *header = (const TextureCacheHeader*)stream.file.data();
+	const uint64_t size = stream.file.size();
+	bool valid = size >= sizeof(TextureCacheHeader) &&
+		memcmp(header->magic, textureCacheMagic, sizeof(header->magic)) == 0 &&
+		header->version == textureCacheVersion &&
+		header->format == textureFormatBC1 &&
+		header->levelCount > 0 && header->levelCount <= maxTextureLevels;
+	valid = valid && header->levels[0].width > 0 && header->levels[0].height > 0;
+	// Each level must be half the size of the one before, as they are built,
+	// and hold exactly its BC1 blocks, or the upload would read past it.
+	for (unsigned level = 0; valid && level < header->levelCount; level++)
+	{
+		const TextureCacheLevel &current = header->levels[level];
+		valid = current.offset <= size && current.size <= size - current.offset &&
+			current.size == getBC1Size(current.width, current.height);
+		if (valid && level > 0)
+		{
+			const TextureCacheLevel &larger = header->levels[level - 1];
+			valid = current.width == (larger.width > 1 ? larger.width / 2 : 1) &&
+				current.height == (larger.height > 1 ? larger.height / 2 : 1);
+		}
+	}
+
+	// Unchanged timestamps mean the cache is current. Otherwise the PPM
+	// may only have been touched, so fall back to comparing its contents.
+	FileStamp stamp;
+	valid = valid && getFileStamp(stream.path.c_str(), &stamp);
+	if (valid && (stamp.modified != header->sourceModified || stamp.size != header->sourceSize))
+	{
+		valid = hashFile(stream.path.c_str()) == header->sourceHash;
+	}
+	if (!valid)
+	{
+		stream.file.close();
+		return false;
+	}
+
+	stream.levelCount = header->levelCount;
+	memcpy(stream.levels, header->levels, sizeof(stream.levels));
+	stream.data = stream.file.data();
+	return true;
+}
+
+TextureStreamer::TextureStreamer(AssetLoader &loader)
+: loader(loader), compressedUploads(-1)
+{
+}
+
+std::shared_ptr<TextureStream> TextureStreamer::request(const char *path)
+{
+	std::shared_ptr<TextureStream> stream = std::make_shared<TextureStream>();
+	stream->path = path;
+
+	// The job holds its own reference, so a texture released mid-load is
+	// only freed once the loader is done with it.
+	loader.submit([stream]()
+	{
+		ProfileScope scope("loadTexture");
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if (!stream->cancelled) load(*stream);
+		stream->loadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		stream->finished.store(true, std::memory_order_release);
+	});
+	return stream;
+}
+
+void TextureStreamer::load(TextureStream &stream)
+{
+	std::string cachePath = stream.path + ".texcache";
+	if (mapCache(stream, cachePath))
+	{
+		for (unsigned ready = 1; ready <= stream.levelCount && !stream.cancelled; ready++)
+		{
+			const TextureCacheLevel &level = stream.levels[stream.levelCount - ready];
+			touchPages(stream.data + level.offset, level.size);
+			stream.levelsReady.store(ready, std::memory_order_release);
+		}
+		return;
+	}
+
+	Image image;
+	if (!readPPM(stream.path.c_str(), &image) || image.width == 0 || image.height == 0)
+	{
+		stream.failed = true;
+		return;
+	}
+
+	// Shrink the image all the way down first, so the levels can be
+	// compressed and handed over from the smallest up.
+	std::vector<std::vector<unsigned char> > pixels(1);
+	pixels[0].swap(image.pixels);
+	TextureCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.levels[0].width = image.width;
+	header.levels[0].height = image.height;
+	unsigned levelCount = 1;
+	while ((header.levels[levelCount - 1].width > 1 || header.levels[levelCount - 1].height > 1) && levelCount < maxTextureLevels)
+	{
+		unsigned width = header.levels[levelCount - 1].width, height = header.levels[levelCount - 1].height;
+		pixels.push_back(std::vector<unsigned char>((size_t)(width > 1 ? width / 2 : 1) * (height > 1 ? height / 2 : 1) * 3));
+		downsampleRGB(pixels[levelCount - 1].data(), &width, &height, pixels[levelCount].data());
+		header.levels[levelCount].width = width;
+		header.levels[levelCount].height = height;
+		levelCount++;
+	}
+
+	// The smallest level comes first in the file, so reading it in order streams it in order.
+	uint64_t offset = alignLevel(sizeof(header));
+	for (unsigned level = levelCount; level-- > 0;)
+	{
+		header.levels[level].offset = offset;
+		header.levels[level].size = getBC1Size(header.levels[level].width, header.levels[level].height);
+		offset = alignLevel(offset + header.levels[level].size);
+	}
+
+	memcpy(header.magic, textureCacheMagic, sizeof(header.magic));
+	header.version = textureCacheVersion;
+	header.format = textureFormatBC1;
+	header.levelCount = levelCount;
+	FileStamp stamp = { 0, 0 };
+	getFileStamp(stream.path.c_str(), &stamp);
+	header.sourceModified = stamp.modified;
+	header.sourceSize = stamp.size;
+	header.sourceHash = hashFile(stream.path.c_str());
+
+	stream.built.assign((size_t)offset, 0);
+	memcpy(&stream.built[0], &header, sizeof(header));
+	stream.levelCount = levelCount;
+	memcpy(stream.levels, header.levels, sizeof(stream.levels));
+	stream.data = stream.built.data();
+
+	for (unsigned ready = 1; ready <= levelCount; ready++)
+	{
+		if (stream.cancelled) return;
+		const TextureCacheLevel &level = header.levels[levelCount - ready];
+		compressBC1(pixels[levelCount - ready].data(), level.width, level.height, &stream.built[(size_t)level.offset]);
+		stream.levelsReady.store(ready, std::memory_order_release);
+	}
+
+	FILE *file = fopen(cachePath.c_str(), "wb");
+	bool written = file && fwrite(stream.built.data(), stream.built.size(), 1, file) == 1;
+	if (file) written = (fclose(file) == 0) && written;
+	if (!written)
+	{
+		remove(cachePath.c_str());
+		fprintf(stderr, "Could not write texture cache %s\n", cachePath.c_str());
+	}
+}
+
+bool TextureStreamer::isComplete(const TextureStream &stream)
+{
+	if (!stream.finished.load(std::memory_order_acquire)) return false;
+	return stream.failed || stream.levelsUploaded == stream.levelCount;
+}
+
+size_t TextureStreamer::upload(TextureStream &stream, GLuint name, size_t *budget)
+{
+	if (compressedUploads < 0)
+	{
+		const char *extensions = (const char*)glGetString(GL_EXTENSIONS);
+		compressedUploads = extensions && strstr(extensions, "GL_EXT_texture_compression_s3tc") ? 1 : 0;
+		if (!compressedUploads) printf("S3TC is unavailable, expanding compressed textures when uploading.\n");
+	}
+
+	size_t uploaded = 0;
+	unsigned ready = stream.levelsReady.load(std::memory_order_acquire);
+	if (stream.levelsUploaded < ready) glBindTexture(GL_TEXTURE_2D, name);
+	while (stream.levelsUploaded < ready && (uploaded == 0 || uploaded < *budget))
+	{
+		unsigned level = stream.levelCount - 1 - stream.levelsUploaded;
+		const TextureCacheLevel &layout = stream.levels[level];
+		const unsigned char *blocks = stream.data + layout.offset;
+
+		if (compressedUploads)
+		{
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+				layout.width, layout.height, 0, (GLsizei)layout.size, blocks);
+			uploaded += (size_t)layout.size;
+		}
+		else
+		{
+			decompressed.resize((size_t)layout.width * layout.height * 3);
+			decompressBC1(blocks, layout.width, layout.height, decompressed.data());
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			glTexImage2D(GL_TEXTURE_2D, level, GL_RGB8, layout.width, layout.height, 0,
+				GL_RGB, GL_UNSIGNED_BYTE, decompressed.data());
+			uploaded += decompressed.size();
+		}
+
+		// Only the levels from the newest one down are filled in, so
+		// sampling starts there.
+		if (stream.levelsUploaded == 0) glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, stream.levelCount - 1);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+
+		stream.levelsUploaded++;
+	}
+	*budget = uploaded < *budget ? *budget - uploaded : 0;
+	return uploaded;
+}
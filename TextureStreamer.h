@@ -0,0 +1,114 @@
+/*
+ * Background loading of textures from compressed, mip-mapped caches.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <gl/glew.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include "AssetLoader.h"
+#include "MappedFile.h"
+
+/** Enough levels for a 32768 pixel texture. */
+const unsigned maxTextureLevels = 16;
+
+/** Where one mip level sits in a texture cache. */
+struct TextureCacheLevel
+{
+	uint32_t width, height;
+	uint64_t offset, size;
+};
+
+/**
+ * A texture on its way from disk to OpenGL. The loader thread fills in the
+ * levels from the smallest up, and the GL thread uploads each one as soon
+ * as it's ready, so a blurry texture is drawn long before the full one.
+ */
+struct TextureStream
+{
+	TextureStream() : cancelled(false), levelsReady(0), finished(false), failed(false), loadMilliseconds(0), levelsUploaded(0) {}
+
+	std::string path;
+
+	/** Set by the GL thread when nobody wants the texture any more. */
+	std::atomic<bool> cancelled;
+
+	/** Levels whose data is in memory, counted from the smallest. */
+	std::atomic<unsigned> levelsReady;
+
+	/** Set when the loader is done with the stream, whether or not it succeeded. */
+	std::atomic<bool> finished;
+	bool failed;
+
+	/** Wall-clock time the loader spent mapping or building the cache. */
+	double loadMilliseconds;
+
+	/** The size and layout of the levels, set before the first is ready. Level zero is the full size. */
+	unsigned levelCount;
+	TextureCacheLevel levels[maxTextureLevels];
+	const unsigned char *data;
+
+	/** The mapped cache, or the cache built in memory if there wasn't a current one. */
+	MappedFile file;
+	std::vector<unsigned char> built;
+
+	/** Levels already handed to OpenGL; only touched by the GL thread. */
+	unsigned levelsUploaded;
+};
+
+/**
+ * Converts PPM textures once into BC1 compressed caches beside them
+ * (<texture>.ppm.texcache) holding every mip level, smallest first. A
+ * cache is rebuilt when its PPM's timestamp and contents change.
+ *
+ * Caches are read and built on the asset loader's threads; uploading stays
+ * on the GL thread.
+ */
+class TextureStreamer
+{
+public:
+	/** Creates a streamer whose caches are read by the given loader. */
+	explicit TextureStreamer(AssetLoader &loader);
+
+	/** Starts loading a texture in the background. */
+	std::shared_ptr<TextureStream> request(const char *path);
+
+	/**
+	 * Uploads the levels that are ready for a texture, lowest detail first,
+	 * stopping once the byte budget is spent; at least one level is always
+	 * uploaded if one is ready. Returns the bytes of texture memory the
+	 * uploads took. Needs the GL context.
+	 */
+	size_t upload(TextureStream &stream, GLuint name, size_t *budget);
+
+	/** Returns true once every level of a stream is uploaded, or it failed. */
+	static bool isComplete(const TextureStream &stream);
+
+private:
+	AssetLoader &loader;
+
+	/** Whether the driver takes BC1 data directly, checked on the first upload. */
+	int compressedUploads;
+	std::vector<unsigned char> decompressed;
+
+	/** Maps or builds a stream's cache, making its levels ready as it goes. */
+	static void load(TextureStream &stream);
+
+	TextureStreamer(const TextureStreamer&);
+	TextureStreamer& operator=(const TextureStreamer&);
+};
+
+#endif // TEXTURE_STREAMER_H
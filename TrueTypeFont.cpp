@@ -0,0 +1,437 @@
+/*
+ * Implementation of the TrueType font reader and glyph rasterizer.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include "TrueTypeFont.h"
+
+#include <math.h>
+#include <string.h>
+
+/** Composite glyph flags. */
+enum
+{
+	ARGS_ARE_WORDS = 0x0001,
+	ARGS_ARE_XY_VALUES = 0x0002,
+	HAS_SCALE = 0x0008,
+	MORE_COMPONENTS = 0x0020,
+	HAS_XY_SCALE = 0x0040,
+	HAS_TWO_BY_TWO = 0x0080
+};
+
+/** Composites nest glyphs; real fonts go a level or two deep, so deeper is taken as a loop. */
+static const unsigned maxCompositeDepth = 8;
+
+/** Font files are big-endian. */
+static unsigned readU16(const unsigned char *p) { return (p[0] << 8) | p[1]; }
+static int readS16(const unsigned char *p) { return (int16_t)readU16(p); }
+static uint32_t readU32(const unsigned char *p) { return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]; }
+
+/** Reads a 2.14 fixed point number, as composite scales are stored. */
+static float readF2Dot14(const unsigned char *p) { return readS16(p) / 16384.0f; }
+
+/** Adds a straight edge to a coverage accumulation buffer, in pixels with y down. */
+static void accumulateLine(float *area, unsigned width, unsigned height, float x0, float y0, float x1, float y1)
+{
+	if (y0 == y1) return;
+
+	// Walk down the edge a row at a time, spreading the signed area each
+	// row gains across the pixels the edge crosses in it.
+	float direction = 1.0f;
+	if (y0 > y1)
+	{
+		float swap;
+		swap = x0; x0 = x1; x1 = swap;
+		swap = y0; y0 = y1; y1 = swap;
+		direction = -1.0f;
+	}
+	float slope = (x1 - x0) / (y1 - y0);
+	float x = x0;
+	if (y0 < 0) x -= y0 * slope;
+
+	unsigned firstRow = y0 > 0 ? (unsigned)y0 : 0;
+	unsigned endRow = (unsigned)ceilf(y1) < height ? (unsigned)ceilf(y1) : height;
+	for (unsigned row = firstRow; row < endRow; row++)
+	{
+		float *line = area + row * width;
+		float dy = (row + 1.0f < y1 ? row + 1.0f : y1) - (row > y0 ? (float)row : y0);
+		float xNext = x + slope * dy;
+		float d = dy * direction;
+		float left = x < xNext ? x : xNext, right = x < xNext ? xNext : x;
+		float leftFloor = floorf(left), rightCeil = ceilf(right);
+		int leftPixel = (int)leftFloor, rightPixel = (int)rightCeil;
+
+		if (rightPixel <= leftPixel + 1)
+		{
+			// The edge stays within one pixel in this row.
+			float middle = 0.5f * (x + xNext) - leftFloor;
+			line[leftPixel] += d - d * middle;
+			line[leftPixel + 1] += d * middle;
+		}
+		else
+		{
+			float inverse = 1.0f / (right - left);
+			float leftFraction = left - leftFloor;
+			float firstArea = 0.5f * inverse * (1.0f - leftFraction) * (1.0f - leftFraction);
+			float rightFraction = right - rightCeil + 1.0f;
+			float lastArea = 0.5f * inverse * rightFraction * rightFraction;
+
+			line[leftPixel] += d * firstArea;
+			if (rightPixel == leftPixel + 2)
+			{
+				line[leftPixel + 1] += d * (1.0f - firstArea - lastArea);
+			}
+			else
+			{
+				float secondArea = inverse * (1.5f - leftFraction);
+				line[leftPixel + 1] += d * (secondArea - firstArea);
+				for (int pixel = leftPixel + 2; pixel < rightPixel - 1; pixel++) line[pixel] += d * inverse;
+				float before = secondArea + (rightPixel - leftPixel - 3) * inverse;
+				line[rightPixel - 1] += d * (1.0f - before - lastArea);
+			}
+			line[rightPixel] += d * lastArea;
+		}
+		x = xNext;
+	}
+}
+
+TrueTypeFont::TrueTypeFont()
+: cmap(0), glyf(0), loca(0), hmtx(0), unitsPerEm(1), glyphCount(0), metricCount(0),
+longOffsets(false), ascent(0), descent(0), lineGap(0)
+{
+}
+
+bool TrueTypeFont::load(const char *path)
+{
+	if (!file.open(path) || file.size() < 12) return false;
+	const unsigned char *data = file.data();
+
+	uint32_t head = 0, hhea = 0, maxp = 0;
+	unsigned tableCount = readU16(data + 4);
+	if (12 + 16 * tableCount > file.size()) return false;
+	for (unsigned i = 0; i < tableCount; i++)
+	{
+		const unsigned char *entry = data + 12 + 16 * i;
+		uint32_t offset = readU32(entry + 8);
+		if (offset + readU32(entry + 12) > file.size()) return false;
+
+		if (memcmp(entry, "head", 4) == 0) head = offset;
+		else if (memcmp(entry, "hhea", 4) == 0) hhea = offset;
+		else if (memcmp(entry, "maxp", 4) == 0) maxp = offset;
+		else if (memcmp(entry, "cmap", 4) == 0) cmap = offset;
+		else if (memcmp(entry, "glyf", 4) == 0) glyf = offset;
+		else if (memcmp(entry, "loca", 4) == 0) loca = offset;
+		else if (memcmp(entry, "hmtx", 4) == 0) hmtx = offset;
+	}
+	if (!head || !hhea || !maxp || !cmap || !glyf || !loca || !hmtx) return false;
+
+	unitsPerEm = readU16(data + head + 18);
+	longOffsets = readS16(data + head + 50) != 0;
+	ascent = readS16(data + hhea + 4);
+	descent = readS16(data + hhea + 6);
+	lineGap = readS16(data + hhea + 8);
+	metricCount = readU16(data + hhea + 34);
+	glyphCount = readU16(data + maxp + 4);
+	if (unitsPerEm == 0 || metricCount == 0) return false;
+
+	// Use the Windows Unicode character map, which every font here has.
+	uint32_t found = 0;
+	unsigned mapCount = readU16(data + cmap + 2);
+	for (unsigned i = 0; i < mapCount; i++)
+	{
+		const unsigned char *record = data + cmap + 4 + 8 * i;
+		uint32_t offset = cmap + readU32(record + 4);
+		if (readU16(record) == 3 && readU16(record + 2) == 1 && readU16(data + offset) == 4) found = offset;
+	}
+	cmap = found;
+	return cmap != 0;
+}
+
+unsigned TrueTypeFont::findGlyph(unsigned codepoint) const
+{
+	// Format 4 maps runs of characters with either a fixed delta or a glyph array.
+	const unsigned char *table = file.data() + cmap;
+	unsigned segmentCount = readU16(table + 6) / 2;
+	const unsigned char *ends = table + 14;
+	const unsigned char *starts = ends + segmentCount * 2 + 2;
+	const unsigned char *deltas = starts + segmentCount * 2;
+	const unsigned char *rangeOffsets = deltas + segmentCount * 2;
+
+	for (unsigned segment = 0; segment < segmentCount; segment++)
+	{
+		if (readU16(ends + segment * 2) < codepoint) continue;
+		unsigned start = readU16(starts + segment * 2);
+		if (start > codepoint) return 0;
+
+		unsigned delta = readU16(deltas + segment * 2);
+		unsigned rangeOffset = readU16(rangeOffsets + segment * 2);
+		if (rangeOffset == 0) return (codepoint + delta) & 0xffff;
+
+		unsigned glyph = readU16(rangeOffsets + segment * 2 + rangeOffset + (codepoint - start) * 2);
+		return glyph ? (glyph + delta) & 0xffff : 0;
+	}
+	return 0;
+}
+
+int TrueTypeFont::getAdvance(unsigned glyph) const
+{
+	unsigned metric = glyph < metricCount ? glyph : metricCount - 1;
+	return readU16(file.data() + hmtx + metric * 4);
+}
+
+uint32_t TrueTypeFont::getGlyphData(unsigned glyph, uint32_t *length) const
+{
+	*length = 0;
+	if (glyph >= glyphCount) return 0;
+
+	const unsigned char *offsets = file.data() + loca;
+	uint32_t start, end;
+	if (longOffsets)
+	{
+		start = readU32(offsets + glyph * 4);
+		end = readU32(offsets + glyph * 4 + 4);
+	}
+	else
+	{
+		start = readU16(offsets + glyph * 2) * 2;
+		end = readU16(offsets + glyph * 2 + 2) * 2;
+	}
+	if (end <= start || glyf + end > file.size()) return 0;
+	*length = end - start;
+	return glyf + start;
+}
+
+void TrueTypeFont::getOutline(unsigned glyph, const float transform[6], unsigned depth,
+	std::vector<OutlinePoint> *points, std::vector<unsigned> *contourEnds) const
+{
+	uint32_t length;
+	uint32_t offset = getGlyphData(glyph, &length);
+	if (!offset || length < 10) return;
+	const unsigned char *data = file.data() + offset;
+	const unsigned char *end = data + length;
+	int contourCount = readS16(data);
+
+	if (contourCount < 0)
+	{
+		// A composite: other glyphs, each with its own offset and scale.
+		if (depth >= maxCompositeDepth) return;
+		const unsigned char *component = data + 10;
+		unsigned flags;
+		do
+		{
+			if (component + 4 > end) return;
+			flags = readU16(component);
+			unsigned part = readU16(component + 2);
+			component += 4;
+
+			float local[6] = { 1, 0, 0, 1, 0, 0 };
+			if (flags & ARGS_ARE_WORDS)
+			{
+				local[4] = (float)readS16(component);
+				local[5] = (float)readS16(component + 2);
+				component += 4;
+			}
+			else
+			{
+				local[4] = (float)(signed char)component[0];
+				local[5] = (float)(signed char)component[1];
+				component += 2;
+			}
+			// Components aligned by matching points are rare; they're left unmoved.
+			if (!(flags & ARGS_ARE_XY_VALUES)) local[4] = local[5] = 0;
+
+			if (flags & HAS_SCALE)
+			{
+				local[0] = local[3] = readF2Dot14(component);
+				component += 2;
+			}
+			else if (flags & HAS_XY_SCALE)
+			{
+				local[0] = readF2Dot14(component);
+				local[3] = readF2Dot14(component + 2);
+				component += 4;
+			}
+			else if (flags & HAS_TWO_BY_TWO)
+			{
+				local[0] = readF2Dot14(component);
+				local[1] = readF2Dot14(component + 2);
+				local[2] = readF2Dot14(component + 4);
+				local[3] = readF2Dot14(component + 6);
+				component += 8;
+			}
+
+			// Apply the component's transform first, then the parent's.
+			float combined[6] = {
+				transform[0] * local[0] + transform[2] * local[1],
+				transform[1] * local[0] + transform[3] * local[1],
+				transform[0] * local[2] + transform[2] * local[3],
+				transform[1] * local[2] + transform[3] * local[3],
+				transform[0] * local[4] + transform[2] * local[5] + transform[4],
+				transform[1] * local[4] + transform[3] * local[5] + transform[5]
+			};
+			getOutline(part, combined, depth + 1, points, contourEnds);
+		}
+		while (flags & MORE_COMPONENTS);
+		return;
+	}
+
+	// A simple glyph: contour ends, instructions, then run-length coded
+	// flags and delta-coded coordinates.
+	const unsigned char *cursor = data + 10 + contourCount * 2;
+	if (cursor + 2 > end) return;
+	unsigned pointCount = contourCount > 0 ? readU16(cursor - 2) + 1 : 0;
+	cursor += 2 + readU16(cursor);
+
+	std::vector<unsigned char> flags(pointCount);
+	for (unsigned i = 0; i < pointCount && cursor < end;)
+	{
+		unsigned char flag = *cursor++;
+		unsigned repeat = (flag & 8) && cursor < end ? *cursor++ : 0;
+		for (unsigned copy = 0; copy <= repeat && i < pointCount; copy++) flags[i++] = flag;
+	}
+
+	size_t first = points->size();
+	points->resize(first + pointCount);
+	OutlinePoint *point = points->data() + first;
+	int x = 0, y = 0;
+	for (unsigned i = 0; i < pointCount && cursor < end; i++)
+	{
+		if (flags[i] & 2) x += (flags[i] & 16) ? *cursor++ : -*cursor++;
+		else if (!(flags[i] & 16)) { x += readS16(cursor); cursor += 2; }
+		point[i].x = (float)x;
+		point[i].onCurve = (flags[i] & 1) != 0;
+	}
+	for (unsigned i = 0; i < pointCount && cursor < end; i++)
+	{
+		if (flags[i] & 4) y += (flags[i] & 32) ? *cursor++ : -*cursor++;
+		else if (!(flags[i] & 32)) { y += readS16(cursor); cursor += 2; }
+		point[i].y = (float)y;
+	}
+
+	for (unsigned i = 0; i < pointCount; i++)
+	{
+		float px = point[i].x, py = point[i].y;
+		point[i].x = transform[0] * px + transform[2] * py + transform[4];
+		point[i].y = transform[1] * px + transform[3] * py + transform[5];
+	}
+	for (int contour = 0; contour < contourCount; contour++)
+	{
+		unsigned last = readU16(data + 10 + contour * 2);
+		contourEnds->push_back((unsigned)first + (last < pointCount ? last + 1 : pointCount));
+	}
+}
+
+void TrueTypeFont::rasterize(unsigned glyph, float scale, GlyphBitmap *bitmap) const
+{
+	bitmap->width = bitmap->height = 0;
+	bitmap->left = bitmap->top = 0;
+	bitmap->coverage.clear();
+
+	std::vector<OutlinePoint> points;
+	std::vector<unsigned> contourEnds;
+	const float identity[6] = { 1, 0, 0, 1, 0, 0 };
+	getOutline(glyph, identity, 0, &points, &contourEnds);
+	if (points.empty()) return;
+
+	// Control points bound the curves, so their box holds the whole glyph.
+	float minX = points[0].x, maxX = minX, minY = points[0].y, maxY = minY;
+	for (const OutlinePoint *point = points.data(); point < points.data() + points.size(); point++)
+	{
+		if (point->x < minX) minX = point->x;
+		if (point->x > maxX) maxX = point->x;
+		if (point->y < minY) minY = point->y;
+		if (point->y > maxY) maxY = point->y;
+	}
+
+	// A pixel of margin all round keeps the edges' area inside the buffer.
+	bitmap->left = (int)floorf(minX * scale) - 1;
+	bitmap->top = (int)ceilf(maxY * scale) + 1;
+	bitmap->width = (unsigned)((int)ceilf(maxX * scale) + 2 - bitmap->left);
+	bitmap->height = (unsigned)(bitmap->top - ((int)floorf(minY * scale) - 1));
+	std::vector<float> area(bitmap->width * bitmap->height + 2, 0.0f);
+
+	unsigned start = 0;
+	for (unsigned *contourEnd = contourEnds.data(); contourEnd < contourEnds.data() + contourEnds.size(); contourEnd++)
+	{
+		unsigned count = *contourEnd - start;
+		if (*contourEnd > points.size() || count < 2)
+		{
+			start = *contourEnd;
+			continue;
+		}
+
+		// Put the implied on-curve point between each pair of control
+		// points, so the contour alternates as quadratic curves expect.
+		std::vector<OutlinePoint> contour;
+		for (unsigned i = 0; i < count; i++)
+		{
+			const OutlinePoint &point = points[start + i], &next = points[start + (i + 1) % count];
+			OutlinePoint pixel = { point.x * scale - bitmap->left, bitmap->top - point.y * scale, point.onCurve };
+			contour.push_back(pixel);
+			if (!point.onCurve && !next.onCurve)
+			{
+				OutlinePoint middle = { (point.x + next.x) * 0.5f * scale - bitmap->left,
+					bitmap->top - (point.y + next.y) * 0.5f * scale, true };
+				contour.push_back(middle);
+			}
+		}
+		start = *contourEnd;
+
+		unsigned first = 0;
+		while (first < contour.size() && !contour[first].onCurve) first++;
+		if (first == contour.size()) continue;
+
+		unsigned size = (unsigned)contour.size();
+		OutlinePoint current = contour[first];
+		for (unsigned step = 1; step <= size;)
+		{
+			const OutlinePoint &next = contour[(first + step) % size];
+			if (next.onCurve)
+			{
+				accumulateLine(area.data(), bitmap->width, bitmap->height, current.x, current.y, next.x, next.y);
+				current = next;
+				step++;
+				continue;
+			}
+
+			// Flatten the curve into enough lines to look smooth at this size.
+			const OutlinePoint &target = contour[(first + step + 1) % size];
+			float bendX = current.x - 2 * next.x + target.x, bendY = current.y - 2 * next.y + target.y;
+			unsigned segments = 1 + (unsigned)sqrtf(sqrtf(bendX * bendX + bendY * bendY) * 4.0f);
+			if (segments > 16) segments = 16;
+			float fromX = current.x, fromY = current.y;
+			for (unsigned segment = 1; segment <= segments; segment++)
+			{
+				float t = (float)segment / segments, u = 1 - t;
+				float toX = u * u * current.x + 2 * u * t * next.x + t * t * target.x;
+				float toY = u * u * current.y + 2 * u * t * next.y + t * t * target.y;
+				accumulateLine(area.data(), bitmap->width, bitmap->height, fromX, fromY, toX, toY);
+				fromX = toX;
+				fromY = toY;
+			}
+			current = target;
+			step += 2;
+		}
+	}
+
+	// Summing the area along each row gives the coverage; its sign only
+	// depends on which way the contour winds.
+	bitmap->coverage.resize(bitmap->width * bitmap->height);
+	for (unsigned row = 0; row < bitmap->height; row++)
+	{
+		float sum = 0;
+		for (unsigned column = 0; column < bitmap->width; column++)
+		{
+			sum += area[row * bitmap->width + column];
+			float coverage = fabsf(sum);
+			bitmap->coverage[row * bitmap->width + column] = (unsigned char)((coverage < 1.0f ? coverage : 1.0f) * 255.0f + 0.5f);
+		}
+	}
+}
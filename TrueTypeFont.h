@@ -0,0 +1,88 @@
+/*
+ * Reads TrueType font files and rasterizes their glyphs.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef TRUETYPE_FONT_H
+#define TRUETYPE_FONT_H
+
+#include <stdint.h>
+#include <vector>
+#include "MappedFile.h"
+
+/** An 8 bit coverage image of one glyph, rows stored top to bottom. */
+struct GlyphBitmap
+{
+	unsigned width = 0;
+	unsigned height = 0;
+	/** Where the bitmap's top left corner sits relative to the pen, in pixels with y up. */
+	int left = 0;
+	int top = 0;
+	std::vector<unsigned char> coverage;
+};
+
+/**
+ * A TrueType (glyf outline) font mapped from disk. Only what the HUD needs
+ * is read: the Unicode character map, horizontal metrics and the outlines,
+ * including composite glyphs. Hinting instructions and kerning are ignored,
+ * and glyphs are filled with anti-aliased coverage.
+ */
+class TrueTypeFont
+{
+public:
+	TrueTypeFont();
+
+	/** Maps and checks a font file. Returns false if it can't be used. */
+	bool load(const char *path);
+
+	/** Returns the glyph for a character, or zero (the missing glyph) if there isn't one. */
+	unsigned findGlyph(unsigned codepoint) const;
+
+	/** Returns the scale from font units to pixels for the given em size. */
+	float getScale(float pixelHeight) const { return pixelHeight / unitsPerEm; }
+
+	/** Returns how far the pen moves after a glyph, in font units. */
+	int getAdvance(unsigned glyph) const;
+
+	/** Returns the distance from one baseline to the next, in font units. */
+	int getLineHeight() const { return ascent - descent + lineGap; }
+
+	/** Fills the glyph's outline at the given scale. Empty glyphs give an empty bitmap. */
+	void rasterize(unsigned glyph, float scale, GlyphBitmap *bitmap) const;
+
+private:
+	MappedFile file;
+	uint32_t cmap, glyf, loca, hmtx;
+	unsigned unitsPerEm, glyphCount, metricCount;
+	bool longOffsets;
+	int ascent, descent, lineGap;
+
+	/** A point of an outline in font units, and whether it lies on the curve. */
+	struct OutlinePoint
+	{
+		float x, y;
+		bool onCurve;
+	};
+
+	/** Returns the offset and length of a glyph's outline data, zero for empty glyphs. */
+	uint32_t getGlyphData(unsigned glyph, uint32_t *length) const;
+
+	/**
+	 * Appends a glyph's points to a list, placed by a 2x3 transform, along
+	 * with the index after the last point of each contour.
+	 */
+	void getOutline(unsigned glyph, const float transform[6], unsigned depth,
+		std::vector<OutlinePoint> *points, std::vector<unsigned> *contourEnds) const;
+
+	TrueTypeFont(const TrueTypeFont&);
+	TrueTypeFont& operator=(const TrueTypeFont&);
+};
+
+#endif // TRUETYPE_FONT_H
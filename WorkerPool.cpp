@@ -0,0 +1,174 @@
+/*
+ * Implementation of the worker pool.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include "WorkerPool.h"
+#include "Profiler.h"
+
+#include <stdio.h>
+
+WorkerPool::WorkerPool(unsigned workerCount)
+: workerCount(0), shares(NULL), job(NULL), jobGrain(1), generation(0), busyThreads(0), stopping(false)
+{
+	start(workerCount);
+}
+
+WorkerPool::~WorkerPool()
+{
+	stop();
+}
+
+void WorkerPool::setWorkerCount(unsigned workerCount)
+{
+	stop();
+	start(workerCount);
+}
+
+void WorkerPool::start(unsigned count)
+{
+	if (count == 0) count = std::thread::hardware_concurrency();
+	if (count == 0) count = 1;
+
+	workerCount = count;
+	shares = new Share[workerCount];
+	for (Share *share = shares; share < shares + workerCount; share++) share->range = 0;
+
+	stopping = false;
+	for (unsigned worker = 1; worker < workerCount; worker++)
+	{
+		threads.push_back(std::thread(&WorkerPool::threadLoop, this, worker, generation));
+	}
+}
+
+void WorkerPool::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::thread *thread = threads.data(); thread < threads.data() + threads.size(); thread++)
+	{
+		thread->join();
+	}
+	threads.clear();
+
+	delete[] shares;
+	shares = NULL;
+	workerCount = 0;
+}
+
+void WorkerPool::parallelFor(unsigned count, unsigned grain, const RangeFunction &function)
+{
+	if (count == 0) return;
+	if (grain == 0) grain = 1;
+	if (workerCount == 1 || count <= grain)
+	{
+		function(0, count, 0);
+		return;
+	}
+
+	for (unsigned worker = 0; worker < workerCount; worker++)
+	{
+		shares[worker].range = pack((unsigned)((uint64_t)count * worker / workerCount),
+			(unsigned)((uint64_t)count * (worker + 1) / workerCount));
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = &function;
+		jobGrain = grain;
+		busyThreads = workerCount - 1;
+		generation++;
+	}
+	wake.notify_all();
+
+	run(0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (busyThreads > 0) finished.wait(lock);
+	job = NULL;
+}
+
+void WorkerPool::threadLoop(unsigned worker, unsigned seen)
+{
+	char name[32];
+	sprintf(name, "worker %u", worker);
+	Profiler::setThreadName(name);
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!stopping && generation == seen) wake.wait(lock);
+			if (stopping) return;
+			seen = generation;
+		}
+
+		run(worker);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--busyThreads == 0) finished.notify_one();
+	}
+}
+
+void WorkerPool::run(unsigned worker)
+{
+	ProfileScope scope("parallelFor");
+	unsigned begin, end;
+	do
+	{
+		while (take(worker, begin, end)) (*job)(begin, end, worker);
+	}
+	while (steal(worker));
+}
+
+bool WorkerPool::take(unsigned worker, unsigned &begin, unsigned &end)
+{
+	std::atomic<uint64_t> &range = shares[worker].range;
+	uint64_t current = range.load();
+	for (;;)
+	{
+		begin = (unsigned)current;
+		unsigned last = (unsigned)(current >> 32);
+		if (begin >= last) return false;
+
+		end = last - begin > jobGrain ? begin + jobGrain : last;
+		if (range.compare_exchange_weak(current, pack(end, last))) return true;
+	}
+}
+
+bool WorkerPool::steal(unsigned worker)
+{
+	// Start with the next worker along, so thieves spread over their victims.
+	for (unsigned offset = 1; offset < workerCount; offset++)
+	{
+		std::atomic<uint64_t> &range = shares[(worker + offset) % workerCount].range;
+		uint64_t current = range.load();
+		for (;;)
+		{
+			unsigned begin = (unsigned)current;
+			unsigned end = (unsigned)(current >> 32);
+			if (begin >= end) break;
+
+			// Leave the victim the front half, which it's working towards;
+			// a share smaller than a chunk is taken whole.
+			unsigned middle = end - begin > jobGrain ? begin + (end - begin) / 2 : begin;
+			if (range.compare_exchange_weak(current, pack(begin, middle)))
+			{
+				// Our own share is empty, and thieves leave empty shares alone.
+				shares[worker].range = pack(middle, end);
+				return true;
+			}
+		}
+	}
+	return false;
+}
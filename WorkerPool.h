@@ -0,0 +1,102 @@
+/*
+ * Pool of threads that share out loops over many independent items.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Runs a loop body over a range of indices on several threads, the
+ * calling thread included.
+ *
+ * The range is dealt out evenly between the workers up front. Each worker
+ * takes small chunks from the start of its own share; one that runs out
+ * steals the back half of another's remaining share, so uneven items
+ * don't leave workers idle. Shares are single atomic words, so taking
+ * and stealing never lock.
+ */
+class WorkerPool
+{
+public:
+	/** Called with a chunk of indices [begin, end) and the index of the worker running it. */
+	typedef std::function<void(unsigned begin, unsigned end, unsigned worker)> RangeFunction;
+
+	/** Creates a pool with the given number of workers, or one per core if zero. */
+	explicit WorkerPool(unsigned workerCount = 0);
+
+	~WorkerPool();
+
+	/** Replaces the workers with the given number, or one per core if zero. */
+	void setWorkerCount(unsigned workerCount);
+
+	/** Returns how many workers, including the calling thread, share each loop. */
+	unsigned getWorkerCount() const { return workerCount; }
+
+	/**
+	 * Runs function over [0, count) in chunks of at most grain indices and
+	 * returns when every chunk is done. Must only be called from one
+	 * thread at a time, and not from inside a chunk.
+	 */
+	void parallelFor(unsigned count, unsigned grain, const RangeFunction &function);
+
+private:
+	/** A worker's remaining share, packed as begin in the low half and end in the high half. */
+	struct Share
+	{
+		std::atomic<uint64_t> range;
+
+		// Each share is mostly touched by its own worker.
+		char padding[64 - sizeof(std::atomic<uint64_t>)];
+	};
+
+	unsigned workerCount;
+	Share *shares;
+	std::vector<std::thread> threads;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable finished;
+	const RangeFunction *job;
+	unsigned jobGrain;
+	unsigned generation;
+	unsigned busyThreads;
+	bool stopping;
+
+	static uint64_t pack(unsigned begin, unsigned end) { return ((uint64_t)end << 32) | begin; }
+
+	void start(unsigned workerCount);
+	void stop();
+
+	/** Body of each extra thread: waits for a loop after the given one and helps run it. */
+	void threadLoop(unsigned worker, unsigned seen);
+
+	/** Runs chunks of the current loop until there are none left to take or steal. */
+	void run(unsigned worker);
+
+	/** Takes the next chunk from a worker's own share. */
+	bool take(unsigned worker, unsigned &begin, unsigned &end);
+
+	/** Moves half of another worker's share into this one's. */
+	bool steal(unsigned worker);
+
+	WorkerPool(const WorkerPool&);
+	WorkerPool& operator=(const WorkerPool&);
+};
+
+#endif // WORKER_POOL_H
@@ -0,0 +1,63 @@
+/*
+ * Implementation of world snapshots.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#include "WorldSnapshot.h"
+
+cyclone::real WorldSnapshot::getInterpolation(std::chrono::steady_clock::time_point now) const
+{
+	cyclone::real time = (cyclone::real)(std::chrono::duration<double>(now - stepTime).count() / timestep);
+	if (time < 0) return 0;
+	if (time > 1) return 1;
+	return time;
+}
+
+void WorldSnapshot::getRoundTransform(unsigned index, cyclone::real time, float mat[16]) const
+{
+	// Rounds are spheres, so only their position and size matter.
+	const RoundSnapshot &round = rounds[index];
+	mat[0] = round.radius; mat[1] = 0; mat[2] = 0; mat[3] = 0;
+	mat[4] = 0; mat[5] = round.radius; mat[6] = 0; mat[7] = 0;
+	mat[8] = 0; mat[9] = 0; mat[10] = round.radius; mat[11] = 0;
+	for (unsigned axis = 0; axis < 3; axis++)
+	{
+		mat[12 + axis] = round.previous[axis] + (round.current[axis] - round.previous[axis]) * (float)time;
+	}
+	mat[15] = 1;
+}
+
+void WorldSnapshot::getBullseyeTransform(unsigned index, cyclone::real time, float mat[16]) const
+{
+	const BullseyeSnapshot &bullseye = bullseyes[index];
+
+	// Blend the positions and, taking the shorter way round, the orientations.
+	cyclone::Vector3 position = bullseye.previousPosition + (bullseye.position - bullseye.previousPosition) * time;
+	const cyclone::Quaternion &current = bullseye.orientation;
+	cyclone::Quaternion orientation = bullseye.previousOrientation;
+	cyclone::real dot = current.r * orientation.r + current.i * orientation.i + current.j * orientation.j + current.k * orientation.k;
+	cyclone::real sign = dot < 0 ? -1.0f : 1.0f;
+	orientation.r += (current.r * sign - orientation.r) * time;
+	orientation.i += (current.i * sign - orientation.i) * time;
+	orientation.j += (current.j * sign - orientation.j) * time;
+	orientation.k += (current.k * sign - orientation.k) * time;
+	orientation.normalise();
+
+	cyclone::Matrix4 transform;
+	transform.setOrientationAndPos(orientation, position);
+	transform.fillGLArray(mat);
+
+	// The model doesn't really need scaling but the rigid-body must be sized according to the model dimensions!
+	cyclone::real scale[3] = { bullseye.halfSize.x / 1.2f, bullseye.halfSize.y / 3.0f, bullseye.halfSize.z / 1.0f };
+	for (unsigned column = 0; column < 3; column++)
+	{
+		for (unsigned row = 0; row < 3; row++) mat[column * 4 + row] *= scale[column];
+	}
+}
@@ -0,0 +1,106 @@
+/*
+ * Copies of the world state handed from the simulation to the renderer.
+ *
+ * Part of the Cyclone physics system.
+ *
+ * Copyright (c) Icosagon 2003. All Rights Reserved.
+ *
+ * This software is distributed under licence. Use of this software
+ * implies agreement with all terms and conditions of the accompanying
+ * software licence.
+ */
+
+#ifndef WORLD_SNAPSHOT_H
+#define WORLD_SNAPSHOT_H
+
+#include <cyclone.h>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+/** A round at the start and end of the last step. */
+struct RoundSnapshot
+{
+	float previous[3];
+	float current[3];
+	float radius;
+};
+
+/** A bullseye at the start and end of the last step. */
+struct BullseyeSnapshot
+{
+	cyclone::Vector3 previousPosition, position;
+	cyclone::Quaternion previousOrientation, orientation;
+	cyclone::Vector3 halfSize;
+};
+
+/** Everything display() draws, as of one simulation step. */
+struct WorldSnapshot
+{
+	std::vector<RoundSnapshot> rounds;
+	std::vector<BullseyeSnapshot> bullseyes;
+
+	/** Each gun body's transform, and the aim and camera that go with them. */
+	std::vector<float> gunTransforms;
+	cyclone::Vector3 cameraOffsetWorld, aimOffsetWorld, gunOffsetWorld, gunEuler;
+
+	int score;
+	int targetsRemaining;
+	int ammoCount;
+
+	/** When the last step's state was current, and how long a step is. */
+	std::chrono::steady_clock::time_point stepTime;
+	cyclone::real timestep;
+
+	/** Returns how far the given moment is into the step after this snapshot, from 0 to 1. */
+	cyclone::real getInterpolation(std::chrono::steady_clock::time_point now) const;
+
+	/** Writes the transform that places the unit round mesh over a round. */
+	void getRoundTransform(unsigned index, cyclone::real time, float mat[16]) const;
+
+	/** Writes the transform that places the bullseye model over a bullseye. */
+	void getBullseyeTransform(unsigned index, cyclone::real time, float mat[16]) const;
+};
+
+/**
+ * Hands snapshots from the simulation thread to the render thread without
+ * either waiting for the other. On top of the two buffers being written and
+ * read, a third holds the newest finished snapshot; publishing and
+ * acquiring swap buffers with it.
+ */
+class SnapshotExchange
+{
+public:
+	SnapshotExchange() : back(0), middle(1), front(2) {}
+
+	/** Returns the snapshot for the simulation thread to fill. */
+	WorldSnapshot& beginWrite() { return buffers[back]; }
+
+	/** Makes the filled snapshot the newest one. */
+	void publish()
+	{
+		back = middle.exchange(back | fresh) & indexMask;
+	}
+
+	/** Returns the newest published snapshot for the render thread to read. */
+	const WorldSnapshot& acquire()
+	{
+		if (middle.load() & fresh)
+		{
+			front = middle.exchange(front) & indexMask;
+		}
+		return buffers[front];
+	}
+
+private:
+	/** Set on the middle index when it holds a snapshot the reader hasn't taken. */
+	static const unsigned fresh = 4;
+	static const unsigned indexMask = 3;
+
+	WorldSnapshot buffers[3];
+	unsigned back;
+	std::atomic<unsigned> middle;
+	unsigned front;
+};
+
+#endif // WORLD_SNAPSHOT_H